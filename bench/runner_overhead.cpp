@@ -0,0 +1,314 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+// measures Mayfly itself: synthetic trees of testcases that do (next to) nothing are run in every runner mode, and what the runner
+// cost on top of them is printed as a table; the same executable is the testcase process of its subprocess modes
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <memory>
+#include <thread>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <boost/program_options.hpp>
+
+#include "mayfly.h"
+#include "mayfly/runner.h"
+
+namespace
+{
+    namespace mayfly = reaver::mayfly;
+
+    class null_reporter : public mayfly::reporter
+    {
+    public:
+        virtual void suite_started(const mayfly::suite &) const override
+        {
+        }
+
+        virtual void suite_finished(const mayfly::suite &) const override
+        {
+        }
+
+        virtual void test_started(const mayfly::testcase &) const override
+        {
+        }
+
+        virtual void test_finished(const mayfly::testcase_result &) const override
+        {
+        }
+
+        virtual void summary(mayfly::tests_summary) const override
+        {
+        }
+    };
+
+    // testcase processes rebuild the tree from the scenario's name and size, so it has to come out the same every time
+    std::vector<mayfly::suite> scenario(const std::string & name, std::size_t tests)
+    {
+        if (name == "empty")
+        {
+            std::vector<mayfly::suite> suites;
+            for (std::size_t i = 0; i < 100; ++i)
+            {
+                mayfly::suite s{ "suite " + std::to_string(i) };
+                for (std::size_t j = i; j < tests; j += 100)
+                {
+                    s.add("test " + std::to_string(j), []{});
+                }
+                suites.push_back(std::move(s));
+            }
+            return suites;
+        }
+
+        if (name == "deep")
+        {
+            const std::size_t depth = 64;
+
+            mayfly::suite s{ "level " + std::to_string(depth - 1) };
+            for (std::size_t level = depth; level-- > 0; )
+            {
+                if (level != depth - 1)
+                {
+                    mayfly::suite parent{ "level " + std::to_string(level) };
+                    parent.add(std::move(s));
+                    s = std::move(parent);
+                }
+
+                for (std::size_t j = level; j < tests; j += depth)
+                {
+                    s.add("test " + std::to_string(j), []{});
+                }
+            }
+            return { std::move(s) };
+        }
+
+        if (name == "chatty")
+        {
+            mayfly::suite s{ "chatty" };
+            for (std::size_t i = 0; i < tests / 10; ++i)
+            {
+                s.add("test " + std::to_string(i), []
+                {
+                    for (std::size_t line = 0; line < 100; ++line)
+                    {
+                        std::cout << "line " << line << " of chatty output, long enough to be more than a handful of bytes per line\n";
+                    }
+                    std::cout << std::flush;
+                });
+            }
+            return { std::move(s) };
+        }
+
+        if (name == "failing")
+        {
+            mayfly::suite s{ "failing" };
+            for (std::size_t i = 0; i < tests / 10; ++i)
+            {
+                s.add("test " + std::to_string(i), []
+                {
+                    MAYFLY_CHECK(false);
+                    MAYFLY_CHECK(1 == 2);
+                    MAYFLY_REQUIRE(false);
+                });
+            }
+            return { std::move(s) };
+        }
+
+        throw std::invalid_argument{ "unknown scenario `" + name + "` - available scenarios are `empty`, `deep`, `chatty` and `failing`." };
+    }
+
+    std::vector<mayfly::suite> scenario_from_environment()
+    {
+        auto name = std::getenv("MAYFLY_BENCH_SCENARIO");
+        auto tests = std::getenv("MAYFLY_BENCH_TESTS");
+        return scenario(name ? name : "empty", tests ? std::stoull(tests) : 0);
+    }
+
+    // testcases print, and the runner logs what they printed; none of it is part of the table
+    class silenced_stdout
+    {
+    public:
+        silenced_stdout()
+        {
+            std::cout << std::flush;
+            _saved = ::dup(STDOUT_FILENO);
+
+            auto null = ::open("/dev/null", O_WRONLY);
+            ::dup2(null, STDOUT_FILENO);
+            ::close(null);
+        }
+
+        ~silenced_stdout()
+        {
+            std::cout << std::flush;
+            ::dup2(_saved, STDOUT_FILENO);
+            ::close(_saved);
+        }
+
+    private:
+        int _saved;
+    };
+
+    std::unique_ptr<mayfly::runner> make_runner(const std::string & mode, const std::string & executable, std::size_t tasks, std::size_t timeout,
+        mayfly::result_protocol protocol)
+    {
+        if (mode == "in-process")
+        {
+            return std::make_unique<mayfly::inprocess_runner>(tasks);
+        }
+
+        auto isolation = mayfly::isolation_mode::subprocess;
+        if (mode == "fork-server")
+        {
+            isolation = mayfly::isolation_mode::fork_server;
+        }
+
+        else if (mode == "batch")
+        {
+            isolation = mayfly::isolation_mode::batch;
+        }
+
+        else if (mode != "subprocess")
+        {
+            throw mayfly::invalid_isolation_mode{ mode };
+        }
+
+        return std::make_unique<mayfly::subprocess_runner>(executable, tasks, timeout, boost::none, isolation, protocol);
+    }
+
+    std::string microseconds(std::chrono::nanoseconds time)
+    {
+        std::ostringstream str;
+        str << std::fixed << std::setprecision(1) << std::chrono::duration<double, std::micro>{ time }.count();
+        return str.str();
+    }
+}
+
+int main(int argc, char ** argv) try
+{
+    // started by one of the runners being measured
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--test-id" || arg == "--worker" || arg == "--test" || arg == "-t")
+        {
+            return mayfly::run(scenario_from_environment(), argc, argv);
+        }
+    }
+
+    boost::program_options::options_description config("Mayfly runner benchmarks");
+    config.add_options()
+        ("help,h", "print this message")
+        ("tests,n", boost::program_options::value<std::size_t>()->default_value(10000), "the number of testcases of the empty and deep scenarios (a tenth of it for the others)")
+        ("tasks,j", boost::program_options::value<std::size_t>()->default_value(std::max(1u, std::thread::hardware_concurrency())), "specify the amount of worker threads")
+        ("scenario,s", boost::program_options::value<std::vector<std::string>>()->composing(), "run only these scenarios (empty, deep, chatty, failing)")
+        ("mode,m", boost::program_options::value<std::vector<std::string>>()->composing(), "run only in these modes (in-process, subprocess, fork-server, batch)")
+        ("protocol", boost::program_options::value<std::string>()->default_value("binary"), "the protocol testcase processes report results with (text, binary)")
+        ("timeout,l", boost::program_options::value<std::size_t>()->default_value(60), "specify the timeout for tests (in seconds)");
+
+    boost::program_options::variables_map variables;
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, config), variables);
+    boost::program_options::notify(variables);
+
+    if (variables.count("help"))
+    {
+        std::cout << config;
+        return 0;
+    }
+
+    std::vector<std::string> scenarios{ "empty", "deep", "chatty", "failing" };
+    if (variables.count("scenario"))
+    {
+        scenarios = variables["scenario"].as<std::vector<std::string>>();
+    }
+
+    std::vector<std::string> modes{ "in-process", "subprocess", "fork-server", "batch" };
+    if (variables.count("mode"))
+    {
+        modes = variables["mode"].as<std::vector<std::string>>();
+    }
+
+    auto protocol = mayfly::result_protocol::binary;
+    if (variables["protocol"].as<std::string>() == "text")
+    {
+        protocol = mayfly::result_protocol::text;
+    }
+
+    else if (variables["protocol"].as<std::string>() != "binary")
+    {
+        throw mayfly::invalid_result_protocol{ variables["protocol"].as<std::string>() };
+    }
+
+    auto tests = variables["tests"].as<std::size_t>();
+    auto tasks = variables["tasks"].as<std::size_t>();
+    auto timeout = variables["timeout"].as<std::size_t>();
+
+    std::cout << std::left << std::setw(10) << "scenario" << std::setw(13) << "mode" << std::right << std::setw(8) << "tests" << std::setw(12) << "wall (ms)"
+        << std::setw(16) << "overhead (us)" << std::setw(14) << "start (us)" << std::setw(16) << "results/s" << std::setw(12) << "RSS (kB)" << std::endl;
+
+    for (auto && name : scenarios)
+    {
+        ::setenv("MAYFLY_BENCH_SCENARIO", name.c_str(), 1);
+        ::setenv("MAYFLY_BENCH_TESTS", std::to_string(tests).c_str(), 1);
+
+        auto suites = scenario(name, tests);
+
+        for (auto && mode : modes)
+        {
+            auto runner = make_runner(mode, argv[0], tasks, timeout, protocol);
+            null_reporter rep;
+
+            reaver::mayfly::_detail::_reset_peak_rss();
+
+            {
+                silenced_stdout silence;
+                (*runner)(suites, rep);
+            }
+
+            auto && stats = runner->stats();
+            std::cout << std::left << std::setw(10) << name << std::setw(13) << mode << std::right << std::setw(8) << stats.executed.load()
+                << std::setw(12) << std::chrono::duration_cast<std::chrono::milliseconds>(stats.run).count()
+                << std::setw(16) << microseconds(stats.overhead_per_test()) << std::setw(14) << microseconds(stats.start_latency())
+                << std::setw(16) << static_cast<std::uint64_t>(stats.reporter_throughput()) << std::setw(12) << stats.peak_rss << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+catch (reaver::exception & e)
+{
+    e.print(reaver::logger::default_logger());
+    return 1;
+}
+
+catch (std::exception & e)
+{
+    std::cerr << e.what() << std::endl;
+    return 1;
+}
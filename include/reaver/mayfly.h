@@ -27,3 +27,6 @@
 #include "mayfly/testcase.h"
 #include "mayfly/reporter.h"
 #include "mayfly/asserts.h"
+#include "mayfly/benchmark.h"
+#include "mayfly/parameterized.h"
+#include "mayfly/fixture.h"
@@ -24,7 +24,8 @@
 
 #include <stdexcept>
 #include <vector>
-#include <unordered_map>
+#include <atomic>
+#include <thread>
 
 #include <boost/optional.hpp>
 
@@ -65,16 +66,75 @@ namespace reaver
 
         namespace _detail
         {
+            // a failed assertion, as recorded by the assertion macros: the expression (with any fixed message already appended to
+            // it by the preprocessor) and the file are string literals, so nothing is allocated until the records are formatted
+            // for the report; `value` carries whatever is only known at runtime, and is the whole message when there's no expression
+            struct _assertion_record
+            {
+                const char * expression;
+                const char * file;
+                std::size_t line;
+                std::string value;
+
+                void format(std::string & out) const
+                {
+                    if (!expression)
+                    {
+                        out += value;
+                        return;
+                    }
+
+                    out += expression;
+                    if (!value.empty())
+                    {
+                        out += ": ";
+                        out += value;
+                    }
+
+                    out += " (in ";
+                    out += file;
+                    out += " at line ";
+                    out += std::to_string(line);
+                    out += ")";
+                }
+            };
+
+            // owned by the thread running the testcase; other threads (see MAYFLY_THREAD) only ever push onto a lock-free stack,
+            // which the owner drains before looking at the assertions
             class _assertions_logger
             {
             public:
-                _assertions_logger(bool positive = true, std::size_t assertions_to_fail = 0) : _positive{ positive }, _assertions_to_fail{ assertions_to_fail }
+                _assertions_logger(bool positive = true, std::size_t assertions_to_fail = 0) : _positive{ positive }, _assertions_to_fail{ assertions_to_fail },
+                    _owner{ std::this_thread::get_id() }
+                {
+                }
+
+                _assertions_logger(const _assertions_logger &) = delete;
+                _assertions_logger & operator=(const _assertions_logger &) = delete;
+
+                ~_assertions_logger()
                 {
+                    _drain();
                 }
 
-                void log(std::string str, bool critical = false)
+                void log(_assertion_record record, bool critical = false)
                 {
-                    _assertions.push_back(std::move(str));
+                    if (std::this_thread::get_id() != _owner)
+                    {
+                        // the owner's state can't be touched from here; the failure still gets reported - by the owner
+                        if (critical)
+                        {
+                            std::string description = "assertion failed: ";
+                            record.format(description);
+                            _push(std::move(record));
+                            throw assertions_failed{ std::move(description), 1 };
+                        }
+
+                        _push(std::move(record));
+                        return;
+                    }
+
+                    _assertions.push_back(std::move(record));
 
                     if (critical)
                     {
@@ -84,6 +144,8 @@ namespace reaver
 
                 void throw_exception(bool critical = false)
                 {
+                    _drain();
+
                     if (!_positive)
                     {
                         if (_assertions_to_fail && _assertions.size() != _assertions_to_fail)
@@ -119,55 +181,91 @@ namespace reaver
 
                     if (single)
                     {
-                        exception_string += _assertions[0];
+                        _assertions[0].format(exception_string);
                     }
 
                     else
                     {
                         for (auto && e : _assertions)
                         {
-                            exception_string += "|n - " + e;
+                            exception_string += "|n - ";
+                            e.format(exception_string);
                         }
                     }
 
                     return exception_string;
                 }
 
-                std::vector<std::string> _assertions;
+                struct _node
+                {
+                    _assertion_record record;
+                    _node * next;
+                };
+
+                void _push(_assertion_record record)
+                {
+                    auto node = new _node{ std::move(record), _remote.load(std::memory_order_relaxed) };
+                    while (!_remote.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+                    {
+                    }
+                }
+
+                void _drain()
+                {
+                    auto head = _remote.exchange(nullptr, std::memory_order_acquire);
+
+                    // the stack is newest-first; reverse it to keep the order in which the assertions were made
+                    _node * reversed = nullptr;
+                    while (head)
+                    {
+                        auto next = head->next;
+                        head->next = reversed;
+                        reversed = head;
+                        head = next;
+                    }
+
+                    while (reversed)
+                    {
+                        auto next = reversed->next;
+                        _assertions.push_back(std::move(reversed->record));
+                        delete reversed;
+                        reversed = next;
+                    }
+                }
+
+                std::vector<_assertion_record> _assertions;
                 bool _positive;
                 std::size_t _assertions_to_fail;
+                std::thread::id _owner;
+                std::atomic<_node *> _remote{ nullptr };
             };
 
-            inline boost::optional<_assertions_logger> & _local_assertions_logger(std::thread::id id)
+            // the logger assertions made on this thread go to; set for the duration of a testcase, and inherited by helper threads through MAYFLY_THREAD
+            inline _assertions_logger *& _local_assertions_logger()
             {
-                static std::unordered_map<std::thread::id, boost::optional<_assertions_logger>> loggers;
-
-                return loggers[id];
+                thread_local _assertions_logger * logger = nullptr;
+                return logger;
             }
 
-            inline auto _main_test_thread(boost::optional<std::thread::id> set = {})
+            class _assertions_logger_scope
             {
-                static std::unordered_map<std::thread::id, std::thread::id> map;
-
-                auto id = std::this_thread::get_id();
-
-                if (set)
+            public:
+                _assertions_logger_scope(_assertions_logger * logger) : _previous{ _local_assertions_logger() }
                 {
-                    map[id] = *set;
+                    _local_assertions_logger() = logger;
                 }
 
-                if (map.find(id) == map.end())
+                _assertions_logger_scope(const _assertions_logger_scope &) = delete;
+                _assertions_logger_scope & operator=(const _assertions_logger_scope &) = delete;
+
+                ~_assertions_logger_scope()
                 {
-                    map[id] = id;
+                    _local_assertions_logger() = _previous;
                 }
 
-                return map[id];
-            }
-
-            inline auto & _local_assertions_logger()
-            {
-                return _local_assertions_logger(_main_test_thread());
-            }
+            private:
+                _assertions_logger * _previous;
+            };
         }
 
         class invalid_log_assertion_call : public exception
@@ -179,73 +277,69 @@ namespace reaver
             }
         };
 
-        inline void log_assertion(std::string description, bool critical = false)
+        inline void log_assertion(_detail::_assertion_record record, bool critical = false)
         {
-            auto & logger = _detail::_local_assertions_logger();
+            auto logger = _detail::_local_assertions_logger();
 
             if (!logger)
             {
                 throw invalid_log_assertion_call{};
             }
 
-            logger->log(std::move(description), critical);
+            logger->log(std::move(record), critical);
+        }
+
+        inline void log_assertion(std::string description, bool critical = false)
+        {
+            log_assertion(_detail::_assertion_record{ nullptr, nullptr, 0, std::move(description) }, critical);
         }
     }}
 }
 
-#define MAYFLY_REQUIRE(...)                                                                                           \
-    try { if (!(__VA_ARGS__)) { ::reaver::mayfly::log_assertion(::std::string{ #__VA_ARGS__ }                         \
-        + " (in " + __FILE__ + " at line " + ::std::to_string(__LINE__) + ")", true); } }                             \
-    catch (::reaver::mayfly::expected_failure_exit &) { throw; }                                                      \
-    catch (::reaver::mayfly::assertions_failed &) { throw; }                                                          \
-    catch (...) { ::reaver::mayfly::log_assertion(::std::string{ #__VA_ARGS__ " has thrown an unexpected exception" } \
-        + " (in " + __FILE__ + " at line " + ::std::to_string(__LINE__) + ")", true); }
-
-#define MAYFLY_CHECK(...)                                                                                             \
-    try { if (!(__VA_ARGS__)) { ::reaver::mayfly::log_assertion(::std::string{ #__VA_ARGS__ }                         \
-        + " (in " + __FILE__ + " at line " + ::std::to_string(__LINE__) + ")"); } }                                   \
-    catch (::reaver::mayfly::expected_failure_exit) { throw; }                                                        \
-    catch (...) { ::reaver::mayfly::log_assertion(::std::string{ #__VA_ARGS__ " has thrown an unexpected exception" } \
-        + " (in " + __FILE__ + " at line " + ::std::to_string(__LINE__) + ")", true); }
-
-#define MAYFLY_REQUIRE_THROWS(...)                                                                                     \
-    try { __VA_ARGS__; ::reaver::mayfly::log_assertion(::std::string{ #__VA_ARGS__ " should have thrown, but didn't" } \
-        + " (in " + __FILE__ + " at line " + ::std::to_string(__LINE__) + ")", true); }                                \
-    catch (::reaver::mayfly::assertions_failed & ex) { throw; }                                                        \
+#define MAYFLY_DETAIL_ASSERTION(message) \
+    ::reaver::mayfly::_detail::_assertion_record{ message, __FILE__, __LINE__, {} }
+
+#define MAYFLY_REQUIRE(...)                                                                                                  \
+    try { if (!(__VA_ARGS__)) { ::reaver::mayfly::log_assertion(MAYFLY_DETAIL_ASSERTION(#__VA_ARGS__), true); } }             \
+    catch (::reaver::mayfly::expected_failure_exit &) { throw; }                                                             \
+    catch (::reaver::mayfly::assertions_failed &) { throw; }                                                                 \
+    catch (...) { ::reaver::mayfly::log_assertion(MAYFLY_DETAIL_ASSERTION(#__VA_ARGS__ " has thrown an unexpected exception"), true); }
+
+#define MAYFLY_CHECK(...)                                                                                                    \
+    try { if (!(__VA_ARGS__)) { ::reaver::mayfly::log_assertion(MAYFLY_DETAIL_ASSERTION(#__VA_ARGS__)); } }                   \
+    catch (::reaver::mayfly::expected_failure_exit) { throw; }                                                               \
+    catch (...) { ::reaver::mayfly::log_assertion(MAYFLY_DETAIL_ASSERTION(#__VA_ARGS__ " has thrown an unexpected exception"), true); }
+
+#define MAYFLY_REQUIRE_THROWS(...)                                                                                           \
+    try { __VA_ARGS__; ::reaver::mayfly::log_assertion(MAYFLY_DETAIL_ASSERTION(#__VA_ARGS__ " should have thrown, but didn't"), true); } \
+    catch (::reaver::mayfly::assertions_failed & ex) { throw; }                                                              \
     catch (...) {}
 
-#define MAYFLY_CHECK_THROWS(...)                                                                                      \
-    try { __VA_ARGS__; ::reaver::mayfly::log_assertion(::std::string{ #__VA_ARGS__ " should have thrown, but didn't"} \
-        + " (in " + __FILE__ + " at line " + ::std::to_string(__LINE__) + ")"); } catch (...) {}
-
-#define MAYFLY_REQUIRE_THROWS_TYPE(type, ...)                                                                                                   \
-    try { __VA_ARGS__; ::reaver::mayfly::log_assertion(::std::string{ #__VA_ARGS__ " should have thrown " #type ", but didn't throw anything" } \
-        + " (in " + __FILE__ + " at line " + ::std::to_string(__LINE__) + ")", true); }                                                         \
-    catch (type & e) {}                                                                                                                         \
-    catch (::reaver::mayfly::assertions_failed & ex) { throw; }                                                                                 \
-    catch (...) { ::reaver::mayfly::log_assertion(::std::string{ #__VA_ARGS__ " should have thrown " #type ", but has thrown something else" }  \
-        + " (in " + __FILE__ + " at line " + ::std::to_string(__LINE__) + ")", true); }
-
-#define MAYFLY_CHECK_THROWS_TYPE(type, ...)                                                                                                     \
-    try { __VA_ARGS__; ::reaver::mayfly::log_assertion(::std::string{ #__VA_ARGS__ " should have thrown " #type ", but didn't throw anything" } \
-        + " (in " + __FILE__ + " at line " + ::std::to_string(__LINE__) + ")"); }                                                               \
-    catch (type &) {}                                                                                                                           \
-    catch (...) { ::reaver::mayfly::log_assertion(::std::string{ #__VA_ARGS__ " should have thrown " #type ", but has thrown something else" }  \
-        + " (in " + __FILE__ + " at line " + ::std::to_string(__LINE__) + ")"); }
-
-#define MAYFLY_REQUIRE_NOTHROW(...)                                                                                           \
-    try { __VA_ARGS__; } catch (...) { ::reaver::mayfly::log_assertion(::std::string{ #__VA_ARGS__ " shouldn't have thrown" } \
-        + " (in " + __FILE__ + " at line " + ::std::to_string(__LINE__) + ")", true); }
-
-#define MAYFLY_CHECK_NOTHROW(...)                                                                                             \
-    try { __VA_ARGS__; } catch (...) { ::reaver::mayfly::log_assertion(::std::string{ #__VA_ARGS__ " shouldn't have thrown" } \
-        + " (in " + __FILE__ + " at line " + ::std::to_string(__LINE__) + ")"); }
+#define MAYFLY_CHECK_THROWS(...)                                                                                             \
+    try { __VA_ARGS__; ::reaver::mayfly::log_assertion(MAYFLY_DETAIL_ASSERTION(#__VA_ARGS__ " should have thrown, but didn't")); } catch (...) {}
+
+#define MAYFLY_REQUIRE_THROWS_TYPE(type, ...)                                                                                                 \
+    try { __VA_ARGS__; ::reaver::mayfly::log_assertion(MAYFLY_DETAIL_ASSERTION(#__VA_ARGS__ " should have thrown " #type ", but didn't throw anything"), true); } \
+    catch (type & e) {}                                                                                                                       \
+    catch (::reaver::mayfly::assertions_failed & ex) { throw; }                                                                               \
+    catch (...) { ::reaver::mayfly::log_assertion(MAYFLY_DETAIL_ASSERTION(#__VA_ARGS__ " should have thrown " #type ", but has thrown something else"), true); }
+
+#define MAYFLY_CHECK_THROWS_TYPE(type, ...)                                                                                                   \
+    try { __VA_ARGS__; ::reaver::mayfly::log_assertion(MAYFLY_DETAIL_ASSERTION(#__VA_ARGS__ " should have thrown " #type ", but didn't throw anything")); } \
+    catch (type &) {}                                                                                                                         \
+    catch (...) { ::reaver::mayfly::log_assertion(MAYFLY_DETAIL_ASSERTION(#__VA_ARGS__ " should have thrown " #type ", but has thrown something else")); }
+
+#define MAYFLY_REQUIRE_NOTHROW(...) \
+    try { __VA_ARGS__; } catch (...) { ::reaver::mayfly::log_assertion(MAYFLY_DETAIL_ASSERTION(#__VA_ARGS__ " shouldn't have thrown"), true); }
+
+#define MAYFLY_CHECK_NOTHROW(...) \
+    try { __VA_ARGS__; } catch (...) { ::reaver::mayfly::log_assertion(MAYFLY_DETAIL_ASSERTION(#__VA_ARGS__ " shouldn't have thrown")); }
 
 // multithreaded checks support
 
 #define MAYFLY_MAIN_THREAD \
-    auto _mayfly_main_thread_logger = std::this_thread::get_id()
+    auto _mayfly_main_thread_logger = ::reaver::mayfly::_detail::_local_assertions_logger()
 
 #define MAYFLY_THREAD \
-    ::reaver::mayfly::_detail::_main_test_thread(_mayfly_main_thread_logger)
+    ::reaver::mayfly::_detail::_assertions_logger_scope _mayfly_thread_logger_scope{ _mayfly_main_thread_logger }
 
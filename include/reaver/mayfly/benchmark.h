@@ -0,0 +1,154 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+
+#include "testcase.h"
+#include "suite.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        // all the times are per single iteration of the benchmark's body
+        struct benchmark_result
+        {
+            using duration = std::chrono::duration<double, std::nano>;
+
+            std::string name;
+            std::size_t iterations;
+            std::size_t samples;
+            duration min;
+            duration median;
+            duration p99;
+            duration mean;
+            duration stddev;
+        };
+
+        // makes the compiler assume that `value` is read, so that the computation producing it can't be optimized away
+        template<typename T>
+        inline void do_not_optimize(const T & value)
+        {
+            asm volatile("" : : "r,m"(value) : "memory");
+        }
+
+        // makes the compiler assume that all memory is read and written, so that stores can't be elided
+        inline void clobber()
+        {
+            asm volatile("" : : : "memory");
+        }
+
+        template<typename F>
+        testcase benchmark(std::string name, F body)
+        {
+            return { std::move(name), body, [body](std::size_t iterations)
+            {
+                for (std::size_t i = 0; i < iterations; ++i)
+                {
+                    body();
+                }
+            } };
+        }
+
+        namespace _detail
+        {
+            struct _benchmark_settings
+            {
+                std::chrono::nanoseconds sample_time = std::chrono::milliseconds{ 1 };
+                std::size_t samples = 100;
+            };
+
+            // the iteration count is doubled until a single sample takes at least `sample_time`, so that the clock's resolution
+            // and the cost of reading it don't show in the results
+            inline benchmark_result _measure(const testcase & t, const _benchmark_settings & settings = {})
+            {
+                using clock = std::chrono::steady_clock;
+
+                benchmark_result result{};
+                result.name = t.name();
+                result.samples = settings.samples;
+
+                t.measure([&](auto && iterate)
+                {
+                    auto sample = [&](std::size_t iterations)
+                    {
+                        auto begin = clock::now();
+                        iterate(iterations);
+                        return clock::now() - begin;
+                    };
+
+                    std::size_t iterations = 1;
+                    while (sample(iterations) < settings.sample_time && iterations < (std::size_t{ 1 } << 40))
+                    {
+                        iterations *= 2;
+                    }
+
+                    std::vector<benchmark_result::duration> samples;
+                    samples.reserve(settings.samples);
+
+                    for (std::size_t i = 0; i < settings.samples; ++i)
+                    {
+                        samples.push_back(std::chrono::duration_cast<benchmark_result::duration>(sample(iterations)) / iterations);
+                    }
+
+                    std::sort(samples.begin(), samples.end());
+
+                    result.iterations = iterations;
+                    result.min = samples.front();
+                    result.median = samples[samples.size() / 2];
+                    result.p99 = samples[std::min(samples.size() - 1, static_cast<std::size_t>(std::ceil(samples.size() * 0.99)) - 1)];
+
+                    benchmark_result::duration total{};
+                    for (auto && elem : samples)
+                    {
+                        total += elem;
+                    }
+                    result.mean = total / samples.size();
+
+                    double variance = 0;
+                    for (auto && elem : samples)
+                    {
+                        auto difference = (elem - result.mean).count();
+                        variance += difference * difference;
+                    }
+                    result.stddev = benchmark_result::duration{ std::sqrt(variance / samples.size()) };
+                });
+
+                return result;
+            }
+        }
+    }}
+}
+
+#define MAYFLY_ADD_BENCHMARK_TO(suite, name, ...)                                                                            \
+    namespace { static ::reaver::mayfly::testcase_registrar MAYFLY_DETAIL_UNIQUE_NAME { suite, ::reaver::mayfly::benchmark( \
+        name, __VA_ARGS__) }; }
+
+#define MAYFLY_ADD_BENCHMARK(name, ...) \
+    MAYFLY_ADD_BENCHMARK_TO(reaver_mayfly_suite_path, name, __VA_ARGS__)
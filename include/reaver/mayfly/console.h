@@ -23,11 +23,13 @@
 #pragma once
 
 #include <iomanip>
+#include <sstream>
 
 #include <boost/algorithm/string.hpp>
 
 #include "reporter.h"
 #include "suite.h"
+#include "benchmark.h"
 
 namespace reaver
 {
@@ -59,16 +61,16 @@ namespace reaver
                 switch (result.status)
                 {
                     case testcase_status::passed:
-                        reaver::logger::dlog(reaver::logger::success) << "test passed: `" << result.name << "`, in " << result.duration.count() << "ms.";
+                        reaver::logger::dlog(reaver::logger::success) << "test passed: `" << result.name << "`, in " << _time(result.duration) << _usage(result) << ".";
                         break;
 
                     case testcase_status::failed:
-                        reaver::logger::dlog(reaver::logger::error) << "test failed: `" << result.name << "`, in " << result.duration.count() << "ms." << (description.empty() ? "" : "\nReason: ")
+                        reaver::logger::dlog(reaver::logger::error) << "test failed: `" << result.name << "`, in " << _time(result.duration) << _usage(result) << "." << (description.empty() ? "" : "\nReason: ")
                             << style::style() << description;
                         break;
 
                     case testcase_status::crashed:
-                        reaver::logger::dlog(reaver::logger::error) << "test crashed: `" << result.name << "`, in " << result.duration.count() << "ms." << (description.empty() ? "" : "\nReason: ")
+                        reaver::logger::dlog(reaver::logger::error) << "test crashed: `" << result.name << "`, in " << _time(result.duration) << _usage(result) << "." << (description.empty() ? "" : "\nReason: ")
                             << style::style() << description;
                         break;
 
@@ -76,11 +78,32 @@ namespace reaver
                         reaver::logger::dlog(reaver::logger::error) << "test timed out: `" << result.name << "`.";
                         break;
 
+                    case testcase_status::regressed:
+                        reaver::logger::dlog(reaver::logger::warning) << "test regressed: `" << result.name << "`, in " << _time(result.duration) << _usage(result) << ".\nReason: "
+                            << style::style() << description;
+                        break;
+
+                    case testcase_status::leaked:
+                    case testcase_status::data_race:
+                    case testcase_status::memory_error:
+                    case testcase_status::undefined_behavior:
+                        reaver::logger::dlog(reaver::logger::error) << "test failed a sanitizer check (" << _finding(result.status) << "): `" << result.name << "`, in " << _time(result.duration) << _usage(result)
+                            << ".\nReason: " << style::style() << description;
+                        break;
+
                     default:
                         throw invalid_testcase_status{};
                 }
             }
 
+            virtual void benchmark_finished(const benchmark_result & b) const override
+            {
+                auto ns = [](benchmark_result::duration d){ return std::to_string(static_cast<std::uintmax_t>(std::llround(d.count()))) + "ns"; };
+
+                reaver::logger::dlog(reaver::logger::info) << "benchmark `" << b.name << "`: median " << ns(b.median) << ", min " << ns(b.min) << ", p99 "
+                    << ns(b.p99) << ", stddev " << ns(b.stddev) << " (" << b.samples << " samples of " << b.iterations << " iterations).";
+            }
+
             virtual void summary(tests_summary summary) const override
             {
                 auto && white = style::style(style::colors::bgray, style::colors::def, style::styles::bold);
@@ -90,6 +113,8 @@ namespace reaver
 
                 std::uintmax_t crashed = 0;
                 std::uintmax_t timed_out = 0;
+                std::uintmax_t regressed = 0;
+                std::uintmax_t sanitized = 0;
 
                 if (summary.failed_tests.size())
                 {
@@ -114,6 +139,19 @@ namespace reaver
                             ++timed_out;
                             break;
 
+                        case testcase_status::regressed:
+                            reaver::logger::dlog() << white << " - " << elem.second << ": " << yellow << "REGRESSED";
+                            ++regressed;
+                            break;
+
+                        case testcase_status::leaked:
+                        case testcase_status::data_race:
+                        case testcase_status::memory_error:
+                        case testcase_status::undefined_behavior:
+                            reaver::logger::dlog() << white << " - " << elem.second << ": " << red << boost::algorithm::to_upper_copy(_finding(elem.first));
+                            ++sanitized;
+                            break;
+
                         default:
                             ;
                     }
@@ -142,9 +180,9 @@ namespace reaver
                     reaver::logger::dlog() << green << "Passed" <<  white << ":    " << to_string_width(summary.passed, width) << " / " << summary.total;
                 }
 
-                if (summary.total - summary.passed - crashed - timed_out)
+                if (summary.total - summary.passed - crashed - timed_out - regressed - sanitized)
                 {
-                    reaver::logger::dlog() << red << "Failed" <<  white << ":    " << to_string_width(summary.total - summary.passed - crashed - timed_out, width) << " / " << summary.total;
+                    reaver::logger::dlog() << red << "Failed" <<  white << ":    " << to_string_width(summary.total - summary.passed - crashed - timed_out - regressed - sanitized, width) << " / " << summary.total;
                 }
 
                 if (crashed)
@@ -157,11 +195,71 @@ namespace reaver
                     reaver::logger::dlog() << yellow << "Timed out" << white << ": " << to_string_width(timed_out, width) << " / " << summary.total;
                 }
 
+                if (sanitized)
+                {
+                    reaver::logger::dlog() << red << "Sanitizer" << white << ": " << to_string_width(sanitized, width) << " / " << summary.total;
+                }
+
+                if (regressed)
+                {
+                    reaver::logger::dlog() << yellow << "Regressed" << white << ": " << to_string_width(regressed, width) << " / " << summary.total;
+                }
+
+                if (summary.not_run)
+                {
+                    reaver::logger::dlog() << yellow << "Not run" << white << ":   " << summary.not_run << " (stopped after too many failures)";
+                }
+
                 if (summary.actual_time.count())
                 {
                     reaver::logger::dlog() << green << "Clock time taken" << white << ": " << summary.actual_time.count() << "ms.";
                 }
             }
+
+        private:
+            static std::string _finding(testcase_status status)
+            {
+                switch (status)
+                {
+                    case testcase_status::leaked:
+                        return "memory leak";
+                    case testcase_status::data_race:
+                        return "data race";
+                    case testcase_status::memory_error:
+                        return "memory error";
+                    case testcase_status::undefined_behavior:
+                        return "undefined behavior";
+                    default:
+                        throw invalid_testcase_status{};
+                }
+            }
+
+            static std::string _time(std::chrono::nanoseconds time)
+            {
+                std::ostringstream str;
+                str << std::fixed << std::setprecision(3) << std::chrono::duration<double, std::milli>{ time }.count() << "ms";
+                return str.str();
+            }
+
+            // nothing is known about the resources of a testcase whose process didn't get to report on it
+            static std::string _usage(const testcase_result & result)
+            {
+                auto && usage = result.usage;
+                if (!usage.peak_rss)
+                {
+                    return {};
+                }
+
+                auto description = " (user " + _time(usage.user_time) + ", system " + _time(usage.system_time) + ", peak RSS " + std::to_string(usage.peak_rss) + "kB, "
+                    + std::to_string(usage.minor_faults) + " minor and " + std::to_string(usage.major_faults) + " major page faults";
+
+                for (auto && counter : result.counters)
+                {
+                    description += ", " + std::to_string(counter.second) + " " + counter.first;
+                }
+
+                return description + ")";
+            }
         };
 
         MAYFLY_REPORTER_REGISTER("console", console_reporter)
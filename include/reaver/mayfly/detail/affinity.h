@@ -0,0 +1,287 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+#include <sched.h>
+#include <sys/types.h>
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        enum class worker_placement
+        {
+            none,
+            cpu,
+            numa
+        };
+
+        namespace _detail
+        {
+            // the last CPU the process may run on; the kernel tends to fill the low-numbered ones first, so this one is usually the quietest
+            inline int _last_allowed_cpu()
+            {
+                ::cpu_set_t set;
+                CPU_ZERO(&set);
+
+                if (::sched_getaffinity(0, sizeof(set), &set) == -1)
+                {
+                    return -1;
+                }
+
+                for (int cpu = CPU_SETSIZE - 1; cpu >= 0; --cpu)
+                {
+                    if (CPU_ISSET(cpu, &set))
+                    {
+                        return cpu;
+                    }
+                }
+
+                return -1;
+            }
+
+            inline std::vector<int> _allowed_cpus()
+            {
+                std::vector<int> cpus;
+
+                ::cpu_set_t set;
+                CPU_ZERO(&set);
+
+                if (::sched_getaffinity(0, sizeof(set), &set) == -1)
+                {
+                    return cpus;
+                }
+
+                for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                {
+                    if (CPU_ISSET(cpu, &set))
+                    {
+                        cpus.push_back(cpu);
+                    }
+                }
+
+                return cpus;
+            }
+
+            // `0-3,8,10-11`, as in the cpulist files of sysfs
+            inline std::vector<int> _parse_cpu_list(const std::string & list)
+            {
+                std::vector<int> cpus;
+
+                std::size_t position = 0;
+                while (position < list.size())
+                {
+                    auto end = list.find(',', position);
+                    if (end == std::string::npos)
+                    {
+                        end = list.size();
+                    }
+
+                    auto range = list.substr(position, end - position);
+                    position = end + 1;
+
+                    try
+                    {
+                        auto dash = range.find('-');
+                        auto first = std::stoi(range.substr(0, dash));
+                        auto last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+
+                        for (auto cpu = first; cpu <= last; ++cpu)
+                        {
+                            cpus.push_back(cpu);
+                        }
+                    }
+
+                    catch (std::exception &)
+                    {
+                    }
+                }
+
+                return cpus;
+            }
+
+            // the allowed CPUs of every NUMA node that has any; a machine without the sysfs node directory is a single node
+            inline std::vector<std::vector<int>> _numa_nodes()
+            {
+                auto allowed = _allowed_cpus();
+                std::vector<std::vector<int>> nodes;
+
+                for (int node = 0; node < 64; ++node)
+                {
+                    std::ifstream in{ "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist" };
+                    std::string list;
+                    if (!std::getline(in, list))
+                    {
+                        // node numbers can have holes, but there's no node 1 without a node 0
+                        if (node == 1 && nodes.empty())
+                        {
+                            break;
+                        }
+
+                        continue;
+                    }
+
+                    std::vector<int> cpus;
+                    for (auto cpu : _parse_cpu_list(list))
+                    {
+                        if (std::binary_search(allowed.begin(), allowed.end(), cpu))
+                        {
+                            cpus.push_back(cpu);
+                        }
+                    }
+
+                    if (!cpus.empty())
+                    {
+                        nodes.push_back(std::move(cpus));
+                    }
+                }
+
+                if (nodes.empty() && !allowed.empty())
+                {
+                    nodes.push_back(std::move(allowed));
+                }
+
+                return nodes;
+            }
+
+            // the CPUs of every worker slot of a pool of `threads`: a single CPU each, or all the CPUs of a NUMA node, handed out round-robin so
+            // that the slots are spread evenly; `reserved` (the CPU benchmarks run on) is left out, as long as anything else is left
+            inline std::vector<::cpu_set_t> _worker_placement(std::size_t threads, worker_placement placement, int reserved = -1)
+            {
+                std::vector<::cpu_set_t> sets;
+                if (placement == worker_placement::none)
+                {
+                    return sets;
+                }
+
+                auto groups = placement == worker_placement::cpu ? std::vector<std::vector<int>>{} : _numa_nodes();
+                if (placement == worker_placement::cpu)
+                {
+                    for (auto cpu : _allowed_cpus())
+                    {
+                        groups.push_back({ cpu });
+                    }
+                }
+
+                if (reserved >= 0)
+                {
+                    auto without = groups;
+                    for (auto & group : without)
+                    {
+                        group.erase(std::remove(group.begin(), group.end(), reserved), group.end());
+                    }
+                    without.erase(std::remove_if(without.begin(), without.end(), [](auto && group){ return group.empty(); }), without.end());
+
+                    if (!without.empty())
+                    {
+                        groups = std::move(without);
+                    }
+                }
+
+                if (groups.empty())
+                {
+                    return sets;
+                }
+
+                sets.resize(threads);
+                for (std::size_t i = 0; i < threads; ++i)
+                {
+                    CPU_ZERO(&sets[i]);
+                    for (auto cpu : groups[i % groups.size()])
+                    {
+                        CPU_SET(cpu, &sets[i]);
+                    }
+                }
+
+                return sets;
+            }
+
+            // makes another process (a child started by someone else than the calling thread) run where the calling thread does
+            inline void _share_affinity(pid_t pid)
+            {
+                ::cpu_set_t set;
+                CPU_ZERO(&set);
+
+                if (::sched_getaffinity(0, sizeof(set), &set) == 0)
+                {
+                    ::sched_setaffinity(pid, sizeof(set), &set);
+                }
+            }
+
+            // pins the calling thread to a single CPU (or a set of them) for the lifetime of the object; pinning is best-effort, a failure
+            // leaves the thread as it was
+            class _affinity_scope
+            {
+            public:
+                _affinity_scope(int cpu)
+                {
+                    ::cpu_set_t set;
+                    CPU_ZERO(&set);
+
+                    if (cpu >= 0)
+                    {
+                        CPU_SET(cpu, &set);
+                    }
+
+                    _pin(set);
+                }
+
+                _affinity_scope(const ::cpu_set_t & set)
+                {
+                    _pin(set);
+                }
+
+                _affinity_scope(const _affinity_scope &) = delete;
+                _affinity_scope & operator=(const _affinity_scope &) = delete;
+
+                ~_affinity_scope()
+                {
+                    if (_restore)
+                    {
+                        ::sched_setaffinity(0, sizeof(_previous), &_previous);
+                    }
+                }
+
+            private:
+                void _pin(const ::cpu_set_t & set)
+                {
+                    CPU_ZERO(&_previous);
+                    _restore = CPU_COUNT(&set) && ::sched_getaffinity(0, sizeof(_previous), &_previous) == 0;
+
+                    if (_restore)
+                    {
+                        _restore = ::sched_setaffinity(0, sizeof(set), &set) == 0;
+                    }
+                }
+
+                ::cpu_set_t _previous;
+                bool _restore;
+            };
+        }
+    }}
+}
@@ -0,0 +1,135 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cmath>
+#include <string>
+#include <map>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+
+#include <reaver/exception.h>
+
+#include "replace_file.h"
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        class baseline_file_error : public exception
+        {
+        public:
+            baseline_file_error(const std::string & path) : exception{ logger::error }
+            {
+                *this << "failed to write the baseline file `" << path << "`.";
+            }
+        };
+
+        namespace _detail
+        {
+            // for ordinary testcases `time` is their duration and `spread` is zero; for benchmarks they are the median and
+            // the standard error of the median of a single iteration
+            struct _baseline_entry
+            {
+                std::chrono::duration<double, std::nano> time;
+                std::chrono::duration<double, std::nano> spread;
+            };
+
+            using _baseline = std::map<std::string, _baseline_entry>;
+
+            // the standard error of the median of `samples` normally distributed samples is sqrt(pi / 2) ~= 1.2533 times that of their mean
+            inline std::chrono::duration<double, std::nano> _median_error(std::chrono::duration<double, std::nano> stddev, std::size_t samples)
+            {
+                constexpr double half_pi = 1.5707963267948966;
+                return samples ? stddev * std::sqrt(half_pi / static_cast<double>(samples)) : stddev;
+            }
+
+            // one testcase per line: time and spread in nanoseconds, then the full path of the testcase
+            inline _baseline _load_baseline(const std::string & path)
+            {
+                _baseline baseline;
+
+                std::ifstream in{ path };
+                std::string line;
+
+                while (std::getline(in, line))
+                {
+                    auto first = line.find(' ');
+                    auto second = first == std::string::npos ? first : line.find(' ', first + 1);
+                    if (second == std::string::npos)
+                    {
+                        continue;
+                    }
+
+                    try
+                    {
+                        baseline[line.substr(second + 1)] = { std::chrono::duration<double, std::nano>{ std::stod(line.substr(0, first)) },
+                            std::chrono::duration<double, std::nano>{ std::stod(line.substr(first + 1, second - first - 1)) } };
+                    }
+
+                    catch (std::exception &)
+                    {
+                    }
+                }
+
+                return baseline;
+            }
+
+            inline void _save_baseline(const std::string & path, const _baseline & baseline)
+            {
+                _replace_file<baseline_file_error>(path, [&](std::ostream & out)
+                {
+                    out.precision(17);
+
+                    for (auto && elem : baseline)
+                    {
+                        out << elem.second.time.count() << ' ' << elem.second.spread.count() << ' ' << elem.first << '\n';
+                    }
+                });
+            }
+
+            // durations of ordinary testcases are single, coarse measurements that include starting a process on a loaded machine;
+            // differences below this are never a regression
+            constexpr std::chrono::milliseconds _regression_noise_floor{ 50 };
+
+            // a regression needs to exceed the relative threshold and, for benchmarks, to be significant: more than three standard
+            // errors away from the baseline, whichever of the two runs was noisier
+            inline bool _regressed(const _baseline_entry & base, const _baseline_entry & current, double threshold)
+            {
+                if (current.time <= base.time * (1 + threshold))
+                {
+                    return false;
+                }
+
+                auto difference = current.time - base.time;
+
+                if (base.spread.count() == 0 && current.spread.count() == 0)
+                {
+                    return difference > _regression_noise_floor;
+                }
+
+                return difference > 3 * std::max(base.spread, current.spread);
+            }
+        }
+    }}
+}
@@ -0,0 +1,215 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <regex>
+
+#include <reaver/exception.h>
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        class invalid_test_pattern : public exception
+        {
+        public:
+            invalid_test_pattern(const std::string & pattern) : exception{ logger::error }
+            {
+                *this << "invalid test pattern `" << pattern << "`: not a valid regular expression.";
+            }
+        };
+
+        namespace _detail
+        {
+            // `*` matches any sequence of characters, `/` included, and `?` any single one; with `prefix`, returns whether `text`
+            // can still be extended into a match, which is what decides if a suite can contain a matching testcase
+            inline bool _glob_match(const std::string & pattern, const std::string & text, bool prefix = false)
+            {
+                std::size_t p = 0, t = 0;
+                std::size_t star = std::string::npos, resume = 0;
+
+                while (t < text.size())
+                {
+                    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t]))
+                    {
+                        ++p;
+                        ++t;
+                    }
+
+                    else if (p < pattern.size() && pattern[p] == '*')
+                    {
+                        star = p++;
+                        resume = t;
+                    }
+
+                    else if (star != std::string::npos)
+                    {
+                        p = star + 1;
+                        t = ++resume;
+                    }
+
+                    else
+                    {
+                        return false;
+                    }
+                }
+
+                if (prefix)
+                {
+                    return true;
+                }
+
+                while (p < pattern.size() && pattern[p] == '*')
+                {
+                    ++p;
+                }
+
+                return p == pattern.size();
+            }
+
+            // a pattern is a glob, unless it starts with `re:` - then the rest is an ECMAScript regular expression, searched for in the path
+            class _test_pattern
+            {
+            public:
+                _test_pattern(std::string pattern) : _pattern{ std::move(pattern) }
+                {
+                    if (_pattern.compare(0, 3, "re:") == 0)
+                    {
+                        try
+                        {
+                            _regex = std::regex{ _pattern.substr(3) };
+                        }
+
+                        catch (std::regex_error &)
+                        {
+                            throw invalid_test_pattern{ _pattern };
+                        }
+
+                        _is_regex = true;
+                    }
+                }
+
+                bool matches(const std::string & path) const
+                {
+                    return _is_regex ? std::regex_search(path, _regex) : _glob_match(_pattern, path);
+                }
+
+                // nothing can be said about regular expressions up front
+                bool may_match_below(const std::string & suite_path) const
+                {
+                    return _is_regex || _glob_match(_pattern, suite_path + "/", true);
+                }
+
+                // a glob ending in `*` that already matches the suite's path matches everything below it as well
+                bool matches_all_below(const std::string & suite_path) const
+                {
+                    return !_is_regex && !_pattern.empty() && _pattern.back() == '*' && _glob_match(_pattern, suite_path + "/");
+                }
+
+            private:
+                std::string _pattern;
+                bool _is_regex = false;
+                std::regex _regex;
+            };
+
+            // a testcase is selected if it matches any of the included patterns (or there are none) and none of the excluded ones
+            class _test_filter
+            {
+            public:
+                void include(std::string pattern)
+                {
+                    _included.emplace_back(std::move(pattern));
+                }
+
+                void exclude(std::string pattern)
+                {
+                    _excluded.emplace_back(std::move(pattern));
+                }
+
+                bool empty() const
+                {
+                    return _included.empty() && _excluded.empty();
+                }
+
+                bool matches(const std::string & path) const
+                {
+                    for (auto && pattern : _excluded)
+                    {
+                        if (pattern.matches(path))
+                        {
+                            return false;
+                        }
+                    }
+
+                    if (_included.empty())
+                    {
+                        return true;
+                    }
+
+                    for (auto && pattern : _included)
+                    {
+                        if (pattern.matches(path))
+                        {
+                            return true;
+                        }
+                    }
+
+                    return false;
+                }
+
+                // false when no testcase in the suite (or any of its sub-suites) can be selected; the whole subtree is skipped then
+                bool may_contain(const std::string & suite_path) const
+                {
+                    for (auto && pattern : _excluded)
+                    {
+                        if (pattern.matches_all_below(suite_path))
+                        {
+                            return false;
+                        }
+                    }
+
+                    if (_included.empty())
+                    {
+                        return true;
+                    }
+
+                    for (auto && pattern : _included)
+                    {
+                        if (pattern.may_match_below(suite_path))
+                        {
+                            return true;
+                        }
+                    }
+
+                    return false;
+                }
+
+            private:
+                std::vector<_test_pattern> _included;
+                std::vector<_test_pattern> _excluded;
+            };
+        }
+    }}
+}
@@ -0,0 +1,423 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <string>
+#include <mutex>
+#include <functional>
+#include <iostream>
+
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <reaver/exception.h>
+
+#include "protocol.h"
+#include "pidfd.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        class fork_server_error : public exception
+        {
+        public:
+            fork_server_error(const std::string & operation, int error) : exception{ logger::crash }
+            {
+                *this << "fork server failed to " << operation << ": " << std::strerror(error) << ".";
+            }
+        };
+
+        namespace _detail
+        {
+            // the zygote is forked off before any worker threads are started, so it holds a fully built registry; every request
+            // makes it fork a child with stdout and stderr bound to fresh pipes (and, with the binary protocol, a third one for the results),
+            // whose read ends are passed back over the socket, followed by a pidfd of the child where the kernel has them; `prepare` is
+            // called in the zygote itself before that, for whatever state the testcase's children should share with it
+            class _fork_server
+            {
+            public:
+                struct process
+                {
+                    pid_t pid;
+                    int output;
+                    int errors;
+                    int results;
+                    // -1 without pidfd support; the zygote reaps the child, so its pid alone may already name another process
+                    int pidfd;
+                };
+
+                _fork_server(std::function<void (const std::string &)> run_test, bool binary = false, std::function<void (const std::string &)> prepare = {})
+                    : _run_test{ std::move(run_test) }, _prepare{ std::move(prepare) }, _binary{ binary }, _owner{ ::getpid() }
+                {
+                    int fds[2];
+                    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+                    {
+                        throw fork_server_error{ "create a socket", errno };
+                    }
+
+                    std::cout << std::flush;
+
+                    _pid = ::fork();
+                    if (_pid == -1)
+                    {
+                        auto error = errno;
+                        ::close(fds[0]);
+                        ::close(fds[1]);
+                        throw fork_server_error{ "start the zygote", error };
+                    }
+
+                    if (_pid == 0)
+                    {
+                        ::close(fds[0]);
+                        _serve(fds[1]);
+                    }
+
+                    ::close(fds[1]);
+                    _socket = fds[0];
+                }
+
+                _fork_server(const _fork_server &) = delete;
+                _fork_server & operator=(const _fork_server &) = delete;
+
+                ~_fork_server()
+                {
+                    // children of the zygote also carry a copy of this object; only the process that started it may tear it down
+                    if (::getpid() != _owner)
+                    {
+                        return;
+                    }
+
+                    ::close(_socket);
+                    ::waitpid(_pid, nullptr, 0);
+                }
+
+                process spawn(const std::string & test_name)
+                {
+                    std::lock_guard<std::mutex> lock{ _mutex };
+
+                    std::uint32_t length = test_name.size();
+                    if (!_write(_socket, &length, sizeof(length)) || !_write(_socket, test_name.data(), length))
+                    {
+                        throw fork_server_error{ "send a request", errno };
+                    }
+
+                    process spawned{ -1, -1, -1, -1, -1 };
+                    int fds[4] = { -1, -1, -1, -1 };
+                    auto count = _receive_fds(_socket, spawned.pid, fds);
+                    std::size_t pipes = _binary ? 3 : 2;
+
+                    if (spawned.pid == -1 || (count != pipes && count != pipes + 1))
+                    {
+                        auto error = spawned.pid == -1 ? EAGAIN : errno;
+                        for (auto fd : fds)
+                        {
+                            if (fd != -1)
+                            {
+                                ::close(fd);
+                            }
+                        }
+
+                        throw fork_server_error{ "fork a testcase process", error };
+                    }
+
+                    spawned.output = fds[0];
+                    spawned.errors = fds[1];
+                    spawned.results = _binary ? fds[2] : -1;
+                    spawned.pidfd = count > pipes ? fds[pipes] : -1;
+                    return spawned;
+                }
+
+            private:
+                // the testcase processes are reaped as soon as they exit; the parent detects their end through the protocol on the pipe
+                static void _reap(int)
+                {
+                    auto saved = errno;
+                    while (::waitpid(-1, nullptr, WNOHANG) > 0)
+                    {
+                    }
+                    errno = saved;
+                }
+
+                [[noreturn]]
+                void _serve(int socket)
+                {
+                    struct ::sigaction reaper{};
+                    reaper.sa_handler = &_reap;
+                    reaper.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+                    ::sigemptyset(&reaper.sa_mask);
+                    ::sigaction(SIGCHLD, &reaper, nullptr);
+
+                    // a child that exits is only reaped once its pidfd is open, so that the pidfd can't end up naming another process
+                    ::sigset_t children, unblocked;
+                    ::sigemptyset(&children);
+                    ::sigaddset(&children, SIGCHLD);
+
+                    std::string test_name;
+                    std::uint32_t length = 0;
+
+                    while (_read(socket, &length, sizeof(length)))
+                    {
+                        test_name.resize(length);
+                        if (!_read(socket, &test_name[0], length))
+                        {
+                            break;
+                        }
+
+                        if (_prepare)
+                        {
+                            _prepare(test_name);
+                        }
+
+                        int pipe[2];
+                        int errors[2];
+                        int results[2] = { -1, -1 };
+                        pid_t pid = -1;
+
+                        if (::pipe(pipe) == -1)
+                        {
+                            _send_fds(socket, pid, nullptr, 0);
+                            continue;
+                        }
+
+                        if (::pipe(errors) == -1)
+                        {
+                            ::close(pipe[0]);
+                            ::close(pipe[1]);
+                            _send_fds(socket, pid, nullptr, 0);
+                            continue;
+                        }
+
+                        if (_binary && ::pipe(results) == -1)
+                        {
+                            for (auto fd : { pipe[0], pipe[1], errors[0], errors[1] })
+                            {
+                                ::close(fd);
+                            }
+                            _send_fds(socket, pid, nullptr, 0);
+                            continue;
+                        }
+
+                        ::sigprocmask(SIG_BLOCK, &children, &unblocked);
+                        pid = ::fork();
+
+                        if (pid == 0)
+                        {
+                            ::close(socket);
+                            ::signal(SIGCHLD, SIG_DFL);
+                            ::sigprocmask(SIG_SETMASK, &unblocked, nullptr);
+                            ::dup2(pipe[1], STDOUT_FILENO);
+                            ::close(pipe[0]);
+                            ::close(pipe[1]);
+                            ::dup2(errors[1], STDERR_FILENO);
+                            ::close(errors[0]);
+                            ::close(errors[1]);
+                            ::close(STDIN_FILENO);
+
+                            if (_binary)
+                            {
+                                ::close(results[0]);
+                                _bind_result_fd(results[1]);
+                                if (results[1] != _result_fd_number)
+                                {
+                                    ::close(results[1]);
+                                }
+                                _result_fd() = _result_fd_number;
+                            }
+
+                            try
+                            {
+                                _run_test(test_name);
+                            }
+
+                            catch (...)
+                            {
+                                std::exit(2);
+                            }
+
+                            std::exit(0);
+                        }
+
+                        auto pidfd = pid != -1 ? _pidfd_open(pid) : -1;
+                        ::sigprocmask(SIG_SETMASK, &unblocked, nullptr);
+
+                        ::close(pipe[1]);
+                        ::close(errors[1]);
+
+                        int fds[4] = { pipe[0], errors[0], results[0], -1 };
+                        std::size_t count = _binary ? 3 : 2;
+                        if (_binary)
+                        {
+                            ::close(results[1]);
+                        }
+
+                        if (pidfd != -1)
+                        {
+                            fds[count++] = pidfd;
+                        }
+
+                        _send_fds(socket, pid, fds, count);
+
+                        if (pidfd != -1)
+                        {
+                            ::close(pidfd);
+                        }
+
+                        ::close(pipe[0]);
+                        ::close(errors[0]);
+                        if (_binary)
+                        {
+                            ::close(results[0]);
+                        }
+                    }
+
+                    ::_exit(0);
+                }
+
+                static bool _write(int fd, const void * buffer, std::size_t size)
+                {
+                    auto ptr = static_cast<const char *>(buffer);
+
+                    while (size)
+                    {
+                        auto written = ::write(fd, ptr, size);
+                        if (written == -1 && errno == EINTR)
+                        {
+                            continue;
+                        }
+
+                        if (written <= 0)
+                        {
+                            return false;
+                        }
+
+                        ptr += written;
+                        size -= written;
+                    }
+
+                    return true;
+                }
+
+                static bool _read(int fd, void * buffer, std::size_t size)
+                {
+                    auto ptr = static_cast<char *>(buffer);
+
+                    while (size)
+                    {
+                        auto read = ::read(fd, ptr, size);
+                        if (read == -1 && errno == EINTR)
+                        {
+                            continue;
+                        }
+
+                        if (read <= 0)
+                        {
+                            return false;
+                        }
+
+                        ptr += read;
+                        size -= read;
+                    }
+
+                    return true;
+                }
+
+                static void _send_fds(int socket, pid_t pid, const int * fds, std::size_t count)
+                {
+                    ::iovec iov{ &pid, sizeof(pid) };
+                    char control[CMSG_SPACE(4 * sizeof(int))] = {};
+
+                    ::msghdr message{};
+                    message.msg_iov = &iov;
+                    message.msg_iovlen = 1;
+
+                    if (count)
+                    {
+                        message.msg_control = control;
+                        message.msg_controllen = CMSG_SPACE(count * sizeof(int));
+
+                        auto cmsg = CMSG_FIRSTHDR(&message);
+                        cmsg->cmsg_level = SOL_SOCKET;
+                        cmsg->cmsg_type = SCM_RIGHTS;
+                        cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+                        std::memcpy(CMSG_DATA(cmsg), fds, count * sizeof(int));
+                    }
+
+                    while (::sendmsg(socket, &message, 0) == -1 && errno == EINTR)
+                    {
+                    }
+                }
+
+                // returns the number of descriptors received, at most four
+                static std::size_t _receive_fds(int socket, pid_t & pid, int (& fds)[4])
+                {
+                    ::iovec iov{ &pid, sizeof(pid) };
+                    char control[CMSG_SPACE(4 * sizeof(int))] = {};
+
+                    ::msghdr message{};
+                    message.msg_iov = &iov;
+                    message.msg_iovlen = 1;
+                    message.msg_control = control;
+                    message.msg_controllen = sizeof(control);
+
+                    ssize_t received;
+                    while ((received = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR)
+                    {
+                    }
+
+                    if (received != sizeof(pid))
+                    {
+                        pid = -1;
+                        return 0;
+                    }
+
+                    auto cmsg = CMSG_FIRSTHDR(&message);
+                    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS)
+                    {
+                        return 0;
+                    }
+
+                    auto count = std::min<std::size_t>((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int), 4);
+                    std::memcpy(fds, CMSG_DATA(cmsg), count * sizeof(int));
+                    return count;
+                }
+
+                std::function<void (const std::string &)> _run_test;
+                std::function<void (const std::string &)> _prepare;
+                bool _binary;
+                pid_t _owner;
+                pid_t _pid = -1;
+                int _socket = -1;
+                std::mutex _mutex;
+            };
+        }
+    }}
+}
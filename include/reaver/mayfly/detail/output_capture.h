@@ -0,0 +1,308 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <utility>
+#include <algorithm>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        namespace _detail
+        {
+            // the output of a single testcase, kept as '\n'-terminated lines in one buffer instead of a string per line; with a limit, only
+            // its first and last `limit / 2` bytes are retained, and the lines in between are only counted; whatever is retained past
+            // `spill` bytes is moved to an unlinked temporary file, so a chatty test costs disk space instead of memory
+            class _output_capture
+            {
+            public:
+                _output_capture(std::size_t limit = 0, std::size_t spill = std::size_t{ 1 } << 20) : _limit{ limit }, _spill{ spill }
+                {
+                }
+
+                _output_capture(const _output_capture &) = delete;
+                _output_capture & operator=(const _output_capture &) = delete;
+
+                _output_capture(_output_capture && other) noexcept
+                {
+                    _steal(other);
+                }
+
+                _output_capture & operator=(_output_capture && other) noexcept
+                {
+                    if (this != &other)
+                    {
+                        _close();
+                        _steal(other);
+                    }
+
+                    return *this;
+                }
+
+                ~_output_capture()
+                {
+                    _close();
+                }
+
+                // a single line, without its terminator
+                void append(const char * line, std::size_t length)
+                {
+                    if (!_limit || (!_tail_started && _retained_head + length + 1 <= _limit / 2))
+                    {
+                        _head.append(line, length);
+                        _head.push_back('\n');
+                        _retained_head += length + 1;
+
+                        if (_spill != _no_spill && _head.size() >= (_file == -1 ? _spill : _write_buffer_size))
+                        {
+                            _flush();
+                        }
+
+                        return;
+                    }
+
+                    _tail_started = true;
+
+                    _tail.append(line, length);
+                    _tail.push_back('\n');
+
+                    // drop whole lines from the front until the tail fits again; compact only once in a while, like the protocol parser
+                    while (_tail.size() - _tail_begin > _limit / 2)
+                    {
+                        auto end = static_cast<const char *>(std::memchr(_tail.data() + _tail_begin, '\n', _tail.size() - _tail_begin));
+                        _tail_begin = end - _tail.data() + 1;
+                        ++_omitted;
+                    }
+
+                    if (_tail_begin > _tail.size() / 2)
+                    {
+                        _tail.erase(0, _tail_begin);
+                        _tail_begin = 0;
+                    }
+                }
+
+                bool empty() const
+                {
+                    return !_retained_head && _tail.size() == _tail_begin && !_omitted;
+                }
+
+                std::size_t omitted() const
+                {
+                    return _omitted;
+                }
+
+                // calls `f(data, length)` for every retained line, in order, with a marker line in place of the omitted ones;
+                // a spilled part is mapped back from its file rather than read into memory
+                template<typename F>
+                void for_each_line(F && f)
+                {
+                    // a write to the file can stop in the middle of a line (on a full disk); the rest of that line starts the part kept
+                    // in memory, and the two are joined back together here
+                    std::string cut;
+                    const char * head = _head.data();
+                    std::size_t head_size = _head.size();
+
+                    if (_file != -1)
+                    {
+                        _flush();
+                        head = _head.data();
+                        head_size = _head.size();
+
+                        if (_file_size)
+                        {
+                            auto mapped = ::mmap(nullptr, _file_size, PROT_READ, MAP_PRIVATE, _file, 0);
+                            if (mapped != MAP_FAILED)
+                            {
+                                auto data = static_cast<const char *>(mapped);
+                                auto whole = _file_size;
+                                while (whole && data[whole - 1] != '\n')
+                                {
+                                    --whole;
+                                }
+
+                                _lines(data, whole, f);
+                                cut.assign(data + whole, _file_size - whole);
+                                ::munmap(mapped, _file_size);
+                            }
+                        }
+                    }
+
+                    if (!cut.empty())
+                    {
+                        auto line_end = static_cast<const char *>(std::memchr(head, '\n', head_size));
+                        auto length = line_end ? line_end - head : head_size;
+                        cut.append(head, length);
+                        f(cut.data(), cut.size());
+
+                        head += std::min(length + 1, head_size);
+                        head_size = _head.data() + _head.size() - head;
+                    }
+
+                    _lines(head, head_size, f);
+
+                    if (_omitted)
+                    {
+                        auto marker = "[... " + std::to_string(_omitted) + " lines of output omitted ...]";
+                        f(marker.data(), marker.size());
+                    }
+
+                    _lines(_tail.data() + _tail_begin, _tail.size() - _tail_begin, f);
+                }
+
+                void clear()
+                {
+                    _close();
+
+                    _head.clear();
+                    _tail.clear();
+                    _tail_begin = 0;
+                    _retained_head = 0;
+                    _tail_started = false;
+                    _omitted = 0;
+                }
+
+            private:
+                static constexpr std::size_t _write_buffer_size = 64 * 1024;
+                // once creating the file or writing to it failed, whatever comes next stays in memory
+                static constexpr std::size_t _no_spill = static_cast<std::size_t>(-1);
+
+                template<typename F>
+                static void _lines(const char * data, std::size_t size, F & f)
+                {
+                    auto end = data + size;
+                    while (data != end)
+                    {
+                        auto line_end = static_cast<const char *>(std::memchr(data, '\n', end - data));
+                        if (!line_end)
+                        {
+                            f(data, end - data);
+                            return;
+                        }
+
+                        f(data, line_end - data);
+                        data = line_end + 1;
+                    }
+                }
+
+                // the first flush creates the file; if that isn't possible, the output just stays in memory
+                void _flush()
+                {
+                    if (_spill == _no_spill)
+                    {
+                        return;
+                    }
+
+                    if (_file == -1)
+                    {
+                        auto directory = std::getenv("TMPDIR");
+                        std::string path = std::string{ directory && *directory ? directory : "/tmp" } + "/mayfly-output-XXXXXX";
+
+                        _file = ::mkostemp(&path[0], O_CLOEXEC);
+                        if (_file == -1)
+                        {
+                            _spill = _no_spill;
+                            return;
+                        }
+
+                        ::unlink(path.c_str());
+                    }
+
+                    auto ptr = _head.data();
+                    auto left = _head.size();
+
+                    while (left)
+                    {
+                        auto written = ::write(_file, ptr, left);
+                        if (written == -1 && errno == EINTR)
+                        {
+                            continue;
+                        }
+
+                        // a full disk; whatever didn't fit stays in memory, and so does everything after it
+                        if (written <= 0)
+                        {
+                            _spill = _no_spill;
+                            break;
+                        }
+
+                        ptr += written;
+                        left -= written;
+                        _file_size += written;
+                    }
+
+                    _head.erase(0, _head.size() - left);
+                }
+
+                void _close()
+                {
+                    if (_file != -1)
+                    {
+                        ::close(_file);
+                        _file = -1;
+                        _file_size = 0;
+                    }
+                }
+
+                void _steal(_output_capture & other)
+                {
+                    _limit = other._limit;
+                    _spill = other._spill;
+                    _head = std::move(other._head);
+                    _tail = std::move(other._tail);
+                    _tail_begin = std::exchange(other._tail_begin, 0);
+                    _retained_head = std::exchange(other._retained_head, 0);
+                    _tail_started = std::exchange(other._tail_started, false);
+                    _omitted = std::exchange(other._omitted, 0);
+                    _file = std::exchange(other._file, -1);
+                    _file_size = std::exchange(other._file_size, 0);
+
+                    other._head.clear();
+                    other._tail.clear();
+                }
+
+                std::size_t _limit = 0;
+                std::size_t _spill = 0;
+
+                std::string _head;
+                std::size_t _retained_head = 0;
+                bool _tail_started = false;
+
+                std::string _tail;
+                std::size_t _tail_begin = 0;
+                std::size_t _omitted = 0;
+
+                int _file = -1;
+                std::size_t _file_size = 0;
+            };
+        }
+    }}
+}
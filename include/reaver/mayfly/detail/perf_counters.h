@@ -0,0 +1,179 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include <reaver/exception.h>
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        class invalid_perf_counter : public exception
+        {
+        public:
+            invalid_perf_counter(const std::string & name) : exception{ logger::error }
+            {
+                *this << "invalid performance counter `" << name << "` - available counters are `cycles`, `instructions`, `cache-references`, `cache-misses`, "
+                    "`branches`, `branch-misses`, `task-clock`, `context-switches` and `cpu-migrations`.";
+            }
+        };
+
+        namespace _detail
+        {
+            // the software events are counted by the kernel itself, so they're available even where there's no PMU (most VMs)
+            struct _perf_counter_kind
+            {
+                const char * name;
+                std::uint32_t type;
+                std::uint64_t config;
+            };
+
+            constexpr _perf_counter_kind _perf_counter_kinds[] = {
+                { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+                { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+                { "cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+                { "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+                { "branches", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+                { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+                { "task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+                { "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+                { "cpu-migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS }
+            };
+
+            inline const _perf_counter_kind & _perf_counter(const std::string & name)
+            {
+                for (auto && kind : _perf_counter_kinds)
+                {
+                    if (name == kind.name)
+                    {
+                        return kind;
+                    }
+                }
+
+                throw invalid_perf_counter{ name };
+            }
+
+            // the counters every testcase is measured with; set once, before any testcase runs, and passed on to the children
+            inline std::vector<std::string> & _perf_counter_selection()
+            {
+                static std::vector<std::string> selection;
+                return selection;
+            }
+
+            // counts the selected hardware events of the calling thread (and of the threads it starts) while it exists; counters the
+            // kernel refuses to open (no PMU in a VM, a restrictive perf_event_paranoid) are silently left out of the readings
+            class _perf_meter
+            {
+            public:
+                _perf_meter(const std::vector<std::string> & names)
+                {
+                    // nothing that can throw is left once the first counter is open; the destructor of a half-built meter wouldn't run
+                    // to close it
+                    std::vector<const _perf_counter_kind *> kinds;
+                    for (auto && name : names)
+                    {
+                        kinds.push_back(&_perf_counter(name));
+                    }
+                    _counters.reserve(names.size());
+
+                    for (std::size_t i = 0; i < names.size(); ++i)
+                    {
+                        ::perf_event_attr attr;
+                        std::memset(&attr, 0, sizeof(attr));
+                        attr.size = sizeof(attr);
+                        attr.type = kinds[i]->type;
+                        attr.config = kinds[i]->config;
+                        attr.disabled = 1;
+                        attr.inherit = 1;
+                        attr.exclude_kernel = 1;
+                        attr.exclude_hv = 1;
+                        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+                        auto fd = static_cast<int>(::syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+                        if (fd != -1)
+                        {
+                            _counters.emplace_back(names[i], fd);
+                        }
+                    }
+
+                    for (auto && counter : _counters)
+                    {
+                        ::ioctl(counter.second, PERF_EVENT_IOC_ENABLE, 0);
+                    }
+                }
+
+                _perf_meter(const _perf_meter &) = delete;
+                _perf_meter & operator=(const _perf_meter &) = delete;
+
+                ~_perf_meter()
+                {
+                    for (auto && counter : _counters)
+                    {
+                        ::close(counter.second);
+                    }
+                }
+
+                // when there are more counters than the PMU has slots, the kernel multiplexes them; the readings are scaled to the
+                // whole measured time
+                std::vector<std::pair<std::string, std::uint64_t>> operator()() const
+                {
+                    for (auto && counter : _counters)
+                    {
+                        ::ioctl(counter.second, PERF_EVENT_IOC_DISABLE, 0);
+                    }
+
+                    std::vector<std::pair<std::string, std::uint64_t>> readings;
+                    readings.reserve(_counters.size());
+
+                    for (auto && counter : _counters)
+                    {
+                        std::uint64_t values[3];
+                        if (::read(counter.second, values, sizeof(values)) != sizeof(values) || !values[2])
+                        {
+                            continue;
+                        }
+
+                        auto value = values[2] == values[1] ? values[0] : static_cast<std::uint64_t>(static_cast<double>(values[0]) * values[1] / values[2]);
+                        readings.emplace_back(counter.first, value);
+                    }
+
+                    return readings;
+                }
+
+            private:
+                std::vector<std::pair<std::string, int>> _counters;
+            };
+        }
+    }}
+}
@@ -0,0 +1,60 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cerrno>
+
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        namespace _detail
+        {
+            // both fail with ENOSYS where the kernel (or the headers the tests were built with) has no pidfds
+            inline int _pidfd_open(pid_t pid)
+            {
+#ifdef SYS_pidfd_open
+                return ::syscall(SYS_pidfd_open, pid, 0);
+#else
+                errno = ENOSYS;
+                return -1;
+#endif
+            }
+
+            inline int _pidfd_kill(int pidfd)
+            {
+#ifdef SYS_pidfd_send_signal
+                return ::syscall(SYS_pidfd_send_signal, pidfd, SIGKILL, nullptr, 0);
+#else
+                errno = ENOSYS;
+                return -1;
+#endif
+            }
+        }
+    }}
+}
@@ -0,0 +1,464 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <chrono>
+
+#include "../testcase.h"
+#include "output_capture.h"
+#include "sanitizers.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        namespace _detail
+        {
+            // the binary protocol: every frame is a native-endian uint32 length of the payload, a type byte and the payload itself;
+            // `finished` carries a status byte, the duration in nanoseconds, the assertion count, the resource usage (all uint64) and the description;
+            // `counters` precedes it when performance counters are read, with a uint64 value, a length byte and a name for every one of them
+            enum class _frame_type : std::uint8_t
+            {
+                started = 1,
+                finished = 2,
+                exit = 3,
+                done = 4,
+                not_found = 5,
+                counters = 6
+            };
+
+            struct _finished_frame
+            {
+                std::uint8_t status;
+                std::uint64_t duration;
+                std::uint64_t assertions;
+                std::uint64_t user_time;
+                std::uint64_t system_time;
+                std::uint64_t peak_rss;
+                std::uint64_t minor_faults;
+                std::uint64_t major_faults;
+            } __attribute__((packed));
+
+            // the descriptor the binary protocol is written to in a child; -1 means the text protocol on stdout is used
+            inline int & _result_fd()
+            {
+                static int fd = -1;
+                return fd;
+            }
+
+            // children are always handed the result pipe on this descriptor, and told so with `--result-fd`
+            constexpr int _result_fd_number = 3;
+
+            // to be called in a freshly forked child; dup2 clears close-on-exec on the new descriptor, unless it is a no-op
+            inline void _bind_result_fd(int fd)
+            {
+                if (fd == _result_fd_number)
+                {
+                    ::fcntl(fd, F_SETFD, 0);
+                }
+
+                else
+                {
+                    ::dup2(fd, _result_fd_number);
+                }
+            }
+
+            inline void _write_frame(_frame_type type, const void * payload = nullptr, std::size_t size = 0, const std::string & tail = {})
+            {
+                std::uint32_t length = size + tail.size();
+
+                std::string frame;
+                frame.reserve(sizeof(length) + 1 + length);
+                frame.append(reinterpret_cast<const char *>(&length), sizeof(length));
+                frame.push_back(static_cast<char>(type));
+                frame.append(static_cast<const char *>(payload), size);
+                frame.append(tail);
+
+                auto ptr = frame.data();
+                auto left = frame.size();
+
+                while (left)
+                {
+                    auto written = ::write(_result_fd(), ptr, left);
+                    if (written == -1 && errno == EINTR)
+                    {
+                        continue;
+                    }
+
+                    if (written <= 0)
+                    {
+                        return;
+                    }
+
+                    ptr += written;
+                    left -= written;
+                }
+            }
+
+            // incremental parser of both protocols spoken by subprocess_reporter; the data is scanned in place, in buffers that are kept
+            // (with their capacity) for the whole life of the parser, so a persistent worker only ever grows a single pair of them;
+            // with the binary protocol the stdout of the child is only split into lines, never looked into
+            class _protocol_parser
+            {
+            public:
+                enum states { not_started, started, finished, exited };
+
+                void reset()
+                {
+                    state = not_started;
+                    status = testcase_status::passed;
+                    description.clear();
+                    output.clear();
+                    unexpected_status = false;
+                    duration = std::chrono::nanoseconds{};
+                    assertions = 0;
+                    usage = {};
+                    counters.clear();
+                    sanitizer = {};
+                }
+
+                // feeds the stdout of the child; with the text protocol, returns true once the end of a testcase has been seen
+                // and anything after that stays buffered for the next one
+                bool feed(const char * data, std::size_t size)
+                {
+                    _buffer.append(data, size);
+                    return _scan();
+                }
+
+                // feeds the result descriptor of the binary protocol; returns true on the end of a testcase, like feed()
+                bool feed_frames(const char * data, std::size_t size)
+                {
+                    _frames.append(data, size);
+
+                    bool done = false;
+
+                    while (!done && _frames.size() - _frames_position >= sizeof(std::uint32_t) + 1)
+                    {
+                        std::uint32_t length;
+                        std::memcpy(&length, _frames.data() + _frames_position, sizeof(length));
+
+                        if (_frames.size() - _frames_position < sizeof(length) + 1 + length)
+                        {
+                            break;
+                        }
+
+                        auto type = static_cast<_frame_type>(_frames[_frames_position + sizeof(length)]);
+                        done = _frame(type, _frames.data() + _frames_position + sizeof(length) + 1, length);
+                        _frames_position += sizeof(length) + 1 + length;
+                    }
+
+                    if (_frames_position == _frames.size())
+                    {
+                        _frames.clear();
+                        _frames_position = 0;
+                    }
+
+                    return done;
+                }
+
+                // feeds the stderr of the child; it goes to the output line by line, as it arrives, and is looked into for sanitizer reports
+                void feed_errors(const char * data, std::size_t size)
+                {
+                    _errors.append(data, size);
+
+                    std::size_t position = 0;
+                    while (auto end = static_cast<const char *>(std::memchr(_errors.data() + position, '\n', _errors.size() - position)))
+                    {
+                        _error_line(_errors.data() + position, end - _errors.data() - position);
+                        position = end - _errors.data() + 1;
+                    }
+
+                    _errors.erase(0, position);
+                }
+
+                void finish_errors()
+                {
+                    if (!_errors.empty())
+                    {
+                        _error_line(_errors.data(), _errors.size());
+                        _errors.clear();
+                    }
+                }
+
+                void finish()
+                {
+                    _scan();
+
+                    if (_position < _buffer.size())
+                    {
+                        output.append(_buffer.data() + _position, _buffer.size() - _position);
+                    }
+
+                    _buffer.clear();
+                    _position = 0;
+                }
+
+                bool binary = false;
+
+                states state = not_started;
+                testcase_status status = testcase_status::passed;
+                std::string description;
+                _output_capture output;
+                bool unexpected_status = false;
+                std::chrono::nanoseconds duration{};
+                std::size_t assertions = 0;
+                resource_usage usage;
+                std::vector<std::pair<std::string, std::uint64_t>> counters;
+                _sanitizer_report sanitizer;
+
+            private:
+                void _error_line(const char * line, std::size_t length)
+                {
+                    output.append(line, length);
+                    sanitizer.scan(line, length);
+                }
+
+                template<std::size_t N>
+                static bool _is(const char * line, std::size_t length, const char (& marker)[N])
+                {
+                    return length == N - 1 && !std::memcmp(line, marker, N - 1);
+                }
+
+                template<std::size_t N>
+                static bool _starts_with(const char * line, std::size_t length, const char (& marker)[N])
+                {
+                    return length >= N - 1 && !std::memcmp(line, marker, N - 1);
+                }
+
+                bool _scan()
+                {
+                    bool done = false;
+
+                    while (!done && _position < _buffer.size())
+                    {
+                        auto begin = _buffer.data() + _position;
+                        auto end = static_cast<const char *>(std::memchr(begin, '\n', _buffer.size() - _position));
+
+                        if (!end)
+                        {
+                            break;
+                        }
+
+                        _position += end - begin + 1;
+
+                        if (!binary)
+                        {
+                            done = _line(begin, end - begin);
+                        }
+
+                        else
+                        {
+                            output.append(begin, end - begin);
+                        }
+                    }
+
+                    // compact only once in a while, so that a chatty test doesn't pay for a memmove on every read
+                    if (_position == _buffer.size())
+                    {
+                        _buffer.clear();
+                        _position = 0;
+                    }
+
+                    else if (_position > _buffer.size() / 2)
+                    {
+                        _buffer.erase(0, _position);
+                        _position = 0;
+                    }
+
+                    return done;
+                }
+
+                bool _line(const char * line, std::size_t length)
+                {
+                    if (!_starts_with(line, length, "{{"))
+                    {
+                        output.append(line, length);
+                        return false;
+                    }
+
+                    if (_is(line, length, "{{started}}"))
+                    {
+                        state = started;
+                    }
+
+                    else if (_is(line, length, "{{finished}}"))
+                    {
+                        state = finished;
+                    }
+
+                    else if (_is(line, length, "{{exit}}"))
+                    {
+                        state = exited;
+                    }
+
+                    else if (_is(line, length, "{{done}}"))
+                    {
+                        state = exited;
+                        return true;
+                    }
+
+                    else if (_starts_with(line, length, "{{failed ") && length >= 11)
+                    {
+                        status = testcase_status::failed;
+                        description.assign(line + 9, length - 11);
+                    }
+
+                    // {{usage <duration> <user time> <system time> <peak rss> <minor faults> <major faults>}}, times in nanoseconds
+                    else if (_starts_with(line, length, "{{usage ") && _is(line + length - 2, 2, "}}"))
+                    {
+                        std::string fields{ line + 8, length - 10 };
+                        auto ptr = fields.c_str();
+                        char * end;
+
+                        auto next = [&]
+                        {
+                            auto value = std::strtoull(ptr, &end, 10);
+                            ptr = end;
+                            return value;
+                        };
+
+                        duration = std::chrono::nanoseconds{ next() };
+                        usage.user_time = std::chrono::nanoseconds{ next() };
+                        usage.system_time = std::chrono::nanoseconds{ next() };
+                        usage.peak_rss = next();
+                        usage.minor_faults = next();
+                        usage.major_faults = next();
+                    }
+
+                    // {{counter <name> <value>}}
+                    else if (_starts_with(line, length, "{{counter ") && _is(line + length - 2, 2, "}}"))
+                    {
+                        auto name = line + 10;
+                        auto space = static_cast<const char *>(std::memchr(name, ' ', length - 12));
+                        if (space)
+                        {
+                            counters.emplace_back(std::string(name, space), std::strtoull(std::string(space + 1, line + length - 2).c_str(), nullptr, 10));
+                        }
+                    }
+
+                    else if (_is(line, length, "{{error unexpected test status}}"))
+                    {
+                        unexpected_status = true;
+                    }
+
+                    else if (_is(line, length, "{{error not found}}"))
+                    {
+                        status = testcase_status::not_found;
+                    }
+
+                    return false;
+                }
+
+                bool _frame(_frame_type type, const char * payload, std::size_t length)
+                {
+                    switch (type)
+                    {
+                        case _frame_type::started:
+                            state = started;
+                            break;
+
+                        case _frame_type::finished:
+                        {
+                            if (length < sizeof(_finished_frame))
+                            {
+                                unexpected_status = true;
+                                break;
+                            }
+
+                            _finished_frame frame;
+                            std::memcpy(&frame, payload, sizeof(frame));
+
+                            status = static_cast<testcase_status>(frame.status);
+                            if (status != testcase_status::passed && status != testcase_status::failed)
+                            {
+                                unexpected_status = true;
+                            }
+
+                            duration = std::chrono::nanoseconds{ frame.duration };
+                            assertions = frame.assertions;
+                            usage.user_time = std::chrono::nanoseconds{ frame.user_time };
+                            usage.system_time = std::chrono::nanoseconds{ frame.system_time };
+                            usage.peak_rss = frame.peak_rss;
+                            usage.minor_faults = frame.minor_faults;
+                            usage.major_faults = frame.major_faults;
+                            description.assign(payload + sizeof(frame), length - sizeof(frame));
+                            state = finished;
+                            break;
+                        }
+
+                        case _frame_type::exit:
+                            state = exited;
+                            break;
+
+                        case _frame_type::done:
+                            state = exited;
+                            return true;
+
+                        case _frame_type::not_found:
+                            status = testcase_status::not_found;
+                            break;
+
+                        case _frame_type::counters:
+                        {
+                            std::size_t position = 0;
+                            while (length - position >= sizeof(std::uint64_t) + 1)
+                            {
+                                std::uint64_t value;
+                                std::memcpy(&value, payload + position, sizeof(value));
+                                std::size_t name_length = static_cast<unsigned char>(payload[position + sizeof(value)]);
+                                position += sizeof(value) + 1;
+
+                                if (length - position < name_length)
+                                {
+                                    break;
+                                }
+
+                                counters.emplace_back(std::string(payload + position, name_length), value);
+                                position += name_length;
+                            }
+                            break;
+                        }
+                    }
+
+                    return false;
+                }
+
+                std::string _buffer;
+                std::size_t _position = 0;
+                std::string _frames;
+                std::size_t _frames_position = 0;
+                std::string _errors;
+            };
+        }
+    }}
+}
@@ -0,0 +1,61 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <fstream>
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        namespace _detail
+        {
+            // `writer(out)` writes the new contents aside, and they're renamed over the old file only once complete, so that an interrupted
+            // run never leaves a truncated file behind; throws `Error{ path }` if either step fails
+            template<typename Error, typename Writer>
+            void _replace_file(const std::string & path, Writer && writer)
+            {
+                auto temporary = path + ".tmp";
+
+                {
+                    std::ofstream out{ temporary, std::ios::trunc };
+                    writer(out);
+
+                    if (!out.flush())
+                    {
+                        std::remove(temporary.c_str());
+                        throw Error{ path };
+                    }
+                }
+
+                if (std::rename(temporary.c_str(), path.c_str()))
+                {
+                    std::remove(temporary.c_str());
+                    throw Error{ path };
+                }
+            }
+        }
+    }}
+}
@@ -0,0 +1,278 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <utility>
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        namespace _detail
+        {
+            // a bounded multi-producer queue (Vyukov's ring of sequenced cells); pushes and pops are a single CAS on the hot path
+            // and never take a lock; the capacity is rounded up to a power of two
+            template<typename T>
+            class _bounded_queue
+            {
+            public:
+                _bounded_queue(std::size_t capacity)
+                {
+                    std::size_t size = 2;
+                    while (size < capacity)
+                    {
+                        size *= 2;
+                    }
+
+                    _mask = size - 1;
+                    _cells = std::vector<_cell>(size);
+
+                    for (std::size_t i = 0; i < size; ++i)
+                    {
+                        _cells[i].sequence.store(i, std::memory_order_relaxed);
+                    }
+                }
+
+                _bounded_queue(const _bounded_queue &) = delete;
+                _bounded_queue & operator=(const _bounded_queue &) = delete;
+
+                bool try_push(T value)
+                {
+                    auto position = _tail.load(std::memory_order_relaxed);
+
+                    while (true)
+                    {
+                        auto & cell = _cells[position & _mask];
+                        auto sequence = cell.sequence.load(std::memory_order_acquire);
+                        auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+                        if (difference == 0)
+                        {
+                            if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                            {
+                                cell.value = std::move(value);
+                                cell.sequence.store(position + 1, std::memory_order_release);
+                                return true;
+                            }
+                        }
+
+                        else if (difference < 0)
+                        {
+                            return false;
+                        }
+
+                        else
+                        {
+                            position = _tail.load(std::memory_order_relaxed);
+                        }
+                    }
+                }
+
+                bool try_pop(T & value)
+                {
+                    auto position = _head.load(std::memory_order_relaxed);
+
+                    while (true)
+                    {
+                        auto & cell = _cells[position & _mask];
+                        auto sequence = cell.sequence.load(std::memory_order_acquire);
+                        auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+
+                        if (difference == 0)
+                        {
+                            if (_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                            {
+                                value = std::move(cell.value);
+                                cell.sequence.store(position + _mask + 1, std::memory_order_release);
+                                return true;
+                            }
+                        }
+
+                        else if (difference < 0)
+                        {
+                            return false;
+                        }
+
+                        else
+                        {
+                            position = _head.load(std::memory_order_relaxed);
+                        }
+                    }
+                }
+
+            private:
+                struct _cell
+                {
+                    std::atomic<std::size_t> sequence;
+                    T value;
+                };
+
+                std::vector<_cell> _cells;
+                std::size_t _mask;
+
+                // on separate cache lines, so that the producers don't keep invalidating the consumer's index
+                alignas(64) std::atomic<std::size_t> _head{ 0 };
+                alignas(64) std::atomic<std::size_t> _tail{ 0 };
+            };
+
+            // a single thread that handles the events pushed by any number of others, in the order they were pushed in; producers only
+            // wait when the queue is full, or briefly to wake the consumer up when it has gone to sleep on an empty queue
+            template<typename T>
+            class _reporting_thread
+            {
+            public:
+                _reporting_thread(std::function<void (T &)> handler, std::size_t capacity = 1024) : _handler{ std::move(handler) }, _queue{ capacity }
+                {
+                    _thread = std::thread{ [this]{ _loop(); } };
+                }
+
+                _reporting_thread(const _reporting_thread &) = delete;
+                _reporting_thread & operator=(const _reporting_thread &) = delete;
+
+                ~_reporting_thread()
+                {
+                    if (_thread.joinable())
+                    {
+                        _stop();
+                    }
+                }
+
+                void push(T event)
+                {
+                    while (!_queue.try_push(event))
+                    {
+                        std::this_thread::yield();
+                    }
+
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (_sleeping.load())
+                    {
+                        std::lock_guard<std::mutex> lock{ _mutex };
+                        _cv.notify_one();
+                    }
+                }
+
+                // handles everything pushed so far and stops the thread; rethrows the first exception that escaped the handler
+                void finish()
+                {
+                    _stop();
+
+                    if (_exception)
+                    {
+                        std::rethrow_exception(std::exchange(_exception, nullptr));
+                    }
+                }
+
+            private:
+                void _stop()
+                {
+                    _stopped.store(true);
+
+                    {
+                        std::lock_guard<std::mutex> lock{ _mutex };
+                        _cv.notify_one();
+                    }
+
+                    _thread.join();
+                }
+
+                void _loop()
+                {
+                    T event;
+
+                    while (true)
+                    {
+                        if (_queue.try_pop(event))
+                        {
+                            _handle(event);
+                            continue;
+                        }
+
+                        std::unique_lock<std::mutex> lock{ _mutex };
+
+                        // announce the sleep before looking at the queue for the last time; a push that lands after that look
+                        // is then guaranteed to see the flag and notify
+                        _sleeping.store(true);
+                        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                        if (!_queue.try_pop(event))
+                        {
+                            if (_stopped.load())
+                            {
+                                _sleeping.store(false);
+                                return;
+                            }
+
+                            _cv.wait(lock);
+                            _sleeping.store(false);
+                            continue;
+                        }
+
+                        _sleeping.store(false);
+                        lock.unlock();
+
+                        _handle(event);
+                    }
+                }
+
+                // after a failure, the rest of the events are only drained, so that no producer is left waiting on a full queue
+                void _handle(T & event)
+                {
+                    if (_exception)
+                    {
+                        return;
+                    }
+
+                    try
+                    {
+                        _handler(event);
+                    }
+
+                    catch (...)
+                    {
+                        _exception = std::current_exception();
+                    }
+                }
+
+                std::function<void (T &)> _handler;
+                _bounded_queue<T> _queue;
+
+                std::mutex _mutex;
+                std::condition_variable _cv;
+                std::atomic<bool> _sleeping{ false };
+                std::atomic<bool> _stopped{ false };
+                std::exception_ptr _exception;
+
+                std::thread _thread;
+            };
+        }
+    }}
+}
@@ -0,0 +1,261 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+
+#include <reaver/exception.h>
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        class invalid_resource_spec : public exception
+        {
+        public:
+            invalid_resource_spec(const std::string & spec) : exception{ logger::error }
+            {
+                *this << "invalid resource specification `" << spec << "`; expected `name`, `name:amount` or `exclusive`.";
+            }
+        };
+
+        class invalid_resource_capacity : public exception
+        {
+        public:
+            invalid_resource_capacity(const std::string & capacity) : exception{ logger::error }
+            {
+                *this << "invalid resource capacity `" << capacity << "`; expected `name=amount`, with an amount of at least 1.";
+            }
+        };
+
+        namespace _detail
+        {
+            // 1, 512, 4K, 16M, 4G, 2T; the suffixes are powers of 1024
+            inline bool _parse_amount(const std::string & text, std::uint64_t & amount)
+            {
+                if (text.empty() || !std::isdigit(static_cast<unsigned char>(text.front())))
+                {
+                    return false;
+                }
+
+                char * end;
+                errno = 0;
+                amount = std::strtoull(text.c_str(), &end, 10);
+                if (errno == ERANGE)
+                {
+                    return false;
+                }
+
+                static const std::string suffixes = "KMGT";
+                if (*end && !end[1])
+                {
+                    auto position = suffixes.find(std::toupper(static_cast<unsigned char>(*end)));
+                    if (position == std::string::npos)
+                    {
+                        return false;
+                    }
+
+                    // an amount that doesn't fit once scaled is an error, not whatever is left of it
+                    auto shift = 10 * (position + 1);
+                    if (amount > (UINT64_MAX >> shift))
+                    {
+                        return false;
+                    }
+
+                    amount <<= shift;
+                    ++end;
+                }
+
+                return !*end;
+            }
+
+            // what a testcase holds while it runs: an amount of every named resource, or the whole machine
+            struct _resource_demand
+            {
+                std::vector<std::pair<std::string, std::uint64_t>> amounts;
+                bool exclusive = false;
+
+                bool empty() const
+                {
+                    return amounts.empty() && !exclusive;
+                }
+
+                // the same resource demanded twice (by a suite and by its testcase) is demanded once, in the larger amount
+                void merge(const _resource_demand & other)
+                {
+                    exclusive = exclusive || other.exclusive;
+
+                    for (auto && elem : other.amounts)
+                    {
+                        auto it = std::find_if(amounts.begin(), amounts.end(), [&](auto && arg){ return arg.first == elem.first; });
+                        if (it == amounts.end())
+                        {
+                            amounts.push_back(elem);
+                        }
+
+                        else
+                        {
+                            it->second = std::max(it->second, elem.second);
+                        }
+                    }
+                }
+            };
+
+            // a list of `name[:amount]` tokens, separated by commas or spaces; `exclusive` runs the testcase alone
+            inline _resource_demand _parse_resources(const std::string & spec)
+            {
+                _resource_demand demand;
+
+                std::size_t position = 0;
+                while (position < spec.size())
+                {
+                    auto end = spec.find_first_of(", ", position);
+                    if (end == std::string::npos)
+                    {
+                        end = spec.size();
+                    }
+
+                    auto token = spec.substr(position, end - position);
+                    position = end + 1;
+
+                    if (token.empty())
+                    {
+                        continue;
+                    }
+
+                    if (token == "exclusive")
+                    {
+                        demand.exclusive = true;
+                        continue;
+                    }
+
+                    _resource_demand single;
+                    std::uint64_t amount = 1;
+
+                    auto colon = token.find(':');
+                    if (colon == 0 || (colon != std::string::npos && !_parse_amount(token.substr(colon + 1), amount)))
+                    {
+                        throw invalid_resource_spec{ spec };
+                    }
+
+                    single.amounts.emplace_back(token.substr(0, colon), amount);
+                    demand.merge(single);
+                }
+
+                return demand;
+            }
+
+            // the capacities given with --resource; a resource without one can only be held by a single testcase at a time, and a demand
+            // larger than the capacity is cut down to it, so that it still gets to run, alone
+            class _resource_pool
+            {
+            public:
+                _resource_pool(std::map<std::string, std::uint64_t> capacities = {}) : _capacities{ std::move(capacities) }
+                {
+                }
+
+                // both called with the scheduler's lock held
+                bool try_acquire(const _resource_demand & demand)
+                {
+                    if (demand.exclusive)
+                    {
+                        if (_running)
+                        {
+                            // later testcases aren't started in the meantime, or this one might never find the pool empty
+                            _exclusive_waiting = true;
+                            return false;
+                        }
+
+                        _exclusive_waiting = false;
+                        _exclusive_running = true;
+                        ++_running;
+                        return true;
+                    }
+
+                    if (_exclusive_running || _exclusive_waiting)
+                    {
+                        return false;
+                    }
+
+                    for (auto && elem : demand.amounts)
+                    {
+                        if (_used[elem.first] + _clamp(elem) > _capacity(elem.first))
+                        {
+                            return false;
+                        }
+                    }
+
+                    for (auto && elem : demand.amounts)
+                    {
+                        _used[elem.first] += _clamp(elem);
+                    }
+
+                    ++_running;
+                    return true;
+                }
+
+                void release(const _resource_demand & demand)
+                {
+                    --_running;
+
+                    if (demand.exclusive)
+                    {
+                        _exclusive_running = false;
+                        return;
+                    }
+
+                    for (auto && elem : demand.amounts)
+                    {
+                        _used[elem.first] -= _clamp(elem);
+                    }
+                }
+
+            private:
+                std::uint64_t _capacity(const std::string & name) const
+                {
+                    auto it = _capacities.find(name);
+                    return it == _capacities.end() ? 1 : it->second;
+                }
+
+                std::uint64_t _clamp(const std::pair<std::string, std::uint64_t> & demand) const
+                {
+                    return std::min(demand.second, _capacity(demand.first));
+                }
+
+                std::map<std::string, std::uint64_t> _capacities;
+                std::map<std::string, std::uint64_t> _used;
+                std::size_t _running = 0;
+                bool _exclusive_running = false;
+                bool _exclusive_waiting = false;
+            };
+        }
+    }}
+}
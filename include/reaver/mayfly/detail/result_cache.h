@@ -0,0 +1,128 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <climits>
+#include <string>
+#include <map>
+#include <utility>
+#include <fstream>
+
+#include <unistd.h>
+
+#include <reaver/exception.h>
+
+#include "../testcase.h"
+#include "replace_file.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        class result_cache_error : public exception
+        {
+        public:
+            result_cache_error(const std::string & path) : exception{ logger::error }
+            {
+                *this << "failed to write the result cache `" << path << "`.";
+            }
+        };
+
+        namespace _detail
+        {
+            struct _cached_result
+            {
+                testcase_status status;
+            };
+
+            // the last result of every testcase, by the executable it belongs to and its full path: every test executable started from
+            // the same directory shares the default cache file, and the same paths can come from different executables;
+            // the executable is kept by its path rather than by its build: a failure is there to be checked against the next build
+            // (the one with the fix), and a pass is trusted until the testcase is run again, whatever was rebuilt in between - telling
+            // builds apart would make every rebuild rerun everything, which is what these runs are meant to avoid
+            using _result_cache = std::map<std::pair<std::string, std::string>, _cached_result>;
+
+            // the absolute path of the running executable; the key of its own testcases
+            inline const std::string & _self_executable()
+            {
+                static const std::string path = []
+                {
+                    char buffer[PATH_MAX];
+                    auto length = ::readlink("/proc/self/exe", buffer, sizeof(buffer));
+                    return length > 0 ? std::string(buffer, length) : std::string{};
+                }();
+
+                return path;
+            }
+
+            // one testcase per line: the numeric status, the executable and the full path of the testcase, separated by tabs; lines
+            // without an executable (written before it was kept) are dropped
+            inline _result_cache _load_result_cache(const std::string & path)
+            {
+                _result_cache cache;
+
+                std::ifstream in{ path };
+                std::string line;
+
+                while (std::getline(in, line))
+                {
+                    auto first = line.find('\t');
+                    auto second = first == std::string::npos ? first : line.find('\t', first + 1);
+                    if (second == std::string::npos || first == 0)
+                    {
+                        continue;
+                    }
+
+                    try
+                    {
+                        cache[{ line.substr(first + 1, second - first - 1), line.substr(second + 1) }] = { static_cast<testcase_status>(std::stoi(line.substr(0, first))) };
+                    }
+
+                    catch (std::exception &)
+                    {
+                    }
+                }
+
+                return cache;
+            }
+
+            inline void _save_result_cache(const std::string & path, const _result_cache & cache)
+            {
+                _replace_file<result_cache_error>(path, [&](std::ostream & out)
+                {
+                    for (auto && elem : cache)
+                    {
+                        out << static_cast<int>(elem.second.status) << '\t' << elem.first.first << '\t' << elem.first.second << '\n';
+                    }
+                });
+            }
+
+            // testcases that are not in the cache yet have never been seen to pass, so they count as failed
+            inline bool _previously_failed(const _result_cache & cache, const std::string & executable, const std::string & path)
+            {
+                auto it = cache.find({ executable, path });
+                return it == cache.end() || it->second.status != testcase_status::passed;
+            }
+        }
+    }}
+}
@@ -0,0 +1,145 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <fstream>
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <reaver/exception.h>
+
+#include "startup_profile.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        namespace _detail
+        {
+            // what the runner itself cost during its last run, as opposed to the testcases; printed with --runner-stats
+            struct _runner_stats
+            {
+                // counted on the threads running the testcases
+                std::atomic<std::uint64_t> executed{};
+                // from handing a testcase to the implementation to getting its result back, and what the testcases measured themselves
+                std::atomic<std::uint64_t> execution_ns{};
+                std::atomic<std::uint64_t> test_ns{};
+                // getting a testcase into a process: spawning a child, forking the zygote or writing to a worker
+                std::atomic<std::uint64_t> starts{};
+                std::atomic<std::uint64_t> start_ns{};
+
+                // counted on the reporting thread
+                std::uint64_t reported = 0;
+                std::chrono::nanoseconds reporting{};
+
+                std::chrono::nanoseconds run{};
+                // in kilobytes; the high-water mark of the whole process, so it includes whatever it did before the run
+                std::size_t peak_rss = 0;
+
+                void reset()
+                {
+                    executed = 0;
+                    execution_ns = 0;
+                    test_ns = 0;
+                    starts = 0;
+                    start_ns = 0;
+                    reported = 0;
+                    reporting = {};
+                    run = {};
+                    peak_rss = 0;
+                }
+
+                void executed_test(std::chrono::nanoseconds execution, std::chrono::nanoseconds test)
+                {
+                    ++executed;
+                    execution_ns += execution.count();
+                    test_ns += std::min(test, execution).count();
+                }
+
+                void started_test(std::chrono::nanoseconds latency)
+                {
+                    ++starts;
+                    start_ns += latency.count();
+                }
+
+                std::chrono::nanoseconds overhead_per_test() const
+                {
+                    return std::chrono::nanoseconds{ executed ? static_cast<std::int64_t>((execution_ns - test_ns) / executed) : 0 };
+                }
+
+                std::chrono::nanoseconds start_latency() const
+                {
+                    return std::chrono::nanoseconds{ starts ? static_cast<std::int64_t>(start_ns / starts) : 0 };
+                }
+
+                // results handed to the reporters per second of reporting
+                double reporter_throughput() const
+                {
+                    return reporting.count() ? reported / std::chrono::duration<double>{ reporting }.count() : 0;
+                }
+            };
+
+            // VmHWM of /proc/self/status, which - unlike ru_maxrss - can be reset between measurements, see _reset_peak_rss()
+            inline std::size_t _peak_rss()
+            {
+                std::ifstream status{ "/proc/self/status" };
+                for (std::string line; std::getline(status, line); )
+                {
+                    if (line.compare(0, 6, "VmHWM:") == 0)
+                    {
+                        return std::stoull(line.substr(6));
+                    }
+                }
+
+                ::rusage usage;
+                ::getrusage(RUSAGE_SELF, &usage);
+                return usage.ru_maxrss;
+            }
+
+            // makes the high-water mark start over from the current RSS; Linux only, ignored elsewhere
+            inline void _reset_peak_rss()
+            {
+                std::ofstream clear_refs{ "/proc/self/clear_refs" };
+                clear_refs << "5" << std::flush;
+            }
+
+            inline void _print_runner_stats(const _runner_stats & stats)
+            {
+                reaver::logger::dlog() << "Runner statistics:";
+                reaver::logger::dlog() << "  run: " << stats.executed.load() << " tests executed in " << _profile_time(stats.run) << ", with "
+                    << _profile_time(stats.overhead_per_test()) << " of runner overhead per test.";
+                reaver::logger::dlog() << "  processes: " << stats.starts.load() << " tests started in a process, " << _profile_time(stats.start_latency()) << " on average.";
+                reaver::logger::dlog() << "  reporting: " << stats.reported << " results in " << _profile_time(stats.reporting) << ", "
+                    << static_cast<std::uint64_t>(stats.reporter_throughput()) << " results per second.";
+                reaver::logger::dlog() << "  peak RSS: " << stats.peak_rss << "kB.";
+            }
+        }
+    }}
+}
@@ -0,0 +1,115 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+
+#pragma once
+
+#include <cstring>
+#include <string>
+
+#include "../testcase.h"
+
+// provided by the LeakSanitizer runtime (standalone or as a part of AddressSanitizer) when the tests are built with it
+extern "C" int __lsan_do_recoverable_leak_check() __attribute__((weak));
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        namespace _detail
+        {
+            // a persistent worker never exits between testcases, so the leak check the runtime does at exit would blame nobody; this does it
+            // after every testcase instead, without exiting even if something leaked - but every later check would report the same leak again,
+            // so a worker that got a sanitizer report is never reused
+            inline void _leak_check()
+            {
+                if (__lsan_do_recoverable_leak_check)
+                {
+                    __lsan_do_recoverable_leak_check();
+                }
+            }
+
+            // the first sanitizer report found on the stderr of a child; the status it maps to, and a single line telling what it is about
+            struct _sanitizer_report
+            {
+                testcase_status status = testcase_status::not_started;
+                std::string description;
+                bool summarized = false;
+
+                explicit operator bool() const
+                {
+                    return status != testcase_status::not_started;
+                }
+
+                // every report starts with a line naming the sanitizer, and (UBSan aside) ends with `SUMMARY: <sanitizer>: ...`, which is
+                // the best description of it there is; a UBSan report is a single line, telling exactly where and what happened; the lines
+                // are matched in place, as they're scanned for every line the children write to stderr
+                void scan(const char * line, std::size_t length)
+                {
+                    if (!*this)
+                    {
+                        static const struct
+                        {
+                            const char * marker;
+                            std::size_t length;
+                            testcase_status status;
+                        } markers[] = {
+                            { "ERROR: LeakSanitizer: ", 22, testcase_status::leaked },
+                            { "WARNING: ThreadSanitizer: ", 26, testcase_status::data_race },
+                            { "ERROR: AddressSanitizer: ", 25, testcase_status::memory_error },
+                            { "WARNING: MemorySanitizer: ", 26, testcase_status::memory_error },
+                            { ": runtime error: ", 17, testcase_status::undefined_behavior }
+                        };
+
+                        for (auto && elem : markers)
+                        {
+                            auto position = static_cast<const char *>(::memmem(line, length, elem.marker, elem.length));
+                            if (position)
+                            {
+                                status = elem.status;
+                                if (elem.status == testcase_status::undefined_behavior)
+                                {
+                                    description.assign(line, length);
+                                }
+
+                                else
+                                {
+                                    description.assign(position + elem.length, line + length);
+                                }
+
+                                return;
+                            }
+                        }
+
+                        return;
+                    }
+
+                    if (!summarized && status != testcase_status::undefined_behavior && length >= 9 && !std::memcmp(line, "SUMMARY: ", 9))
+                    {
+                        description.assign(line + 9, length - 9);
+                        summarized = true;
+                    }
+                }
+            };
+        }
+    }}
+}
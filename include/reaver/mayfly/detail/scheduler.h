@@ -0,0 +1,271 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <utility>
+
+#include "resources.h"
+#include "affinity.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        namespace _detail
+        {
+            // a work-stealing pool shared by all the suites of a run; every worker owns a queue that it drains from the front,
+            // so the tests run roughly in submission order, and steals from the back of the other queues when its own is empty;
+            // a task whose resources are held by running ones is passed over for the next one that can run, until they're released;
+            // with a `placement`, every worker stays on the CPUs of its slot (and so do the processes that it starts)
+            class _scheduler
+            {
+            public:
+                _scheduler(std::size_t threads, _resource_pool resources = {}, std::vector<::cpu_set_t> placement = {}) : _queues(threads ? threads : 1),
+                    _resources{ std::move(resources) }, _placement{ std::move(placement) }
+                {
+                    for (auto & q : _queues)
+                    {
+                        q = std::make_unique<_queue>();
+                    }
+
+                    _workers.reserve(_queues.size());
+                    for (std::size_t i = 0; i < _queues.size(); ++i)
+                    {
+                        _workers.emplace_back([this, i]{ _work(i); });
+                    }
+                }
+
+                _scheduler(const _scheduler &) = delete;
+                _scheduler & operator=(const _scheduler &) = delete;
+
+                ~_scheduler()
+                {
+                    {
+                        std::lock_guard<std::mutex> lock{ _mutex };
+                        _stopped = true;
+                    }
+
+                    _cv.notify_all();
+
+                    for (auto & worker : _workers)
+                    {
+                        worker.join();
+                    }
+                }
+
+                void push(std::function<void ()> task, _resource_demand demand = {})
+                {
+                    auto & q = *_queues[_next++ % _queues.size()];
+
+                    {
+                        std::lock_guard<std::mutex> lock{ _mutex };
+                        ++_pending;
+                    }
+
+                    {
+                        std::lock_guard<std::mutex> lock{ q.mutex };
+                        q.tasks.push_back({ std::move(task), std::move(demand) });
+                    }
+
+                    {
+                        std::lock_guard<std::mutex> lock{ _mutex };
+                        ++_available;
+                        ++_epoch;
+                    }
+
+                    _cv.notify_one();
+                }
+
+                // blocks until every pushed task has finished; rethrows the first exception that escaped a task
+                void wait()
+                {
+                    std::unique_lock<std::mutex> lock{ _mutex };
+                    _done_cv.wait(lock, [&]{ return !_pending; });
+
+                    if (_exception)
+                    {
+                        std::rethrow_exception(std::exchange(_exception, nullptr));
+                    }
+                }
+
+                std::size_t size() const
+                {
+                    return _queues.size();
+                }
+
+            private:
+                struct _task
+                {
+                    std::function<void ()> run;
+                    _resource_demand demand;
+                };
+
+                struct _queue
+                {
+                    std::mutex mutex;
+                    std::deque<_task> tasks;
+                };
+
+                // takes the first task of the queue that can run now, scanning from the front or from the back; the resources are
+                // acquired (under the pool's lock, nested in the queue's) before the task leaves the queue
+                bool _take(_queue & q, bool front, _task & task)
+                {
+                    std::lock_guard<std::mutex> lock{ q.mutex };
+
+                    for (std::size_t i = 0; i < q.tasks.size(); ++i)
+                    {
+                        auto it = front ? q.tasks.begin() + i : q.tasks.end() - 1 - i;
+
+                        {
+                            std::lock_guard<std::mutex> pool_lock{ _mutex };
+                            if (!_resources.try_acquire(it->demand))
+                            {
+                                continue;
+                            }
+
+                            --_available;
+                        }
+
+                        task = std::move(*it);
+                        q.tasks.erase(it);
+                        return true;
+                    }
+
+                    return false;
+                }
+
+                bool _pop(std::size_t index, _task & task)
+                {
+                    if (_take(*_queues[index], true, task))
+                    {
+                        return true;
+                    }
+
+                    for (std::size_t i = 1; i < _queues.size(); ++i)
+                    {
+                        if (_take(*_queues[(index + i) % _queues.size()], false, task))
+                        {
+                            return true;
+                        }
+                    }
+
+                    return false;
+                }
+
+                void _work(std::size_t index)
+                {
+                    std::unique_ptr<_affinity_scope> pin;
+                    if (index < _placement.size())
+                    {
+                        pin = std::make_unique<_affinity_scope>(_placement[index]);
+                    }
+
+                    _task task;
+                    std::size_t seen = 0;
+
+                    while (true)
+                    {
+                        {
+                            std::unique_lock<std::mutex> lock{ _mutex };
+                            _cv.wait(lock, [&]{ return (_available && _epoch != seen) || _stopped; });
+
+                            if (!_available)
+                            {
+                                return;
+                            }
+
+                            seen = _epoch;
+                        }
+
+                        // another worker may have taken the task that woke this one up, or the resources of all the queued ones
+                        // are taken; either way, there's nothing to do until another push or release
+                        if (!_pop(index, task))
+                        {
+                            std::lock_guard<std::mutex> lock{ _mutex };
+                            _passed_over = true;
+                            continue;
+                        }
+
+                        try
+                        {
+                            task.run();
+                        }
+
+                        catch (...)
+                        {
+                            std::lock_guard<std::mutex> lock{ _mutex };
+                            if (!_exception)
+                            {
+                                _exception = std::current_exception();
+                            }
+                        }
+
+                        task.run = nullptr;
+
+                        std::lock_guard<std::mutex> lock{ _mutex };
+                        _resources.release(task.demand);
+                        ++_epoch;
+
+                        if (!--_pending)
+                        {
+                            _done_cv.notify_all();
+                        }
+
+                        // whatever was waiting for these resources may be able to run now
+                        if (_passed_over)
+                        {
+                            _passed_over = false;
+                            _cv.notify_all();
+                        }
+                    }
+                }
+
+                std::vector<std::unique_ptr<_queue>> _queues;
+                std::vector<std::thread> _workers;
+                std::atomic<std::size_t> _next{ 0 };
+
+                std::mutex _mutex;
+                std::condition_variable _cv;
+                std::condition_variable _done_cv;
+                std::size_t _pending = 0;
+                std::size_t _available = 0;
+                // bumped on every push and every release, which are the only events that can make a passed-over task runnable
+                std::size_t _epoch = 1;
+                _resource_pool _resources;
+                bool _passed_over = false;
+                std::vector<::cpu_set_t> _placement;
+                bool _stopped = false;
+                std::exception_ptr _exception;
+            };
+        }
+    }}
+}
@@ -0,0 +1,93 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <reaver/exception.h>
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        namespace _detail
+        {
+            // what a test binary did before running anything; kept by a registry, printed with --profile-startup
+            struct _startup_profile
+            {
+                using clock = std::chrono::steady_clock;
+
+                std::size_t suites = 0;
+                std::size_t testcases = 0;
+                std::size_t records = 0;
+
+                // the first and the last registration; other static initialization in between is counted too
+                clock::time_point first_registration;
+                clock::time_point last_registration;
+
+                // building the suite tree out of the registrations, and indexing it; both happen on first use
+                std::chrono::nanoseconds materialization{};
+                std::size_t materializations = 0;
+                std::chrono::nanoseconds indexing{};
+
+                void registered()
+                {
+                    auto now = clock::now();
+                    if (!records++)
+                    {
+                        first_registration = now;
+                    }
+
+                    last_registration = now;
+                }
+            };
+
+            inline std::string _profile_time(std::chrono::nanoseconds time)
+            {
+                std::ostringstream str;
+                str << std::fixed << std::setprecision(3) << std::chrono::duration<double, std::milli>{ time }.count() << "ms";
+                return str.str();
+            }
+
+            inline void _print_startup_profile(const _startup_profile & profile)
+            {
+                ::rusage usage;
+                ::getrusage(RUSAGE_SELF, &usage);
+
+                reaver::logger::dlog() << "Startup profile:";
+                reaver::logger::dlog() << "  registration: " << profile.records << " registrations of " << profile.suites << " suites and " << profile.testcases
+                    << " testcases, over " << _profile_time(profile.last_registration - profile.first_registration) << ".";
+                reaver::logger::dlog() << "  suite tree: built " << profile.materializations << " time(s), in " << _profile_time(profile.materialization) << ".";
+                reaver::logger::dlog() << "  test index: built in " << _profile_time(profile.indexing) << ".";
+                reaver::logger::dlog() << "  peak RSS so far: " << usage.ru_maxrss << "kB.";
+            }
+        }
+    }}
+}
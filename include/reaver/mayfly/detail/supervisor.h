@@ -0,0 +1,562 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cstdint>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <map>
+#include <unordered_map>
+#include <condition_variable>
+#include <system_error>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+
+#include "protocol.h"
+#include "pidfd.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        namespace _detail
+        {
+            // a single thread that owns the deadlines of all the running testcases, reads their output and reaps the children the runner
+            // started itself; it sleeps in epoll_wait until the closest deadline, data on one of the pipes, a child's exit (through its pidfd)
+            // or a change to the watch list
+            class _supervisor
+            {
+            public:
+                using watch_id = std::uint64_t;
+
+                enum class outcome
+                {
+                    completed,
+                    timed_out,
+                    cancelled
+                };
+
+                _supervisor() : _epoll{ ::epoll_create1(EPOLL_CLOEXEC) }, _wakeup{ ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK) }
+                {
+                    if (_epoll == -1 || _wakeup == -1)
+                    {
+                        throw std::system_error{ errno, std::system_category() };
+                    }
+
+                    ::epoll_event event{};
+                    event.events = EPOLLIN;
+                    event.data.u64 = 0;
+                    ::epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeup, &event);
+
+                    _thread = std::thread{ [this]{ _loop(); } };
+                }
+
+                _supervisor(const _supervisor &) = delete;
+                _supervisor & operator=(const _supervisor &) = delete;
+
+                ~_supervisor()
+                {
+                    {
+                        std::lock_guard<std::mutex> lock{ _mutex };
+                        _stopped = true;
+                    }
+
+                    _wake();
+                    _thread.join();
+
+                    // whatever is still here has no deadline anymore, only needs reaping
+                    for (auto && elem : _watches)
+                    {
+                        _finish(elem.second, true);
+                    }
+
+                    ::close(_wakeup);
+                    ::close(_epoll);
+                }
+
+                // `owned` children are reaped once they exit; the others (persistent workers, children of the fork server) only get killed;
+                // `output` is read into `parser` until the end of the testcase; with the binary protocol that end is seen on `results`
+                // instead, and `output` is only drained at that point; `errors` (the stderr of the child, or -1) is read along with them and
+                // drained at the end too; the descriptors themselves stay owned by the caller, except for `pidfd`: one opened by whoever
+                // reaps the child (the zygote of the fork server) is taken over, otherwise one is opened here
+                watch_id watch(pid_t pid, bool owned, std::chrono::steady_clock::duration timeout, int output, int errors, int results, _protocol_parser & parser,
+                    int pidfd = -1)
+                {
+                    for (auto fd : { output, errors, results })
+                    {
+                        if (fd != -1)
+                        {
+                            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+                        }
+                    }
+
+                    std::lock_guard<std::mutex> lock{ _mutex };
+
+                    auto id = ++_last_id;
+                    auto & w = _watches[id];
+                    w.pid = pid;
+                    w.owned = owned;
+                    w.pidfd = pidfd;
+
+                    // without pidfds at all, the pid is all there is; and the pid of a child that's only reaped here can't be reused while
+                    // it's watched - but that of a child the fork server reaps can, any time after it exited
+                    if (w.pidfd == -1)
+                    {
+                        w.pidfd = _pidfd_open(pid);
+                        w.kill_by_pid = w.pidfd == -1 && (owned || errno == ENOSYS);
+                    }
+
+                    w.output = output;
+                    w.errors = errors;
+                    w.results = results;
+                    w.parser = &parser;
+                    w.deadline = std::chrono::steady_clock::now() + timeout;
+                    _deadlines.emplace(w.deadline, id);
+
+                    // a child that got started just as the run was being cancelled doesn't get to run either
+                    if (_cancelled)
+                    {
+                        _kill(w);
+                        w.cancelled = true;
+                    }
+
+                    ::epoll_event event{};
+                    event.events = EPOLLIN;
+
+                    if (w.pidfd != -1)
+                    {
+                        event.data.u64 = id << 2;
+                        ::epoll_ctl(_epoll, EPOLL_CTL_ADD, w.pidfd, &event);
+                    }
+
+                    event.data.u64 = (id << 2) | _output_event;
+                    ::epoll_ctl(_epoll, EPOLL_CTL_ADD, output, &event);
+
+                    if (errors != -1)
+                    {
+                        event.data.u64 = (id << 2) | _errors_event;
+                        ::epoll_ctl(_epoll, EPOLL_CTL_ADD, errors, &event);
+                    }
+
+                    if (results != -1)
+                    {
+                        event.data.u64 = (id << 2) | _results_event;
+                        ::epoll_ctl(_epoll, EPOLL_CTL_ADD, results, &event);
+                    }
+
+                    _wake();
+
+                    return id;
+                }
+
+                // kills every child whose testcase hasn't completed yet, and every child watched from now on
+                void cancel()
+                {
+                    std::lock_guard<std::mutex> lock{ _mutex };
+
+                    _cancelled = true;
+
+                    for (auto && elem : _watches)
+                    {
+                        auto & w = elem.second;
+                        if (!w.complete && !w.exited)
+                        {
+                            _kill(w);
+                            w.cancelled = true;
+                        }
+                    }
+                }
+
+                // blocks until the testcase's output is complete and drops its deadline; returns whether the child has been killed, for running
+                // past the deadline or by cancel()
+                outcome wait(watch_id id)
+                {
+                    std::unique_lock<std::mutex> lock{ _mutex };
+
+                    auto it = _watches.find(id);
+                    auto & w = it->second;
+
+                    _completed.wait(lock, [&]{ return w.complete; });
+
+                    auto result = w.cancelled ? outcome::cancelled : w.timed_out ? outcome::timed_out : outcome::completed;
+
+                    _cancel_deadline(id, w);
+
+                    if (!w.owned || w.exited)
+                    {
+                        _finish(w, false);
+                        _watches.erase(it);
+                    }
+
+                    // without a pidfd there's no way to learn about the exit in the loop; the child has closed its output already, so just wait here
+                    else if (w.pidfd == -1)
+                    {
+                        auto pid = w.pid;
+                        _watches.erase(it);
+                        lock.unlock();
+                        ::waitpid(pid, nullptr, 0);
+                    }
+
+                    else
+                    {
+                        w.released = true;
+                    }
+
+                    return result;
+                }
+
+            private:
+                static constexpr std::uint64_t _output_event = 1;
+                static constexpr std::uint64_t _results_event = 2;
+                static constexpr std::uint64_t _errors_event = 3;
+
+                struct _watch
+                {
+                    pid_t pid;
+                    bool owned;
+                    int pidfd;
+                    bool kill_by_pid = false;
+                    int output;
+                    int errors;
+                    int results;
+                    bool output_closed = false;
+                    bool errors_closed = false;
+                    _protocol_parser * parser;
+                    std::chrono::steady_clock::time_point deadline;
+                    bool has_deadline = true;
+                    bool complete = false;
+                    bool timed_out = false;
+                    bool cancelled = false;
+                    bool exited = false;
+                    bool released = false;
+                };
+
+                void _wake()
+                {
+                    std::uint64_t one = 1;
+                    auto ret = ::write(_wakeup, &one, sizeof(one));
+                    (void)ret;
+                }
+
+                // signalling through the pidfd can't hit an unrelated process that reused the pid; when it fails, the child is gone already
+                static void _kill(_watch & w)
+                {
+                    if (w.exited)
+                    {
+                        return;
+                    }
+
+                    if (w.pidfd != -1)
+                    {
+                        _pidfd_kill(w.pidfd);
+                    }
+
+                    else if (w.kill_by_pid)
+                    {
+                        ::kill(w.pid, SIGKILL);
+                    }
+                }
+
+                void _cancel_deadline(watch_id id, _watch & w)
+                {
+                    if (!w.has_deadline)
+                    {
+                        return;
+                    }
+
+                    auto range = _deadlines.equal_range(w.deadline);
+                    for (auto it = range.first; it != range.second; ++it)
+                    {
+                        if (it->second == id)
+                        {
+                            _deadlines.erase(it);
+                            break;
+                        }
+                    }
+
+                    w.has_deadline = false;
+                }
+
+                void _finish(_watch & w, bool blocking)
+                {
+                    if (w.pidfd != -1)
+                    {
+                        ::epoll_ctl(_epoll, EPOLL_CTL_DEL, w.pidfd, nullptr);
+                        ::close(w.pidfd);
+                        w.pidfd = -1;
+                    }
+
+                    if (w.owned && (blocking || w.exited))
+                    {
+                        ::waitpid(w.pid, nullptr, blocking && !w.exited ? 0 : WNOHANG);
+                    }
+                }
+
+                void _loop()
+                {
+                    ::epoll_event events[16];
+
+                    while (true)
+                    {
+                        int timeout = -1;
+
+                        {
+                            std::lock_guard<std::mutex> lock{ _mutex };
+
+                            if (_stopped)
+                            {
+                                return;
+                            }
+
+                            auto now = std::chrono::steady_clock::now();
+                            while (!_deadlines.empty() && _deadlines.begin()->first <= now)
+                            {
+                                auto & w = _watches[_deadlines.begin()->second];
+                                _deadlines.erase(_deadlines.begin());
+                                w.has_deadline = false;
+
+                                _kill(w);
+                                w.timed_out = !w.exited;
+                            }
+
+                            if (!_deadlines.empty())
+                            {
+                                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(_deadlines.begin()->first - now);
+                                timeout = static_cast<int>(left.count()) + 1;
+                            }
+                        }
+
+                        auto count = ::epoll_wait(_epoll, events, 16, timeout);
+
+                        for (int i = 0; i < count; ++i)
+                        {
+                            if (events[i].data.u64 == 0)
+                            {
+                                std::uint64_t value;
+                                auto ret = ::read(_wakeup, &value, sizeof(value));
+                                (void)ret;
+                                continue;
+                            }
+
+                            auto id = events[i].data.u64 >> 2;
+                            auto kind = events[i].data.u64 & 3;
+
+                            std::unique_lock<std::mutex> lock{ _mutex };
+
+                            auto it = _watches.find(id);
+                            if (it == _watches.end())
+                            {
+                                continue;
+                            }
+
+                            auto & w = it->second;
+
+                            if (kind != 0)
+                            {
+                                if (w.complete)
+                                {
+                                    continue;
+                                }
+
+                                // the watch can't go away before it's marked complete, and only this thread does that
+                                lock.unlock();
+                                auto complete = kind == _output_event ? _read_output(w) : kind == _results_event ? _read_results(w) : _read_errors(w);
+                                if (complete)
+                                {
+                                    _drain_errors(w);
+                                }
+                                lock.lock();
+
+                                if (complete)
+                                {
+                                    if (!w.output_closed)
+                                    {
+                                        ::epoll_ctl(_epoll, EPOLL_CTL_DEL, w.output, nullptr);
+                                    }
+
+                                    if (w.results != -1)
+                                    {
+                                        ::epoll_ctl(_epoll, EPOLL_CTL_DEL, w.results, nullptr);
+                                    }
+
+                                    w.complete = true;
+                                    _completed.notify_all();
+                                }
+
+                                continue;
+                            }
+
+                            w.exited = true;
+                            _finish(w, false);
+
+                            if (w.released)
+                            {
+                                _watches.erase(it);
+                            }
+                        }
+                    }
+                }
+
+                // returns false on EAGAIN (or after a single chunk of data, when `drain` is false), true on EOF; `data` tells whether anything was read
+                template<typename F>
+                bool _read(int fd, bool drain, F && data)
+                {
+                    while (true)
+                    {
+                        auto size = ::read(fd, _buffer, sizeof(_buffer));
+
+                        if (size > 0)
+                        {
+                            // a single read per wakeup keeps one chatty child from starving the others; epoll will report the rest
+                            if (data(size) || !drain)
+                            {
+                                return false;
+                            }
+
+                            continue;
+                        }
+
+                        if (size == -1 && errno == EINTR)
+                        {
+                            continue;
+                        }
+
+                        if (size == -1 && errno == EAGAIN)
+                        {
+                            return false;
+                        }
+
+                        return true;
+                    }
+                }
+
+                bool _read_output(_watch & w)
+                {
+                    // with the binary protocol the output stream doesn't decide anything; its end only stops it from being polled
+                    if (w.results != -1)
+                    {
+                        if (_read(w.output, false, [&](std::size_t size){ w.parser->feed(_buffer, size); return false; }))
+                        {
+                            _close_output(w);
+                        }
+
+                        return false;
+                    }
+
+                    bool done = false;
+                    if (_read(w.output, false, [&](std::size_t size){ return done = w.parser->feed(_buffer, size); }))
+                    {
+                        w.parser->finish();
+                        return true;
+                    }
+
+                    return done;
+                }
+
+                bool _read_results(_watch & w)
+                {
+                    bool done = false;
+                    auto eof = _read(w.results, false, [&](std::size_t size){ return done = w.parser->feed_frames(_buffer, size); });
+
+                    if (!done && !eof)
+                    {
+                        return false;
+                    }
+
+                    // everything the child printed before the end of the testcase is already in the pipe by now
+                    if (!w.output_closed && _read(w.output, true, [&](std::size_t size){ w.parser->feed(_buffer, size); return false; }))
+                    {
+                        _close_output(w);
+                    }
+
+                    if (eof || w.output_closed)
+                    {
+                        w.parser->finish();
+                    }
+
+                    return true;
+                }
+
+                // stderr never decides anything; a child that closes it just isn't polled for it anymore
+                bool _read_errors(_watch & w)
+                {
+                    if (_read(w.errors, false, [&](std::size_t size){ w.parser->feed_errors(_buffer, size); return false; }))
+                    {
+                        ::epoll_ctl(_epoll, EPOLL_CTL_DEL, w.errors, nullptr);
+                        w.errors_closed = true;
+                    }
+
+                    return false;
+                }
+
+                // whatever the child wrote to stderr before the end of the testcase is in the pipe by then, just like its output
+                void _drain_errors(_watch & w)
+                {
+                    if (w.errors == -1)
+                    {
+                        return;
+                    }
+
+                    if (!w.errors_closed)
+                    {
+                        _read(w.errors, true, [&](std::size_t size){ w.parser->feed_errors(_buffer, size); return false; });
+                        ::epoll_ctl(_epoll, EPOLL_CTL_DEL, w.errors, nullptr);
+                        w.errors_closed = true;
+                    }
+
+                    w.parser->finish_errors();
+                }
+
+                void _close_output(_watch & w)
+                {
+                    std::lock_guard<std::mutex> lock{ _mutex };
+                    ::epoll_ctl(_epoll, EPOLL_CTL_DEL, w.output, nullptr);
+                    w.output_closed = true;
+                }
+
+                int _epoll;
+                int _wakeup;
+                std::thread _thread;
+
+                char _buffer[64 * 1024];
+
+                std::mutex _mutex;
+                std::condition_variable _completed;
+                bool _stopped = false;
+                bool _cancelled = false;
+                watch_id _last_id = 0;
+                std::unordered_map<watch_id, _watch> _watches;
+                std::multimap<std::chrono::steady_clock::time_point, watch_id> _deadlines;
+            };
+        }
+    }}
+}
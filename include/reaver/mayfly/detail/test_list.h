@@ -0,0 +1,139 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <istream>
+
+#include "../suite.h"
+#include "resources.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        namespace _detail
+        {
+            // a testcase as printed by --list-tests, and as read back by the driver; one line each, in order of the ids:
+            // `<id>\t<suite path>\t<name>\t<resources>`, with the resources in the syntax of _parse_resources
+            struct _listed_test
+            {
+                std::size_t id;
+                std::string suite_path;
+                std::string name;
+                std::string resources;
+            };
+
+            inline std::string _format_resources(const _resource_demand & demand)
+            {
+                std::string spec = demand.exclusive ? "exclusive" : "";
+                for (auto && elem : demand.amounts)
+                {
+                    if (!spec.empty())
+                    {
+                        spec += ',';
+                    }
+
+                    spec += elem.first + ':' + std::to_string(elem.second);
+                }
+
+                return spec;
+            }
+
+            // the ids are handed out like in _test_index, sub-suites first; benchmarks are measured in the process that runs them,
+            // so they're left out, and only ever run by their own executable
+            inline void _list_suite(std::ostream & out, const suite & s, const std::string & parent_path, _resource_demand resources, std::size_t & next_id)
+            {
+                auto path = parent_path.empty() ? s.name() : parent_path + "/" + s.name();
+                resources.merge(s.resources());
+
+                for (auto && sub : s.suites())
+                {
+                    _list_suite(out, sub, path, resources, next_id);
+                }
+
+                for (auto && test : s)
+                {
+                    auto demand = resources;
+                    demand.merge(test.resources());
+                    auto spec = _format_resources(demand);
+
+                    for (std::size_t i = 0; i < test.cases(); ++i)
+                    {
+                        auto id = next_id++;
+                        if (!test.is_benchmark())
+                        {
+                            out << id << '\t' << path << '\t' << test.case_name(i) << '\t' << spec << '\n';
+                        }
+                    }
+                }
+            }
+
+            inline void _list_tests(std::ostream & out, const std::vector<suite> & suites)
+            {
+                std::size_t next_id = 0;
+                for (auto && s : suites)
+                {
+                    _list_suite(out, s, {}, {}, next_id);
+                }
+            }
+
+            // returns false on the first malformed line
+            inline bool _read_test_list(std::istream & in, std::vector<_listed_test> & tests)
+            {
+                std::string line;
+                while (std::getline(in, line))
+                {
+                    if (line.empty())
+                    {
+                        continue;
+                    }
+
+                    auto first = line.find('\t');
+                    auto second = first == std::string::npos ? first : line.find('\t', first + 1);
+                    auto third = second == std::string::npos ? second : line.find('\t', second + 1);
+                    if (third == std::string::npos || first == 0 || second == first + 1 || third == second + 1)
+                    {
+                        return false;
+                    }
+
+                    char * end;
+                    auto id = std::strtoull(line.c_str(), &end, 10);
+                    if (end != line.c_str() + first)
+                    {
+                        return false;
+                    }
+
+                    tests.push_back({ static_cast<std::size_t>(id), line.substr(first + 1, second - first - 1), line.substr(second + 1, third - second - 1),
+                        line.substr(third + 1) });
+                }
+
+                return true;
+            }
+        }
+    }}
+}
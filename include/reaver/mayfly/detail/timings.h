@@ -0,0 +1,170 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_set>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+
+#include <reaver/exception.h>
+
+#include "replace_file.h"
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        class timing_file_error : public exception
+        {
+        public:
+            timing_file_error(const std::string & path) : exception{ logger::error }
+            {
+                *this << "failed to write the timing file `" << path << "`.";
+            }
+        };
+
+        namespace _detail
+        {
+            // kept sorted by path, so that a timing file committed next to the tests produces readable diffs
+            using _timings = std::map<std::string, std::chrono::milliseconds>;
+
+            // one testcase per line: the duration in milliseconds, a single space and the full path of the testcase;
+            // a missing file is just an empty history
+            inline _timings _load_timings(const std::string & path)
+            {
+                _timings timings;
+
+                std::ifstream in{ path };
+                std::string line;
+
+                while (std::getline(in, line))
+                {
+                    auto space = line.find(' ');
+                    if (space == std::string::npos || space == 0)
+                    {
+                        continue;
+                    }
+
+                    try
+                    {
+                        timings[line.substr(space + 1)] = std::chrono::milliseconds{ std::stoll(line.substr(0, space)) };
+                    }
+
+                    catch (std::exception &)
+                    {
+                    }
+                }
+
+                return timings;
+            }
+
+            inline void _save_timings(const std::string & path, const _timings & timings)
+            {
+                _replace_file<timing_file_error>(path, [&](std::ostream & out)
+                {
+                    for (auto && elem : timings)
+                    {
+                        out << elem.second.count() << ' ' << elem.first << '\n';
+                    }
+                });
+            }
+
+            // what testcases that aren't in the history yet are assumed to take: as long as an average known one
+            inline std::chrono::milliseconds _mean_duration(const _timings & timings)
+            {
+                if (timings.empty())
+                {
+                    return std::chrono::milliseconds{ 1 };
+                }
+
+                std::chrono::milliseconds total{};
+                for (auto && elem : timings)
+                {
+                    total += elem.second;
+                }
+
+                return total / timings.size();
+            }
+
+            // `mean` is _mean_duration() of the same history, computed once by the caller
+            inline std::chrono::milliseconds _expected_duration(const _timings & timings, const std::string & path, std::chrono::milliseconds mean)
+            {
+                auto it = timings.find(path);
+                return it != timings.end() ? it->second : mean;
+            }
+
+            // the shard of a testcase without a timing history; 64-bit FNV-1a of its path, since std::hash is free to differ between
+            // standard libraries, and so between agents
+            inline std::size_t _shard_of(const std::string & path, std::size_t count)
+            {
+                std::uint64_t hash = 14695981039346656037ull;
+                for (auto c : path)
+                {
+                    hash ^= static_cast<unsigned char>(c);
+                    hash *= 1099511628211ull;
+                }
+
+                return hash % count;
+            }
+
+            // longest-processing-time-first partitioning: the longest remaining testcase goes to the least loaded shard; sorting by
+            // duration and then by path keeps the outcome identical on every agent that has the same timing file
+            inline std::unordered_set<std::string> _weighted_shard(std::vector<std::string> paths, const _timings & timings, std::size_t index, std::size_t count)
+            {
+                std::vector<std::pair<std::chrono::milliseconds, std::string>> weighted;
+                weighted.reserve(paths.size());
+
+                auto mean = _mean_duration(timings);
+                for (auto && path : paths)
+                {
+                    weighted.emplace_back(_expected_duration(timings, path, mean), std::move(path));
+                }
+
+                std::sort(weighted.begin(), weighted.end(), [](auto && lhs, auto && rhs)
+                {
+                    return lhs.first != rhs.first ? lhs.first > rhs.first : lhs.second < rhs.second;
+                });
+
+                std::vector<std::chrono::milliseconds> loads(count);
+                std::unordered_set<std::string> selected;
+
+                for (auto && elem : weighted)
+                {
+                    auto lightest = std::min_element(loads.begin(), loads.end()) - loads.begin();
+                    loads[lightest] += std::max(elem.first, std::chrono::milliseconds{ 1 });
+
+                    if (static_cast<std::size_t>(lightest) == index)
+                    {
+                        selected.insert(std::move(elem.second));
+                    }
+                }
+
+                return selected;
+            }
+        }
+    }}
+}
@@ -0,0 +1,76 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <chrono>
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "../testcase.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        namespace _detail
+        {
+            // measures what a testcase cost the process (RUSAGE_SELF) or only the thread (RUSAGE_THREAD) it is executed by; the peak RSS
+            // is that of the whole process either way, which is what the kernel tracks
+            class _usage_meter
+            {
+            public:
+                _usage_meter(int who) : _who{ who }
+                {
+                    ::getrusage(_who, &_before);
+                }
+
+                resource_usage operator()() const
+                {
+                    ::rusage after;
+                    ::getrusage(_who, &after);
+
+                    ::rusage process;
+                    ::getrusage(RUSAGE_SELF, &process);
+
+                    resource_usage usage;
+                    usage.user_time = _difference(after.ru_utime, _before.ru_utime);
+                    usage.system_time = _difference(after.ru_stime, _before.ru_stime);
+                    usage.peak_rss = process.ru_maxrss;
+                    usage.minor_faults = after.ru_minflt - _before.ru_minflt;
+                    usage.major_faults = after.ru_majflt - _before.ru_majflt;
+                    return usage;
+                }
+
+            private:
+                static std::chrono::nanoseconds _difference(const ::timeval & after, const ::timeval & before)
+                {
+                    return std::chrono::seconds{ after.tv_sec - before.tv_sec } + std::chrono::microseconds{ after.tv_usec - before.tv_usec };
+                }
+
+                int _who;
+                ::rusage _before;
+            };
+        }
+    }}
+}
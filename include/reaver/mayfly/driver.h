@@ -0,0 +1,402 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <sstream>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include <boost/filesystem.hpp>
+
+#include "runner.h"
+#include "detail/test_list.h"
+#include "detail/filter.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        class invalid_test_executable : public exception
+        {
+        public:
+            invalid_test_executable(const std::string & executable, const std::string & reason) : exception{ reaver::logger::error }
+            {
+                *this << "couldn't list the tests of `" << executable << "` - " << reason << ".";
+            }
+        };
+
+        class duplicate_test_executable : public exception
+        {
+        public:
+            duplicate_test_executable(const std::string & executable, const std::string & name) : exception{ reaver::logger::error }
+            {
+                *this << "the tests of `" << executable << "` would be reported under `" << name << "`, like those of another executable.";
+            }
+        };
+
+        class no_test_executables : public exception
+        {
+        public:
+            no_test_executables() : exception{ reaver::logger::error }
+            {
+                *this << "no test executables to run - name them (or directories containing them) with --binary.";
+            }
+        };
+
+        namespace _detail
+        {
+            // runs `executable --list-tests` and reads what it prints
+            inline std::vector<_listed_test> _query_tests(const std::string & executable)
+            {
+                if (::access(executable.c_str(), X_OK) == -1)
+                {
+                    throw invalid_test_executable{ executable, "it isn't an executable file" };
+                }
+
+                using namespace boost::process::initializers;
+
+                int fds[2];
+                if (::pipe2(fds, O_CLOEXEC) == -1)
+                {
+                    throw std::system_error{ errno, std::system_category() };
+                }
+
+                std::string listing;
+
+                {
+                    boost::iostreams::file_descriptor_sink sink{ fds[1], boost::iostreams::close_handle };
+                    auto child = boost::process::execute(set_args(std::vector<std::string>{ executable, "--list-tests" }), inherit_env(), bind_stdout(sink), close_stdin());
+
+                    // the write end has to be gone from this process too, or reading would never see the end of the listing
+                    sink.close();
+
+                    char buffer[4096];
+                    ssize_t length;
+                    while ((length = ::read(fds[0], buffer, sizeof(buffer))) != 0)
+                    {
+                        if (length == -1)
+                        {
+                            if (errno == EINTR)
+                            {
+                                continue;
+                            }
+
+                            ::close(fds[0]);
+                            throw std::system_error{ errno, std::system_category() };
+                        }
+
+                        listing.append(buffer, length);
+                    }
+
+                    ::close(fds[0]);
+
+                    auto status = boost::process::wait_for_exit(child);
+                    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                    {
+                        throw invalid_test_executable{ executable, "it didn't exit successfully with --list-tests; is it a Mayfly test executable?" };
+                    }
+                }
+
+                std::vector<_listed_test> tests;
+                std::istringstream stream{ listing };
+                if (!_read_test_list(stream, tests))
+                {
+                    throw invalid_test_executable{ executable, "it printed a malformed test list" };
+                }
+
+                return tests;
+            }
+
+            // a directory stands for all the executable files directly in it whose names match `pattern`, in the order of their names
+            inline std::vector<std::string> _discover_executables(const std::vector<std::string> & paths, const std::string & pattern)
+            {
+                std::vector<std::string> executables;
+
+                for (auto && path : paths)
+                {
+                    if (!boost::filesystem::is_directory(path))
+                    {
+                        executables.push_back(path);
+                        continue;
+                    }
+
+                    std::vector<std::string> found;
+                    for (boost::filesystem::directory_iterator it{ path }, end; it != end; ++it)
+                    {
+                        if (boost::filesystem::is_regular_file(it->status()) && _glob_match(pattern, it->path().filename().string())
+                            && ::access(it->path().c_str(), X_OK) == 0)
+                        {
+                            found.push_back(it->path().string());
+                        }
+                    }
+
+                    std::sort(found.begin(), found.end());
+                    executables.insert(executables.end(), found.begin(), found.end());
+                }
+
+                return executables;
+            }
+        }
+
+        // runs the tests of many test executables in a single pool, with a single report: every executable's tree is put in a top-level
+        // suite named after it, and every testcase is started as a child of the executable it came from, by its id there
+        class driver_runner : public subprocess_runner
+        {
+        public:
+            driver_runner(std::size_t threads = 1, std::size_t timeout = 60, result_protocol protocol = result_protocol::text) : subprocess_runner{ {}, threads, timeout,
+                {}, isolation_mode::subprocess, protocol }
+            {
+            }
+
+            void add_executable(std::string executable)
+            {
+                auto tests = _detail::_query_tests(executable);
+                add_executable(std::move(executable), tests);
+            }
+
+            void add_executable(std::string executable, const std::vector<_detail::_listed_test> & tests)
+            {
+                auto name = boost::filesystem::path{ executable }.filename().string();
+                if (!_indices.emplace(name, _executables.size()).second)
+                {
+                    throw duplicate_test_executable{ executable, name };
+                }
+
+                suite top{ name };
+                std::unordered_set<std::string> created;
+
+                for (auto && test : tests)
+                {
+                    std::deque<std::string> path_parts;
+                    boost::split(path_parts, test.suite_path, boost::is_any_of("/"));
+
+                    // suites come up in the order of the ids, which is the order they were planned in by the executable itself
+                    std::deque<std::string> parent;
+                    std::string path;
+                    for (auto && part : path_parts)
+                    {
+                        path += (path.empty() ? "" : "/") + part;
+                        if (created.emplace(path).second)
+                        {
+                            top.add(suite{ part }, parent);
+                        }
+
+                        parent.push_back(part);
+                    }
+
+                    // never called; the testcase only ever runs in a child of its executable
+                    testcase t{ test.name, []{} };
+                    if (!test.resources.empty())
+                    {
+                        t.uses(test.resources);
+                    }
+
+                    top.add(std::move(t), std::move(parent));
+                    _targets.emplace(name + "/" + test.suite_path + "/" + test.name, std::make_pair(_executables.size(), test.id));
+                }
+
+                _absolute.push_back(boost::filesystem::absolute(executable).string());
+                _executables.push_back(std::move(executable));
+                _suites.push_back(std::move(top));
+            }
+
+            // the combined tree; the runner is called with it
+            const std::vector<suite> & suites() const
+            {
+                return _suites;
+            }
+
+        protected:
+            virtual std::pair<std::string, std::string> _target(const _plan_entry & entry) const override
+            {
+                auto && target = _targets.at(entry.path);
+                return { _executables[target.first], "#" + std::to_string(target.second) };
+            }
+
+            // the top-level suite of a path is named after the executable
+            virtual const std::string & _executable_of(const std::string & path) const override
+            {
+                return _absolute[_indices.at(path.substr(0, path.find('/')))];
+            }
+
+        private:
+            std::vector<suite> _suites;
+            std::vector<std::string> _executables;
+            // the keys of their testcases in the result cache
+            std::vector<std::string> _absolute;
+            // the index of every executable, by the name of its top-level suite
+            std::unordered_map<std::string, std::size_t> _indices;
+            // the executable and the id there of every testcase, by its path in the combined tree
+            std::unordered_map<std::string, std::pair<std::size_t, std::size_t>> _targets;
+        };
+
+        namespace options
+        {
+            new_opt_desc(binary, std::vector<std::string>, "binary,b", "run the tests of this executable, or of the executables in this directory");
+            new_opt_desc(binary_pattern, boost::optional<std::string>, "binary-pattern", "only take the executables whose names match this glob from directories (`*` by default)");
+        }
+
+        // the main() of the mayfly driver executable
+        inline int run_driver(int argc, char ** argv)
+        {
+            boost::program_options::options_description general("General");
+            general.add_options()
+                ("help,h", "print this message")
+                ("version,v", "print version information");
+
+            boost::program_options::options_description config("Configuration");
+            config.add_options()
+                ("binary,b", boost::program_options::value<std::vector<std::string>>()->composing(), "run the tests of this executable, or of the executables in this directory")
+                ("binary-pattern", boost::program_options::value<std::string>(), "only take the executables whose names match this glob from directories (`*` by default)")
+                ("tasks,j", boost::program_options::value<std::size_t>(), "specify the amount of worker threads")
+                ("reporter,r", boost::program_options::value<std::vector<std::string>>()->composing(), "select a reporter to use (`name:path` writes a file, for junit and json)")
+                ("filter,f", boost::program_options::value<std::vector<std::string>>()->composing(), "run only the tests whose paths (starting with the executable's name) match one of these patterns")
+                ("exclude,x", boost::program_options::value<std::vector<std::string>>()->composing(), "never run the tests whose paths match one of these patterns")
+                ("resource", boost::program_options::value<std::vector<std::string>>()->composing(), "set the amount of a resource tests can hold at the same time (`name=amount`, e.g. `gpu=2` or `mem=64G`)")
+                ("quiet,q", "disable reporters")
+                ("timeout,l", boost::program_options::value<std::size_t>(), "specify the timeout for tests (in seconds)")
+                ("error,e", "only show errors and summary (controls console output)")
+                ("pin", boost::program_options::value<std::string>(), "pin every worker thread and its testcase processes to a CPU or a NUMA node (none, cpu, numa)")
+                ("protocol", boost::program_options::value<std::string>(), "select the protocol testcase processes report results with (text, binary)")
+                ("shard-index", boost::program_options::value<std::size_t>(), "run only the part of the tests with this index (counted from 0)")
+                ("shard-count", boost::program_options::value<std::size_t>(), "split the tests into this many disjoint parts")
+                ("timing-file", boost::program_options::value<std::string>(), "read and update test durations in this file, to run the longest tests first and balance shards")
+                ("output-limit", boost::program_options::value<std::size_t>(), "keep only about this many bytes of the beginning and the end of the output of every test (0 keeps all)")
+                ("perf-counters", boost::program_options::value<std::string>(), "read these hardware counters around every test")
+                ("result-cache", boost::program_options::value<std::string>(), "keep the last result of every test in this file (.mayfly-results by default, with --rerun-failed and --failed-first)")
+                ("rerun-failed", "run only the tests that didn't pass in the previous run (everything, if none failed)")
+                ("failed-first", "run the tests that didn't pass in the previous run before all the others")
+                ("fail-fast", "stop the run after the first failed test")
+                ("max-failures", boost::program_options::value<std::size_t>(), "stop the run after this many failed tests")
+                ("baseline", boost::program_options::value<std::string>(), "report tests slower than in this baseline file as regressed")
+                ("save-baseline", boost::program_options::value<std::string>(), "write the durations of passed tests to this baseline file")
+                ("regression-threshold", boost::program_options::value<std::size_t>(), "the slowdown against the baseline, in percent, above which a test has regressed")
+                ("runner-stats", "print what the runner itself cost (overhead per test, process start latency, reporting, peak RSS) after the run");
+
+            boost::program_options::options_description options;
+            options.add(general).add(config);
+
+            auto parsed = reaver::options::parse_argv(argc, argv, tpl::vector<options::help, options::version, options::binary, options::binary_pattern, options::tasks, options::reporter,
+                options::filter, options::exclude, options::resource, options::quiet, options::timeout, options::error, options::pin, options::protocol, options::shard_index,
+                options::shard_count, options::timing_file, options::output_limit, options::perf_counters, options::result_cache, options::rerun_failed, options::failed_first,
+                options::fail_fast, options::max_failures, options::baseline, options::save_baseline, options::regression_threshold, options::runner_stats>{});
+
+            if (parsed.get<options::help>())
+            {
+                std::cout << version_string << '\n';
+                std::cout << general << '\n' << config;
+
+                return 0;
+            }
+
+            if (parsed.get<options::version>())
+            {
+                std::cout << version_string;
+                std::cout << "Distributed under modified zlib license.\n\n";
+
+                std::cout << "Mayfly is the Reaver Project's free testing framework.\n";
+
+                return 0;
+            }
+
+            auto reporters = parsed.get<options::reporter>();
+            if (reporters.empty() && !parsed.get<options::quiet>())
+            {
+                reporters.push_back("console");
+            }
+
+            if (parsed.get<options::error>())
+            {
+                reaver::logger::default_logger().set_level(reaver::logger::error);
+            }
+
+            auto reps = _detail::_select_reporters(reporters);
+
+            if (auto counters = parsed.get<options::perf_counters>())
+            {
+                auto && selection = _detail::_perf_counter_selection();
+                boost::algorithm::split(selection, *counters, boost::is_any_of(","));
+
+                for (auto && name : selection)
+                {
+                    _detail::_perf_counter(name);
+                }
+            }
+
+            auto protocol = result_protocol::text;
+            if (auto name = parsed.get<options::protocol>())
+            {
+                if (*name == "binary")
+                {
+                    protocol = result_protocol::binary;
+                }
+
+                else if (*name != "text")
+                {
+                    throw invalid_result_protocol{ *name };
+                }
+            }
+
+            auto pattern = parsed.get<options::binary_pattern>();
+            auto executables = _detail::_discover_executables(parsed.get<options::binary>(), pattern ? *pattern : "*");
+            if (executables.empty())
+            {
+                throw no_test_executables{};
+            }
+
+            auto driver = std::make_unique<driver_runner>(parsed.get<options::tasks>(), parsed.get<options::timeout>(), protocol);
+            for (auto && executable : executables)
+            {
+                driver->add_executable(executable);
+            }
+
+            auto && suites = driver->suites();
+            default_runner(std::move(driver));
+            _detail::_configure_runner(default_runner(), parsed);
+
+            auto && reporter = combine(reps);
+            default_runner()(suites, reporter);
+            default_runner().summary(reporter);
+
+            if (parsed.get<options::runner_stats>())
+            {
+                _detail::_print_runner_stats(default_runner().stats());
+            }
+
+            if (default_runner().passed() == default_runner().total())
+            {
+                return 0;
+            }
+
+            return 1;
+        }
+    }}
+}
@@ -0,0 +1,249 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <reaver/exception.h>
+
+#include "reporter.h"
+#include "testcase.h"
+#include "suite.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        class report_file_error : public exception
+        {
+        public:
+            report_file_error(const std::string & path) : exception{ logger::error }
+            {
+                *this << "failed to open the report file `" << path << "`.";
+            }
+        };
+
+        namespace _detail
+        {
+            // appends into a buffer reserved once, and writes it out in large chunks; formatting numbers and escaping strings goes
+            // straight into the buffer too, so writing a record doesn't allocate at all once the buffer has its capacity
+            class _buffered_writer
+            {
+            public:
+                _buffered_writer(std::size_t capacity = 64 * 1024) : _capacity{ capacity }
+                {
+                    _buffer.reserve(_capacity);
+                }
+
+                _buffered_writer(const _buffered_writer &) = delete;
+                _buffered_writer & operator=(const _buffered_writer &) = delete;
+
+                ~_buffered_writer()
+                {
+                    flush();
+                    _close();
+                }
+
+                void open(const std::string & path)
+                {
+                    flush();
+                    _close();
+
+                    _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                    if (_fd == -1)
+                    {
+                        _fd = STDOUT_FILENO;
+                        throw report_file_error{ path };
+                    }
+
+                    _owned = true;
+                }
+
+                _buffered_writer & operator<<(const char * string)
+                {
+                    _buffer.append(string);
+                    return *this;
+                }
+
+                _buffered_writer & operator<<(const std::string & string)
+                {
+                    _buffer.append(string);
+                    return *this;
+                }
+
+                _buffered_writer & operator<<(char c)
+                {
+                    _buffer.push_back(c);
+                    return *this;
+                }
+
+                _buffered_writer & operator<<(std::uint64_t value)
+                {
+                    char digits[20];
+                    std::size_t count = 0;
+
+                    do
+                    {
+                        digits[count++] = '0' + value % 10;
+                        value /= 10;
+                    } while (value);
+
+                    while (count)
+                    {
+                        _buffer.push_back(digits[--count]);
+                    }
+
+                    return *this;
+                }
+
+                // with a fixed number of decimal places
+                void fixed(double value, int precision)
+                {
+                    char formatted[64];
+                    auto length = std::snprintf(formatted, sizeof(formatted), "%.*f", precision, value);
+                    _buffer.append(formatted, length > 0 ? std::min<std::size_t>(length, sizeof(formatted) - 1) : 0);
+                }
+
+                // to be called after every complete record; the buffer is only written out when it's half full
+                void end_record()
+                {
+                    if (_buffer.size() >= _capacity / 2)
+                    {
+                        flush();
+                    }
+                }
+
+                void flush()
+                {
+                    auto ptr = _buffer.data();
+                    auto left = _buffer.size();
+
+                    while (left)
+                    {
+                        auto written = ::write(_fd, ptr, left);
+                        if (written == -1 && errno == EINTR)
+                        {
+                            continue;
+                        }
+
+                        if (written <= 0)
+                        {
+                            break;
+                        }
+
+                        ptr += written;
+                        left -= written;
+                    }
+
+                    _buffer.clear();
+                }
+
+            private:
+                void _close()
+                {
+                    if (_owned)
+                    {
+                        ::close(_fd);
+                        _fd = STDOUT_FILENO;
+                        _owned = false;
+                    }
+                }
+
+                std::size_t _capacity;
+                std::string _buffer;
+                int _fd = STDOUT_FILENO;
+                bool _owned = false;
+            };
+
+            inline const char * _status_name(testcase_status status)
+            {
+                switch (status)
+                {
+                    case testcase_status::passed:
+                        return "passed";
+                    case testcase_status::failed:
+                        return "failed";
+                    case testcase_status::crashed:
+                        return "crashed";
+                    case testcase_status::timed_out:
+                        return "timed out";
+                    case testcase_status::not_found:
+                        return "not found";
+                    case testcase_status::regressed:
+                        return "regressed";
+                    case testcase_status::leaked:
+                        return "leaked";
+                    case testcase_status::data_race:
+                        return "data race";
+                    case testcase_status::memory_error:
+                        return "memory error";
+                    case testcase_status::undefined_behavior:
+                        return "undefined behavior";
+                    default:
+                        throw invalid_testcase_status{};
+                }
+            }
+        }
+
+        // a reporter that writes a machine readable report to a file, selected with `-r name:path`, or to stdout without a path
+        class file_reporter : public reporter
+        {
+        public:
+            void open(const std::string & path)
+            {
+                _out.open(path);
+            }
+
+        protected:
+            // the path of the innermost suite being reported, with `/` between the names of the suites
+            void _enter(const suite & s) const
+            {
+                _path_lengths.push_back(_path.size());
+                if (!_path.empty())
+                {
+                    _path.push_back('/');
+                }
+                _path.append(s.name());
+            }
+
+            void _leave() const
+            {
+                _path.resize(_path_lengths.back());
+                _path_lengths.pop_back();
+            }
+
+            // reporters are only ever called from the runner's reporting thread
+            mutable _detail::_buffered_writer _out;
+            mutable std::string _path;
+            mutable std::vector<std::size_t> _path_lengths;
+        };
+    }}
+}
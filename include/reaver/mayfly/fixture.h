@@ -0,0 +1,166 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <exception>
+
+#include <unistd.h>
+
+#include "suite.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        namespace _detail
+        {
+            class _fixture_base
+            {
+            public:
+                virtual ~_fixture_base() = default;
+
+                // creates the shared state, if it doesn't exist in this process yet; a failure isn't thrown from here, but from
+                // every later use of the fixture
+                virtual void prepare() = 0;
+            };
+
+            // the fork server prepares these in the zygote before it forks a testcase, so that every child shares their pages
+            // copy-on-write instead of building them again; the suites enclosing the testcase are prepared outermost first
+            inline void _prepare_fixtures(const _test_index & index, const _test_index::entry & entry)
+            {
+                std::vector<const suite *> chain;
+                for (auto s = entry.parent; s; s = index.parent(*s))
+                {
+                    chain.push_back(s);
+                }
+
+                for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+                {
+                    for (auto && f : (*it)->fixtures())
+                    {
+                        f->prepare();
+                    }
+                }
+            }
+        }
+
+        // state shared by all the testcases of a suite that run in the same process - created on first use, and then kept for
+        // as long as the process lives: once per process with subprocess isolation (where that's once per testcase), once per
+        // worker in batch mode, once for the whole run in-process, and once in the zygote of the fork server, before it forks
+        template<typename T>
+        class fixture : public _detail::_fixture_base
+        {
+        public:
+            template<typename F>
+            fixture(F setup) : _setup{ [setup]{ return std::make_unique<T>(setup()); } }
+            {
+            }
+
+            // registers the fixture in the default registry's suite with the given path; see MAYFLY_ADD_FIXTURE
+            template<typename F>
+            fixture(const std::string & suite_path, F setup) : fixture{ std::move(setup) }
+            {
+                try
+                {
+                    default_suite_registry().add_fixture(suite_path, *this);
+                }
+
+                catch (reaver::exception & e)
+                {
+                    e.print(reaver::logger::default_logger());
+                    std::exit(2);
+                }
+            }
+
+            // a child forked off the process that created the state only borrows its pages; tearing it down there would
+            // copy every one of them just to free it
+            ~fixture()
+            {
+                if (_value && ::getpid() != _owner)
+                {
+                    _value.release();
+                }
+            }
+
+            // the setup is attempted once per process; if it threw, every testcase using the fixture fails with what it threw
+            T & get()
+            {
+                _create();
+
+                if (_failure)
+                {
+                    std::rethrow_exception(_failure);
+                }
+
+                return *_value;
+            }
+
+            T & operator*()
+            {
+                return get();
+            }
+
+            T * operator->()
+            {
+                return &get();
+            }
+
+            virtual void prepare() override
+            {
+                _create();
+            }
+
+        private:
+            void _create()
+            {
+                std::call_once(_once, [&]
+                {
+                    try
+                    {
+                        _value = _setup();
+                        _owner = ::getpid();
+                    }
+
+                    catch (...)
+                    {
+                        _failure = std::current_exception();
+                    }
+                });
+            }
+
+            std::function<std::unique_ptr<T> ()> _setup;
+            std::once_flag _once;
+            std::unique_ptr<T> _value;
+            std::exception_ptr _failure;
+            pid_t _owner = 0;
+        };
+    }}
+}
+
+#define MAYFLY_ADD_FIXTURE(name, type, ...) \
+    namespace { static ::reaver::mayfly::fixture<type> name{ reaver_mayfly_suite_path, __VA_ARGS__ }; }
@@ -0,0 +1,188 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <boost/optional.hpp>
+
+#include "file_reporter.h"
+#include "benchmark.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        // newline-delimited JSON: an object for every finished test, and one with the summary at the end; times are in nanoseconds
+        class json_reporter : public file_reporter
+        {
+        public:
+            virtual void suite_started(const suite & s) const override
+            {
+                _enter(s);
+            }
+
+            virtual void suite_finished(const suite &) const override
+            {
+                _leave();
+            }
+
+            virtual void test_started(const testcase &) const override
+            {
+            }
+
+            virtual void benchmark_finished(const benchmark_result & b) const override
+            {
+                _benchmark = b;
+            }
+
+            virtual void test_finished(const testcase_result & result) const override
+            {
+                _out << "{\"suite\":";
+                _string(_path);
+                _out << ",\"name\":";
+                _string(result.name);
+                _out << ",\"status\":\"" << _detail::_status_name(result.status) << "\",\"duration\":" << static_cast<std::uint64_t>(result.duration.count())
+                    << ",\"assertions\":" << static_cast<std::uint64_t>(result.assertions);
+
+                if (!result.description.empty())
+                {
+                    _out << ",\"description\":";
+                    _description_string(result.description);
+                }
+
+                if (result.usage.peak_rss)
+                {
+                    _out << ",\"usage\":{\"user_time\":" << static_cast<std::uint64_t>(result.usage.user_time.count())
+                        << ",\"system_time\":" << static_cast<std::uint64_t>(result.usage.system_time.count())
+                        << ",\"peak_rss_kb\":" << static_cast<std::uint64_t>(result.usage.peak_rss)
+                        << ",\"minor_faults\":" << static_cast<std::uint64_t>(result.usage.minor_faults)
+                        << ",\"major_faults\":" << static_cast<std::uint64_t>(result.usage.major_faults) << '}';
+                }
+
+                if (!result.counters.empty())
+                {
+                    _out << ",\"counters\":{";
+                    for (auto && counter : result.counters)
+                    {
+                        if (&counter != &result.counters.front())
+                        {
+                            _out << ',';
+                        }
+
+                        _string(counter.first);
+                        _out << ':' << counter.second;
+                    }
+                    _out << '}';
+                }
+
+                if (_benchmark)
+                {
+                    auto time = [&](const char * name, std::chrono::duration<double, std::nano> value)
+                    {
+                        _out << ",\"" << name << "\":";
+                        _out.fixed(value.count(), 3);
+                    };
+
+                    _out << ",\"benchmark\":{\"iterations\":" << static_cast<std::uint64_t>(_benchmark->iterations) << ",\"samples\":"
+                        << static_cast<std::uint64_t>(_benchmark->samples);
+                    time("min", _benchmark->min);
+                    time("median", _benchmark->median);
+                    time("p99", _benchmark->p99);
+                    time("mean", _benchmark->mean);
+                    time("stddev", _benchmark->stddev);
+                    _out << '}';
+
+                    _benchmark = boost::none;
+                }
+
+                _out << "}\n";
+                _out.end_record();
+            }
+
+            virtual void summary(tests_summary summary) const override
+            {
+                _out << "{\"summary\":{\"total\":" << static_cast<std::uint64_t>(summary.total) << ",\"passed\":" << static_cast<std::uint64_t>(summary.passed)
+                    << ",\"failed\":" << static_cast<std::uint64_t>(summary.failed_tests.size()) << ",\"not_run\":" << static_cast<std::uint64_t>(summary.not_run) << ",\"time\":"
+                    << static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(summary.actual_time).count()) << "}}\n";
+                _out.flush();
+            }
+
+        private:
+            void _string(const std::string & string) const
+            {
+                _out << '"';
+                for (auto c : string)
+                {
+                    _char(c);
+                }
+                _out << '"';
+            }
+
+            // descriptions encode their line breaks as `|n`, for the text protocol; names and paths are never encoded, and keep theirs
+            void _description_string(const std::string & string) const
+            {
+                _out << '"';
+
+                for (std::size_t i = 0; i < string.size(); ++i)
+                {
+                    if (string[i] == '|' && i + 1 < string.size() && string[i + 1] == 'n')
+                    {
+                        _out << "\\n";
+                        ++i;
+                        continue;
+                    }
+
+                    _char(string[i]);
+                }
+
+                _out << '"';
+            }
+
+            void _char(char c) const
+            {
+                static constexpr char hex[] = "0123456789abcdef";
+
+                switch (c)
+                {
+                    case '"': _out << "\\\""; break;
+                    case '\\': _out << "\\\\"; break;
+                    case '\n': _out << "\\n"; break;
+                    case '\t': _out << "\\t"; break;
+                    case '\r': _out << "\\r"; break;
+
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20)
+                        {
+                            _out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+                            break;
+                        }
+
+                        _out << c;
+                }
+            }
+
+            mutable boost::optional<benchmark_result> _benchmark;
+        };
+
+        MAYFLY_REPORTER_REGISTER("json", json_reporter)
+    }}
+}
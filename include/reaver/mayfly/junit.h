@@ -0,0 +1,234 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <boost/optional.hpp>
+
+#include "file_reporter.h"
+#include "benchmark.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        // every suite that directly contains tests becomes a flat <testsuite>, named with its full path, as most consumers of the
+        // format don't understand nested ones; elements are written as the results arrive, so no totals are given in attributes
+        class junit_reporter : public file_reporter
+        {
+        public:
+            virtual void suite_started(const suite & s) const override
+            {
+                if (!_started)
+                {
+                    _out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n";
+                    _started = true;
+                }
+
+                _close_suite();
+                _enter(s);
+            }
+
+            virtual void suite_finished(const suite &) const override
+            {
+                _close_suite();
+                _leave();
+            }
+
+            virtual void test_started(const testcase &) const override
+            {
+            }
+
+            virtual void benchmark_finished(const benchmark_result & b) const override
+            {
+                _benchmark = b;
+            }
+
+            virtual void test_finished(const testcase_result & result) const override
+            {
+                if (!_suite_open)
+                {
+                    _out << "  <testsuite name=\"";
+                    _escaped(_path);
+                    _out << "\">\n";
+                    _suite_open = true;
+                }
+
+                _out << "    <testcase classname=\"";
+                for (auto c : _path)
+                {
+                    _escaped_char(c == '/' ? '.' : c);
+                }
+                _out << "\" name=\"";
+                _escaped(result.name);
+                _out << "\" time=\"";
+                _out.fixed(std::chrono::duration<double>{ result.duration }.count(), 6);
+                _out << "\">\n";
+
+                _properties(result);
+
+                switch (result.status)
+                {
+                    case testcase_status::passed:
+                        break;
+
+                    case testcase_status::failed:
+                    case testcase_status::regressed:
+                        _out << "      <failure type=\"" << _detail::_status_name(result.status) << "\" message=\"";
+                        _escaped_description(result.description);
+                        _out << "\"/>\n";
+                        break;
+
+                    default:
+                        _out << "      <error type=\"" << _detail::_status_name(result.status) << "\" message=\"test " << _detail::_status_name(result.status);
+                        if (!result.description.empty())
+                        {
+                            _out << ": ";
+                            _escaped_description(result.description);
+                        }
+                        _out << "\"/>\n";
+                }
+
+                _out << "    </testcase>\n";
+                _out.end_record();
+            }
+
+            virtual void summary(tests_summary) const override
+            {
+                if (!_started)
+                {
+                    _out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n";
+                    _started = true;
+                }
+
+                _close_suite();
+                _out << "</testsuites>\n";
+                _out.flush();
+            }
+
+        private:
+            void _close_suite() const
+            {
+                if (_suite_open)
+                {
+                    _out << "  </testsuite>\n";
+                    _suite_open = false;
+                }
+            }
+
+            void _properties(const testcase_result & result) const
+            {
+                if (!result.usage.peak_rss && result.counters.empty() && !_benchmark)
+                {
+                    return;
+                }
+
+                auto property = [&](const char * name, auto && write)
+                {
+                    _out << "        <property name=\"" << name << "\" value=\"";
+                    write();
+                    _out << "\"/>\n";
+                };
+
+                auto integer = [&](const char * name, std::uint64_t value){ property(name, [&]{ _out << value; }); };
+                auto time = [&](const char * name, std::chrono::duration<double, std::nano> value){ property(name, [&]{ _out.fixed(value.count(), 0); }); };
+
+                _out << "      <properties>\n";
+
+                if (result.usage.peak_rss)
+                {
+                    time("user time (ns)", result.usage.user_time);
+                    time("system time (ns)", result.usage.system_time);
+                    integer("peak RSS (kB)", result.usage.peak_rss);
+                    integer("minor page faults", result.usage.minor_faults);
+                    integer("major page faults", result.usage.major_faults);
+                }
+
+                for (auto && counter : result.counters)
+                {
+                    property(counter.first.c_str(), [&]{ _out << counter.second; });
+                }
+
+                if (_benchmark)
+                {
+                    integer("benchmark iterations", _benchmark->iterations);
+                    integer("benchmark samples", _benchmark->samples);
+                    time("benchmark min (ns)", _benchmark->min);
+                    time("benchmark median (ns)", _benchmark->median);
+                    time("benchmark p99 (ns)", _benchmark->p99);
+                    time("benchmark stddev (ns)", _benchmark->stddev);
+                    _benchmark = boost::none;
+                }
+
+                _out << "      </properties>\n";
+            }
+
+            void _escaped(const std::string & string) const
+            {
+                for (auto c : string)
+                {
+                    _escaped_char(c);
+                }
+            }
+
+            // descriptions encode their line breaks as `|n`, for the text protocol; names and paths are never encoded, and keep theirs
+            void _escaped_description(const std::string & string) const
+            {
+                for (std::size_t i = 0; i < string.size(); ++i)
+                {
+                    if (string[i] == '|' && i + 1 < string.size() && string[i + 1] == 'n')
+                    {
+                        _out << "&#10;";
+                        ++i;
+                        continue;
+                    }
+
+                    _escaped_char(string[i]);
+                }
+            }
+
+            void _escaped_char(char c) const
+            {
+                switch (c)
+                {
+                    case '&': _out << "&amp;"; break;
+                    case '<': _out << "&lt;"; break;
+                    case '>': _out << "&gt;"; break;
+                    case '"': _out << "&quot;"; break;
+                    case '\'': _out << "&apos;"; break;
+                    case '\n': _out << "&#10;"; break;
+                    case '\t': _out << "&#9;"; break;
+
+                    default:
+                        // other control characters can't appear in XML 1.0 at all, not even escaped
+                        _out << (static_cast<unsigned char>(c) < 0x20 ? '?' : c);
+                }
+            }
+
+            mutable bool _started = false;
+            mutable bool _suite_open = false;
+            mutable boost::optional<benchmark_result> _benchmark;
+        };
+
+        MAYFLY_REPORTER_REGISTER("junit", junit_reporter)
+    }}
+}
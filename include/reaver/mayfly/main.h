@@ -24,6 +24,8 @@
 
 #include "../mayfly.h"
 #include "runner.h"
+#include "junit.h"
+#include "json.h"
 
 int main(int argc, char ** argv) try
 {
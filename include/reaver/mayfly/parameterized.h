@@ -0,0 +1,76 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <iterator>
+
+#include "testcase.h"
+#include "suite.h"
+
+namespace reaver
+{
+    namespace mayfly { inline namespace _v1
+    {
+        // `case_name` is called with an element of the range and its index, and returns what goes between the brackets
+        template<typename Range, typename F, typename Name>
+        testcase parameterized(std::string name, Range range, F body, Name case_name)
+        {
+            auto shared = std::make_shared<const Range>(std::move(range));
+
+            auto element = [shared](std::size_t index) -> decltype(auto)
+            {
+                return *std::next(std::begin(*shared), index);
+            };
+
+            auto cases = std::make_shared<_detail::_case_generator>();
+            cases->count = std::distance(std::begin(*shared), std::end(*shared));
+            cases->name = [=](std::size_t index)
+            {
+                return name + "[" + case_name(element(index), index) + "]";
+            };
+            cases->body = [=](std::size_t index)
+            {
+                body(element(index));
+            };
+
+            return { std::move(name), std::move(cases) };
+        }
+
+        // one testcase for every element of `range`, named `name[<index>]`; the range is kept as it is and indexed into for a case,
+        // so a random access one (a container, boost::irange) makes that constant time, and a lazy one is never expanded
+        template<typename Range, typename F>
+        testcase parameterized(std::string name, Range range, F body)
+        {
+            return parameterized(name, std::move(range), std::move(body), [](auto &&, std::size_t index){ return std::to_string(index); });
+        }
+    }}
+}
+
+#define MAYFLY_ADD_PARAMETERIZED_TESTCASE_TO(suite, name, ...)                                                               \
+    namespace { static ::reaver::mayfly::testcase_registrar MAYFLY_DETAIL_UNIQUE_NAME { suite, ::reaver::mayfly::parameterized( \
+        name, __VA_ARGS__) }; }
+
+#define MAYFLY_ADD_PARAMETERIZED_TESTCASE(name, ...) \
+    MAYFLY_ADD_PARAMETERIZED_TESTCASE_TO(reaver_mayfly_suite_path, name, __VA_ARGS__)
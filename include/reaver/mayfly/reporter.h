@@ -40,6 +40,7 @@ namespace reaver
         class suite;
         class testcase;
         struct testcase_result;
+        struct benchmark_result;
 
         enum class testcase_status;
 
@@ -49,6 +50,8 @@ namespace reaver
             std::uintmax_t passed;
             std::uintmax_t total;
             std::chrono::milliseconds actual_time;
+            // testcases cancelled before they ran, once the run was stopped by too many failures
+            std::uintmax_t not_run = 0;
         };
 
         class invalid_testcase_status : public exception
@@ -63,11 +66,18 @@ namespace reaver
         class reporter
         {
         public:
+            virtual ~reporter() {}
+
             virtual void suite_started(const suite &) const = 0;
             virtual void suite_finished(const suite &) const = 0;
             virtual void test_started(const testcase &) const = 0;
             virtual void test_finished(const testcase_result &) const = 0;
 
+            // called right before test_finished() of a benchmark that has passed; reporters that don't show measurements can ignore it
+            virtual void benchmark_finished(const benchmark_result &) const
+            {
+            }
+
             virtual void summary(tests_summary) const = 0;
 
             void lock() const
@@ -123,6 +133,14 @@ namespace reaver
                 }
             }
 
+            virtual void benchmark_finished(const benchmark_result & b) const override
+            {
+                for (const auto & r : _reporters)
+                {
+                    r.get().benchmark_finished(b);
+                }
+            }
+
             virtual void summary(tests_summary summary) const override
             {
                 for (const auto & r : _reporters)
@@ -22,28 +22,51 @@
 
 #pragma once
 
+#include <cstdint>
+#include <cmath>
 #include <vector>
+#include <unordered_set>
+#include <algorithm>
 #include <memory>
 #include <iostream>
 #include <chrono>
+#include <system_error>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
 
 #include <boost/process.hpp>
 #include <boost/process/initializers.hpp>
 #include <boost/program_options.hpp>
 #include <boost/iostreams/device/file_descriptor.hpp>
-#include <boost/iostreams/stream.hpp>
 #include <boost/algorithm/string.hpp>
-#include <boost/range/algorithm/search.hpp>
 #include <boost/optional.hpp>
 
-#include <reaver/thread_pool.h>
 #include <reaver/configuration/options.h>
 
 #include "reporter.h"
 #include "testcase.h"
 #include "suite.h"
 #include "console.h"
+#include "file_reporter.h"
 #include "subprocess.h"
+#include "detail/fork_server.h"
+#include "detail/scheduler.h"
+#include "detail/supervisor.h"
+#include "detail/report_queue.h"
+#include "detail/timings.h"
+#include "detail/baseline.h"
+#include "detail/affinity.h"
+#include "detail/usage.h"
+#include "detail/perf_counters.h"
+#include "detail/filter.h"
+#include "detail/result_cache.h"
+#include "detail/sanitizers.h"
+#include "detail/test_list.h"
+#include "detail/runner_stats.h"
+#include "benchmark.h"
+#include "fixture.h"
 
 namespace reaver
 {
@@ -72,261 +95,1238 @@ namespace reaver
 
             auto summary(const reporter & rep) const
             {
-                rep.summary({ _failed, _passed, _tests, _last_actual_time });
+                rep.summary({ _failed, _passed, _tests, _last_actual_time, _not_run });
+            }
+
+            // restricts the run to one of `count` disjoint parts of the test tree; every testcase lands in the same part on every
+            // machine, as long as its path doesn't change
+            void shard(std::size_t index, std::size_t count)
+            {
+                _shard_index = index;
+                _shard_count = count;
+            }
+
+            // only testcases whose paths match one of the filters (if any were given) are run; see _detail::_glob_match for the syntax,
+            // a `re:` prefix makes the pattern a regular expression instead
+            void filter(std::string pattern)
+            {
+                _filter.include(std::move(pattern));
+            }
+
+            // testcases matching any of the exclusions are never run, even if they also match a filter
+            void exclude(std::string pattern)
+            {
+                _filter.exclude(std::move(pattern));
+            }
+
+            // the last result of every testcase is kept in this file, for rerun_failed() and failed_first() to use in the next run
+            void result_cache(std::string path)
+            {
+                _result_cache_file = std::move(path);
+            }
+
+            // only the testcases that didn't pass the last time they were run (or have never been run) are run; when none
+            // of them failed, everything is
+            void rerun_failed(bool enable = true)
+            {
+                _rerun_failed = enable;
+            }
+
+            // the testcases that didn't pass the last time are run and reported before all the others
+            void failed_first(bool enable = true)
+            {
+                _failed_first = enable;
+            }
+
+            // once this many testcases have failed, the testcases that haven't started yet are never run and the running ones are stopped;
+            // 0 runs everything
+            void fail_fast(std::size_t failures = 1)
+            {
+                _max_failures = failures;
+            }
+
+            // pins every thread of the pool (and the processes it starts) to a CPU, or to a NUMA node, of its own; benchmarks then get
+            // a CPU that no worker runs on, when there's more than one
+            void pin_workers(worker_placement placement)
+            {
+                _placement = placement;
+            }
+
+            // how much of a resource testcases can hold at the same time; resources without a capacity are held by one testcase at a time;
+            // a capacity of 0 is rejected: demands are cut down to the capacity, so it would let every testcase using the resource run at once
+            void resource_capacity(std::string name, std::uint64_t amount)
+            {
+                if (!amount)
+                {
+                    throw invalid_resource_capacity{ name + "=0" };
+                }
+
+                _resource_capacities[std::move(name)] = amount;
+            }
+
+            // durations are read from this file before the run and written back after it; they order the submission of the tests
+            // (longest first) and weigh the shards
+            void timing_history(std::string path)
+            {
+                _timing_file = std::move(path);
+            }
+
+            // testcases (and benchmarks) that take longer than they did in the baseline by more than `threshold` (a fraction) are
+            // reported as regressed; see _detail::_regressed for what else counts
+            void baseline(std::string path, double threshold = 0.1)
+            {
+                _baseline_file = std::move(path);
+                _regression_threshold = threshold;
+            }
+
+            // the measurements of this run are merged into this file after it
+            void save_baseline(std::string path)
+            {
+                _save_baseline_file = std::move(path);
+            }
+
+            // caps the output retained for every testcase at about `limit` bytes, from its beginning and its end; 0 keeps all of it
+            void output_limit(std::size_t limit)
+            {
+                _output_limit = limit;
+            }
+
+            // what the last run cost besides the testcases themselves
+            const _detail::_runner_stats & stats() const
+            {
+                return _stats;
             }
 
         protected:
-            std::size_t _threads = 1;
-            std::size_t _limit = 0;
-            std::size_t _timeout = 60;
+            // the plan is the flattened suite tree, in the order it is reported in; tests finish in any order,
+            // but reporting only ever advances the cursor over a prefix of the plan that has already completed
+            struct _plan_entry
+            {
+                enum class kinds { suite_started, test, suite_finished };
+
+                kinds kind;
+                const suite * parent;
+                const testcase * test;
+                std::string path;
+                // the testcase's id in a _detail::_test_index of the same tree
+                std::size_t id;
+                bool done;
+                bool in_process;
+                testcase_result result;
+                _detail::_output_capture output;
+                boost::optional<benchmark_result> benchmark;
+                // owns `test`, when it's a case of a parameterized testcase
+                std::shared_ptr<const testcase> instance;
+                // of the testcase and of all the suites it's in
+                _detail::_resource_demand resources;
+            };
+
+            struct _report_event
+            {
+                _plan_entry * entry;
+                bool started;
+            };
 
-            boost::optional<std::string> _test_name;
+            // runs a testcase on the calling thread; `who` selects what its resource usage is taken from - the thread, when other
+            // testcases may be running in the same process, or the whole process, when a child only exists to run this one
+            static testcase_result _invoke(const testcase & t)
+            {
+                return _invoke(t, [&]{ t(); });
+            }
 
-            std::atomic<std::uintmax_t> _tests{};
-            std::atomic<std::uintmax_t> _passed{};
+            template<typename F>
+            static testcase_result _invoke(const testcase & t, F && body, int who = RUSAGE_THREAD)
+            {
+                testcase_result result;
+                result.name = t.name();
+                result.status = testcase_status::passed;
 
-            std::vector<std::pair<testcase_status, std::string>> _failed;
-            std::chrono::milliseconds _last_actual_time;
-        };
+                _detail::_usage_meter meter{ who };
+                _detail::_perf_meter counters{ _detail::_perf_counter_selection() };
+                auto begin = std::chrono::steady_clock::now();
 
-        class subprocess_runner : public runner
-        {
-        public:
-            subprocess_runner(std::string executable, std::size_t threads = 1, std::size_t timeout = 60, boost::optional<std::string> test_name = {}) : runner{ threads, timeout, std::move(test_name) },
-                _executable{ std::move(executable) }
+                try
+                {
+                    body();
+                }
+
+                catch (assertions_failed & e)
+                {
+                    result.status = testcase_status::failed;
+                    result.description = e.what();
+                    result.assertions = e.count();
+                }
+
+                catch (reaver::exception & e)
+                {
+                    std::ostringstream str;
+
+                    {
+                        reaver::logger::logger l{};
+                        l.add_stream(str);
+                        e.print(l);
+                    }
+
+                    result.status = testcase_status::failed;
+                    result.description = str.str();
+                }
+
+                catch (std::exception & e)
+                {
+                    result.status = testcase_status::failed;
+                    result.description = e.what();
+                }
+
+                // in a child process, this would have been a crash; on one of the runner's threads (an in-process testcase or a benchmark),
+                // it would end the whole run
+                catch (...)
+                {
+                    result.status = testcase_status::failed;
+                    result.description = "unknown exception thrown";
+                }
+
+                result.duration = std::chrono::steady_clock::now() - begin;
+                result.counters = counters();
+                result.usage = meter();
+                return result;
+            }
+
+            // executes a single testcase of the plan, on one of the scheduler's threads; anything the testcase printed (and that
+            // the implementation captured) goes to `output`, to be logged when the result is reported
+            virtual testcase_result _execute(const _plan_entry & entry, _detail::_output_capture & output) const = 0;
+
+            // which of the selected testcases the current pass over the tree runs; there are two passes with failed_first()
+            enum class _pass
+            {
+                all,
+                failed,
+                rest
+            };
+
+            // runs the selected part of the tree and reports everything in tree order - once, or with failed_first() twice,
+            // the previously failed testcases first
+            void _run_plan(const std::vector<suite> & suites, const reporter & rep)
             {
+                _load_results(suites);
+                _load_history(suites);
+                _load_baselines();
+
+                _failures = 0;
+                _cancelled = false;
+                _stats.reset();
+
+                auto start = std::chrono::steady_clock::now();
+
+                if (_failed_first && _has_failures)
+                {
+                    _run_pass(suites, rep, _pass::failed);
+                    _run_pass(suites, rep, _pass::rest);
+                }
+
+                else
+                {
+                    _run_pass(suites, rep, _pass::all);
+                }
+
+                _stats.run = std::chrono::steady_clock::now() - start;
+                _stats.peak_rss = _detail::_peak_rss();
+                _last_actual_time = std::chrono::duration_cast<std::chrono::milliseconds>(_stats.run);
+
+                _save_history();
+                _save_baselines();
+                _save_results();
             }
 
-            virtual void operator()(const std::vector<suite> & suites, const reporter & rep) override
+            // plans one pass over the tree, runs it on a single pool and reports it in tree order
+            void _run_pass(const std::vector<suite> & suites, const reporter & rep, _pass pass)
             {
-                if (_test_name)
+                _plan.clear();
+                _cursor = 0;
+                _current_pass = pass;
+
+                std::size_t next_id = 0;
+                for (const auto & s : suites)
                 {
-                    std::vector<std::string> suite_names;
-                    boost::algorithm::split(suite_names, *_test_name, boost::is_any_of("/"));
-                    testcase_result result;
-                    result.status = testcase_status::passed;
-                    result.name = std::move(suite_names.back());
-                    suite_names.pop_back();
+                    _plan_suite(s, {}, false, {}, next_id);
+                }
+
+                std::vector<_plan_entry *> submission;
+                std::vector<_plan_entry *> benchmarks;
+                for (auto & entry : _plan)
+                {
+                    if (entry.kind == _plan_entry::kinds::test)
+                    {
+                        (entry.test->is_benchmark() ? benchmarks : submission).push_back(&entry);
+                    }
+                }
 
-                    boost::optional<const testcase &> t;
+                // tests can only be reported as started when they start if they also finish in the order of the plan
+                _live_start = _threads == 1 && benchmarks.empty();
+
+                // a long test submitted last would finish alone, long after the rest of the pool went idle
+                if (_timing_file && _threads != 1)
+                {
+                    // the keys are looked up once per testcase; most of the comparisons would otherwise be two map lookups
+                    auto mean = _detail::_mean_duration(_timings);
 
-                    try
+                    std::vector<std::pair<std::chrono::milliseconds, _plan_entry *>> keyed;
+                    keyed.reserve(submission.size());
+                    for (auto entry_ptr : submission)
                     {
-                        auto ref = std::ref(*boost::range::find_if(suites, [&](const suite & s){ return s.name() == suite_names.front(); }));
-                        suite_names.erase(suite_names.begin());
-                        for (auto && s : suite_names)
+                        keyed.emplace_back(_detail::_expected_duration(_timings, entry_ptr->path, mean), entry_ptr);
+                    }
+
+                    std::stable_sort(keyed.begin(), keyed.end(), [](auto && lhs, auto && rhs){ return lhs.first > rhs.first; });
+
+                    for (std::size_t i = 0; i < keyed.size(); ++i)
+                    {
+                        submission[i] = keyed[i].second;
+                    }
+                }
+
+                _report_completed(rep);
+
+                // everything the reporters do happens on this thread; the threads running the tests only hand their entries over,
+                // so they never wait for the terminal or a file, and the entries need no lock - a worker is done with one once it's pushed
+                _detail::_reporting_thread<_report_event> events{ [&](_report_event & event)
+                {
+                    auto begin = std::chrono::steady_clock::now();
+
+                    if (event.started)
+                    {
+                        rep.test_started(*event.entry->test);
+                    }
+
+                    else
+                    {
+                        _complete(*event.entry);
+                        _report_completed(rep);
+                        ++_stats.reported;
+                    }
+
+                    _stats.reporting += std::chrono::steady_clock::now() - begin;
+                } };
+
+                {
+                    _detail::_scheduler scheduler{ _threads, _detail::_resource_pool{ _resource_capacities },
+                        _detail::_worker_placement(_threads, _placement, benchmarks.empty() ? -1 : _detail::_last_allowed_cpu()) };
+
+                    for (auto entry_ptr : submission)
+                    {
+                        auto & entry = *entry_ptr;
+
+                        scheduler.push([&]()
+                        {
+                            if (_cancelled)
+                            {
+                                entry.result.status = testcase_status::not_started;
+                                events.push({ &entry, false });
+                                return;
+                            }
+
+                            if (_live_start)
+                            {
+                                events.push({ &entry, true });
+                            }
+
+                            _detail::_output_capture output{ _output_limit };
+                            auto begin = std::chrono::steady_clock::now();
+                            entry.result = _execute(entry, output);
+                            _stats.executed_test(std::chrono::steady_clock::now() - begin, entry.result.duration);
+                            entry.output = std::move(output);
+
+                            _count_failure(entry.result);
+
+                            events.push({ &entry, false });
+                        }, entry.resources);
+                    }
+
+                    scheduler.wait();
+                }
+
+                _run_benchmarks(benchmarks, events);
+
+                events.finish();
+            }
+
+            // benchmarks run one after another once the pool is gone, on this thread pinned to a single CPU, so that nothing else
+            // the runner does competes with them; they're never isolated in a child process
+            void _run_benchmarks(const std::vector<_plan_entry *> & benchmarks, _detail::_reporting_thread<_report_event> & events)
+            {
+                if (benchmarks.empty())
+                {
+                    return;
+                }
+
+                _detail::_affinity_scope pin{ _detail::_last_allowed_cpu() };
+
+                for (auto entry_ptr : benchmarks)
+                {
+                    auto & entry = *entry_ptr;
+
+                    if (_cancelled)
+                    {
+                        entry.result.status = testcase_status::not_started;
+                        events.push({ &entry, false });
+                        continue;
+                    }
+
+                    boost::optional<benchmark_result> measured;
+                    entry.result = _invoke(*entry.test, [&]{ measured = _detail::_measure(*entry.test); });
+                    entry.benchmark = std::move(measured);
+
+                    _count_failure(entry.result);
+
+                    events.push({ &entry, false });
+                }
+            }
+
+            // called on the reporting thread, which is the only one that touches the histories and the cursor
+            void _complete(_plan_entry & entry)
+            {
+                _record_duration(entry.path, entry.result);
+                _record_result(entry.path, entry.result);
+
+                if (entry.benchmark)
+                {
+                    _compare_to_baseline(entry.path, entry.result, { entry.benchmark->median,
+                        _detail::_median_error(entry.benchmark->stddev, entry.benchmark->samples) });
+                }
+
+                else
+                {
+                    _compare_to_baseline(entry.path, entry.result, { entry.result.duration, {} });
+                }
+
+                // the thread that ran the testcase counted it as passed; a regression is only known here, and counts towards --fail-fast too
+                if (entry.result.status == testcase_status::regressed)
+                {
+                    _count_failure(entry.result);
+                }
+
+                entry.done = true;
+            }
+
+            // returns whether any testcase of the suite has been selected; suites without any are left out of the plan entirely
+            bool _plan_suite(const suite & s, const std::string & parent_path, bool in_process, _detail::_resource_demand resources, std::size_t & next_id)
+            {
+                auto path = parent_path.empty() ? s.name() : parent_path + "/" + s.name();
+
+                // the ids still have to be handed out, so that they stay those of the index
+                if (!_filter.may_contain(path))
+                {
+                    next_id += _count_tests(s);
+                    return false;
+                }
+
+                auto begin = _plan.size();
+                bool selected = false;
+
+                // a suite marked as in-process takes all of its sub-suites with it, and so do the resources of a suite
+                in_process = in_process || s.in_process();
+                resources.merge(s.resources());
+
+                _plan.push_back({ _plan_entry::kinds::suite_started, &s, nullptr, {}, 0, true, in_process });
+
+                for (const auto & sub : s.suites())
+                {
+                    selected = _plan_suite(sub, path, in_process, resources, next_id) || selected;
+                }
+
+                for (const auto & test : s)
+                {
+                    // every case of a parameterized testcase is planned (and scheduled) on its own; only the selected ones are ever created
+                    for (std::size_t i = 0; i < test.cases(); ++i)
+                    {
+                        auto id = next_id++;
+                        auto test_path = path + "/" + test.case_name(i);
+                        if (!_selected(test_path))
                         {
-                            ref = std::ref(ref.get()[s]);
+                            continue;
                         }
-                        auto it = std::find_if(ref.get().begin(), ref.get().end(), [&](const testcase & tc){ return tc.name() == result.name; });
-                        if (it == ref.get().end())
+
+                        _plan.push_back({ _plan_entry::kinds::test, &s, &test, std::move(test_path), id, false, in_process });
+                        if (test.is_parameterized())
                         {
-                            return;
+                            _plan.back().instance = std::make_shared<const testcase>(test.instance(i));
+                            _plan.back().test = _plan.back().instance.get();
                         }
-                        t = *it;
+
+                        _plan.back().resources = resources;
+                        _plan.back().resources.merge(test.resources());
+
+                        ++_tests;
+                        selected = true;
                     }
+                }
 
-                    catch (...)
+                if (!selected)
+                {
+                    _plan.resize(begin);
+                    return false;
+                }
+
+                _plan.push_back({ _plan_entry::kinds::suite_finished, &s, nullptr, {}, 0, true, in_process });
+                return true;
+            }
+
+            void _report_completed(const reporter & rep)
+            {
+                for (; _cursor < _plan.size(); ++_cursor)
+                {
+                    auto & entry = _plan[_cursor];
+
+                    switch (entry.kind)
                     {
-                        return;
+                        case _plan_entry::kinds::suite_started:
+                            rep.suite_started(*entry.parent);
+                            break;
+
+                        case _plan_entry::kinds::suite_finished:
+                            rep.suite_finished(*entry.parent);
+                            break;
+
+                        case _plan_entry::kinds::test:
+                            if (!entry.done)
+                            {
+                                return;
+                            }
+
+                            // cancelled before it got to run; it's left out of the report, and only counted in the summary
+                            if (entry.result.status == testcase_status::not_started)
+                            {
+                                --_tests;
+                                ++_not_run;
+                                break;
+                            }
+
+                            if (!_live_start)
+                            {
+                                rep.test_started(*entry.test);
+                            }
+
+                            entry.output.for_each_line([](const char * line, std::size_t length)
+                            {
+                                logger::dlog() << std::string{ line, length };
+                            });
+
+                            if (entry.benchmark && entry.result.status == testcase_status::passed)
+                            {
+                                rep.benchmark_finished(*entry.benchmark);
+                            }
+                            rep.test_finished(entry.result);
+
+                            if (entry.result.status == testcase_status::passed)
+                            {
+                                ++_passed;
+                            }
+
+                            else
+                            {
+                                _failed.push_back(std::make_pair(entry.result.status, entry.path));
+                            }
+
+                            entry.output.clear();
                     }
+                }
+            }
 
-                    rep.test_started(*t);
-                    auto begin = std::chrono::high_resolution_clock::now();
+            // called on the threads running the testcases, as soon as a result is known, so that nothing waits for the reporting to catch up;
+            // and on the reporting thread for regressions, which are only decided there
+            void _count_failure(const testcase_result & result)
+            {
+                if (_max_failures && result.status != testcase_status::passed && result.status != testcase_status::not_started
+                    && ++_failures >= _max_failures && !_cancelled.exchange(true))
+                {
+                    _cancel_running();
+                }
+            }
 
-                    try
+            // stops the testcases that are running when the run gets cancelled; their results must come out as not_started
+            virtual void _cancel_running() const
+            {
+            }
+
+            // the executable a testcase comes from, by its path; the testcases of different executables share the default cache file
+            virtual const std::string & _executable_of(const std::string &) const
+            {
+                return _detail::_self_executable();
+            }
+
+            void _load_results(const std::vector<suite> & suites)
+            {
+                _previous_results = {};
+                _results = {};
+                _has_failures = false;
+
+                if (!_result_cache_file)
+                {
+                    return;
+                }
+
+                _previous_results = _detail::_load_result_cache(*_result_cache_file);
+                _results = _previous_results;
+
+                // only the failures of this tree count; the entries of other executables are kept, but say nothing about it
+                for (auto && s : suites)
+                {
+                    if (_has_cached_failures(s, {}))
                     {
-                        (*t)();
+                        _has_failures = true;
+                        break;
                     }
+                }
+            }
+
+            bool _has_cached_failures(const suite & s, const std::string & parent_path) const
+            {
+                auto path = parent_path.empty() ? s.name() : parent_path + "/" + s.name();
 
-                    catch (reaver::exception & e)
+                for (const auto & sub : s.suites())
+                {
+                    if (_has_cached_failures(sub, path))
                     {
-                        std::ostringstream str;
+                        return true;
+                    }
+                }
 
+                for (const auto & test : s)
+                {
+                    for (std::size_t i = 0; i < test.cases(); ++i)
+                    {
+                        auto test_path = path + "/" + test.case_name(i);
+                        auto it = _previous_results.find({ _executable_of(test_path), test_path });
+                        if (it != _previous_results.end() && it->second.status != testcase_status::passed)
                         {
-                            reaver::logger::logger l{};
-                            l.add_stream(str);
-                            e.print(l);
+                            return true;
                         }
+                    }
+                }
+
+                return false;
+            }
+
+            // whether a result says anything about the testcase that's worth keeping for the next run; a testcase that wasn't found, or was
+            // cancelled (before it started or while it ran) never got to finish, and its duration and status are those of the cancellation
+            static bool _recordable(const testcase_result & result)
+            {
+                return result.status != testcase_status::not_found && result.status != testcase_status::not_started;
+            }
+
+            // testcases that weren't run this time keep their old entries
+            void _record_result(const std::string & path, const testcase_result & result)
+            {
+                if (_result_cache_file && _recordable(result))
+                {
+                    _results[{ _executable_of(path), path }] = { result.status };
+                }
+            }
+
+            void _save_results() const
+            {
+                if (_result_cache_file)
+                {
+                    _detail::_save_result_cache(*_result_cache_file, _results);
+                }
+            }
+
+            void _load_history(const std::vector<suite> & suites)
+            {
+                _weighted_selection = boost::none;
+
+                if (!_timing_file)
+                {
+                    return;
+                }
+
+                _timings = _detail::_load_timings(*_timing_file);
+
+                if (_shard_count > 1)
+                {
+                    std::vector<std::string> paths;
+                    for (auto && s : suites)
+                    {
+                        _collect_paths(s, {}, paths);
+                    }
+
+                    _weighted_selection = _detail::_weighted_shard(std::move(paths), _timings, _shard_index, _shard_count);
+                }
+            }
+
+            void _record_duration(const std::string & path, const testcase_result & result)
+            {
+                if (_timing_file && _recordable(result))
+                {
+                    _timings[path] = std::chrono::duration_cast<std::chrono::milliseconds>(result.duration);
+                }
+            }
+
+            void _save_history() const
+            {
+                if (_timing_file)
+                {
+                    _detail::_save_timings(*_timing_file, _timings);
+                }
+            }
+
+            void _load_baselines()
+            {
+                _baseline = {};
+                _new_baseline = {};
+
+                if (_baseline_file)
+                {
+                    _baseline = _detail::_load_baseline(*_baseline_file);
+                }
+
+                // testcases that weren't run this time (other shards, other filters) keep their old entries
+                if (_save_baseline_file)
+                {
+                    _new_baseline = _detail::_load_baseline(*_save_baseline_file);
+                }
+            }
+
+            void _compare_to_baseline(const std::string & path, testcase_result & result, _detail::_baseline_entry current)
+            {
+                if (result.status != testcase_status::passed)
+                {
+                    return;
+                }
 
-                        result.status = testcase_status::failed;
-                        result.description = str.str();
+                if (_save_baseline_file)
+                {
+                    _new_baseline[path] = current;
+                }
+
+                auto it = _baseline.find(path);
+                if (it == _baseline.end() || !_detail::_regressed(it->second, current, _regression_threshold))
+                {
+                    return;
+                }
+
+                auto format = [](std::chrono::duration<double, std::nano> d)
+                {
+                    if (d >= std::chrono::milliseconds{ 1 })
+                    {
+                        return std::to_string(static_cast<std::uintmax_t>(std::llround(std::chrono::duration<double, std::milli>{ d }.count()))) + "ms";
                     }
 
-                    catch (std::exception & e)
+                    return std::to_string(static_cast<std::uintmax_t>(std::llround(d.count()))) + "ns";
+                };
+
+                result.status = testcase_status::regressed;
+                result.description = "duration regressed from " + format(it->second.time) + " to " + format(current.time) + ", over the threshold of "
+                    + std::to_string(static_cast<std::uintmax_t>(std::llround(_regression_threshold * 100))) + "%.";
+            }
+
+            void _save_baselines() const
+            {
+                if (_save_baseline_file)
+                {
+                    _detail::_save_baseline(*_save_baseline_file, _new_baseline);
+                }
+            }
+
+            // only the filtered testcases are weighed, so that the shards are balanced over what is actually going to run
+            void _collect_paths(const suite & s, const std::string & parent_path, std::vector<std::string> & paths) const
+            {
+                auto path = parent_path.empty() ? s.name() : parent_path + "/" + s.name();
+                if (!_filter.may_contain(path))
+                {
+                    return;
+                }
+
+                for (const auto & sub : s.suites())
+                {
+                    _collect_paths(sub, path, paths);
+                }
+
+                for (const auto & test : s)
+                {
+                    for (std::size_t i = 0; i < test.cases(); ++i)
+                    {
+                        auto test_path = path + "/" + test.case_name(i);
+                        if (_wanted(test_path))
+                        {
+                            paths.push_back(std::move(test_path));
+                        }
+                    }
+                }
+            }
+
+            static std::size_t _count_tests(const suite & s)
+            {
+                std::size_t count = 0;
+                for (const auto & test : s)
+                {
+                    count += test.cases();
+                }
+
+                for (const auto & sub : s.suites())
+                {
+                    count += _count_tests(sub);
+                }
+
+                return count;
+            }
+
+            // what the filters and the result cache select, before the split into passes and shards
+            bool _wanted(const std::string & path) const
+            {
+                if (!_filter.matches(path))
+                {
+                    return false;
+                }
+
+                return !_rerun_failed || !_has_failures || _detail::_previously_failed(_previous_results, _executable_of(path), path);
+            }
+
+            bool _selected(const std::string & path) const
+            {
+                if (!_wanted(path))
+                {
+                    return false;
+                }
+
+                if (_current_pass != _pass::all && (_current_pass == _pass::failed) != _detail::_previously_failed(_previous_results, _executable_of(path), path))
+                {
+                    return false;
+                }
+
+                if (_shard_count <= 1)
+                {
+                    return true;
+                }
+
+                if (_weighted_selection)
+                {
+                    return _weighted_selection->count(path);
+                }
+
+                return _detail::_shard_of(path, _shard_count) == _shard_index;
+            }
+
+            std::size_t _threads = 1;
+            std::size_t _limit = 0;
+            std::size_t _timeout = 60;
+            std::size_t _shard_index = 0;
+            std::size_t _shard_count = 1;
+            std::size_t _output_limit = 0;
+
+            boost::optional<std::string> _test_name;
+            _detail::_test_filter _filter;
+            std::map<std::string, std::uint64_t> _resource_capacities;
+            worker_placement _placement = worker_placement::none;
+
+            boost::optional<std::string> _timing_file;
+            _detail::_timings _timings;
+            boost::optional<std::unordered_set<std::string>> _weighted_selection;
+
+            boost::optional<std::string> _baseline_file;
+            boost::optional<std::string> _save_baseline_file;
+            double _regression_threshold = 0.1;
+            _detail::_baseline _baseline;
+            _detail::_baseline _new_baseline;
+
+            boost::optional<std::string> _result_cache_file;
+            bool _rerun_failed = false;
+            bool _failed_first = false;
+            _detail::_result_cache _previous_results;
+            _detail::_result_cache _results;
+            bool _has_failures = false;
+            _pass _current_pass = _pass::all;
+
+            std::vector<_plan_entry> _plan;
+            std::size_t _cursor = 0;
+            bool _live_start = false;
+
+            std::atomic<std::uintmax_t> _tests{};
+            std::atomic<std::uintmax_t> _passed{};
+            std::uintmax_t _not_run = 0;
+
+            std::size_t _max_failures = 0;
+            std::atomic<std::size_t> _failures{};
+            std::atomic<bool> _cancelled{};
+
+            std::vector<std::pair<testcase_status, std::string>> _failed;
+            std::chrono::milliseconds _last_actual_time;
+
+            // also counted in the const _execute() of the implementations
+            mutable _detail::_runner_stats _stats;
+        };
+
+        enum class isolation_mode
+        {
+            subprocess,
+            fork_server,
+            batch
+        };
+
+        enum class result_protocol
+        {
+            text,
+            binary
+        };
+
+        class subprocess_runner : public runner
+        {
+        public:
+            subprocess_runner(std::string executable, std::size_t threads = 1, std::size_t timeout = 60, boost::optional<std::string> test_name = {},
+                isolation_mode isolation = isolation_mode::subprocess, result_protocol protocol = result_protocol::text) : runner{ threads, timeout, std::move(test_name) },
+                _executable{ std::move(executable) }, _isolation{ isolation }, _protocol{ protocol }
+            {
+            }
+
+            virtual void operator()(const std::vector<suite> & suites, const reporter & rep) override
+            {
+                // without an index handed over by the caller, one is built for this run only
+                std::unique_ptr<_detail::_test_index> own_index;
+                const auto & index = _index ? *_index : *(own_index = std::make_unique<_detail::_test_index>(suites));
+
+                if (_test_name)
+                {
+                    auto entry = index.resolve(*_test_name);
+                    if (!entry)
                     {
-                        result.status = testcase_status::failed;
-                        result.description = e.what();
+                        return;
                     }
 
+                    rep.test_started(*entry->test);
+                    auto result = _invoke(*entry->test, [&]{ (*entry->test)(); }, RUSAGE_SELF);
+
                     if (result.status == testcase_status::passed)
                     {
                         ++_passed;
                     }
                     ++_tests;
 
-                    result.duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - begin);
                     rep.test_finished(result);
 
                     return;
                 }
 
-                auto start = std::chrono::high_resolution_clock::now();
-                for (const auto & s : suites)
+                if (_isolation == isolation_mode::fork_server)
+                {
+                    _fork_server = std::make_unique<_detail::_fork_server>([&](const std::string & test_name)
+                    {
+                        run_child(suites, index, test_name);
+                    }, _protocol == result_protocol::binary, [&](const std::string & test_name)
+                    {
+                        if (auto entry = index.resolve(test_name))
+                        {
+                            _detail::_prepare_fixtures(index, *entry);
+                        }
+                    });
+                }
+
+                if (_isolation == isolation_mode::batch)
                 {
-                    _handle_suite(s, rep);
+                    // a worker may die between two requests; that is detected on its output, not through a signal
+                    ::signal(SIGPIPE, SIG_IGN);
                 }
-                _last_actual_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start);
+
+                _supervisor = std::make_unique<_detail::_supervisor>();
+
+                _run_plan(suites, rep);
+
+                _idle_workers.clear();
+                _supervisor.reset();
+                _fork_server.reset();
+            }
+
+            // the index of the tree the runner is called with; it is looked up in by the path of `test_name`, or by the id of
+            // testcases started by this runner, so it must describe exactly that tree
+            void index(const _detail::_test_index & index)
+            {
+                _index = &index;
+            }
+
+            // executes a single testcase in the current process, reporting through the subprocess protocol; `test_name` is
+            // either a full path or `#<id>`
+            static void run_child(const std::vector<suite> & suites, const _detail::_test_index & index, const std::string & test_name)
+            {
+                const auto & rep = *reporter_registry().at("subprocess");
+                subprocess_runner single{ {}, 1, 0, test_name };
+                single.index(index);
+                single(suites, rep);
+                single.summary(rep);
+            }
+
+        protected:
+            virtual void _cancel_running() const override
+            {
+                _supervisor->cancel();
+            }
+
+            // the executable a testcase of the plan is started from, and the name it's given there; the executable only matters in the
+            // subprocess isolation mode, the other ones keep the processes they start from the executable the runner was created with
+            virtual std::pair<std::string, std::string> _target(const _plan_entry & entry) const
+            {
+                return { _executable, "#" + std::to_string(entry.id) };
             }
 
         private:
             std::string _executable;
+            isolation_mode _isolation;
+            result_protocol _protocol;
+            std::unique_ptr<_detail::_fork_server> _fork_server;
+            std::unique_ptr<_detail::_supervisor> _supervisor;
+            const _detail::_test_index * _index = nullptr;
+
+            // a long-lived child started with `--worker`; it reads testcase names from its stdin and ends every one with `{{done}}`
+            struct _worker_process
+            {
+                _worker_process(boost::process::child child, int input, int output, int errors, int results) : child{ std::move(child) }, input{ input },
+                    output{ output }, errors{ errors }, results{ results }
+                {
+                }
+
+                ~_worker_process()
+                {
+                    // nobody reads stderr anymore; whatever the worker still writes there at exit must not block it
+                    ::close(input);
+                    ::close(errors);
+                    boost::process::wait_for_exit(child);
+                    ::close(output);
+
+                    if (results != -1)
+                    {
+                        ::close(results);
+                    }
+                }
+
+                bool send(const std::string & test_name)
+                {
+                    auto line = test_name + '\n';
+                    return ::write(input, line.data(), line.size()) == static_cast<ssize_t>(line.size());
+                }
+
+                boost::process::child child;
+                int input;
+                int output;
+                int errors;
+                int results;
+                _detail::_protocol_parser parser;
+            };
+
+            mutable std::mutex _workers_mutex;
+            mutable std::vector<std::unique_ptr<_worker_process>> _idle_workers;
 
-            void _handle_suite(const suite & s, const reporter & rep, std::vector<std::string> suite_stack = {})
+            static std::pair<int, int> _create_pipe()
             {
-                suite_stack.push_back(s.name());
-                if (_test_name && boost::range::search(*_test_name, boost::join(suite_stack, "/")) != _test_name->begin())
+                // the descriptors must not leak into other children, or a dead child's pipe would never report EOF
+                int fds[2];
+                if (::pipe2(fds, O_CLOEXEC) == -1)
                 {
-                    return;
+                    throw std::system_error{ errno, std::system_category() };
+                }
+
+                return { fds[0], fds[1] };
+            }
+
+            // with the binary protocol, the write end of a fresh pipe is handed to the child as `--result-fd`; the read end is returned
+            int _add_result_pipe(std::vector<std::string> & args, int & sink) const
+            {
+                if (_protocol != result_protocol::binary)
+                {
+                    return -1;
+                }
+
+                auto results = _create_pipe();
+                sink = results.second;
+
+                args.push_back("--result-fd");
+                args.push_back(std::to_string(_detail::_result_fd_number));
+
+                return results.first;
+            }
+
+            static void _add_perf_counters(std::vector<std::string> & args)
+            {
+                auto && selection = _detail::_perf_counter_selection();
+                if (!selection.empty())
+                {
+                    args.push_back("--perf-counters");
+                    args.push_back(boost::algorithm::join(selection, ","));
                 }
+            }
+
+            std::unique_ptr<_worker_process> _spawn_worker() const
+            {
+                using namespace boost::process::initializers;
+
+                std::vector<std::string> args{ _executable, "--worker", "-r", "subprocess" };
+                _add_perf_counters(args);
+
+                int results_sink = -1;
+                auto results = _add_result_pipe(args, results_sink);
+
+                auto input = _create_pipe();
+                auto output = _create_pipe();
+                auto errors = _create_pipe();
+
+                boost::iostreams::file_descriptor_source stdin_source{ input.first, boost::iostreams::close_handle };
+                boost::iostreams::file_descriptor_sink stdout_sink{ output.second, boost::iostreams::close_handle };
+                boost::iostreams::file_descriptor_sink stderr_sink{ errors.second, boost::iostreams::close_handle };
 
-                rep.suite_started(s);
+                auto child = boost::process::execute(set_args(args), inherit_env(), bind_stdin(stdin_source), bind_stdout(stdout_sink), bind_stderr(stderr_sink),
+                    on_exec_setup([=](auto &){ if (results_sink != -1) { _detail::_bind_result_fd(results_sink); } }));
+
+                if (results_sink != -1)
+                {
+                    ::close(results_sink);
+                }
+
+                return std::make_unique<_worker_process>(std::move(child), input.second, output.first, errors.first, results);
+            }
+
+            std::unique_ptr<_worker_process> _acquire_worker(const std::string & test_name) const
+            {
+                std::unique_ptr<_worker_process> worker;
 
-                for (const auto & sub : s.suites())
                 {
-                    _handle_suite(sub, rep, suite_stack);
+                    std::lock_guard<std::mutex> lock{ _workers_mutex };
+                    if (!_idle_workers.empty())
+                    {
+                        worker = std::move(_idle_workers.back());
+                        _idle_workers.pop_back();
+                    }
                 }
 
+                if (worker && worker->send(test_name))
                 {
-                    thread_pool pool(_threads);
-
-                    for (const auto & test : s)
-                    {
-                        if (_test_name && boost::join(suite_stack, "/") + "/" + test.name() != _test_name)
-                        {
-                            continue;
-                        }
-
-                        ++_tests;
+                    return worker;
+                }
 
-                        pool.push([=, &rep]()
-                        {
-                            auto result = _run_test(test, s, rep, suite_stack);
+                worker = _spawn_worker();
+                if (!worker->send(test_name))
+                {
+                    throw std::system_error{ errno, std::system_category() };
+                }
 
-                            if (result.status == testcase_status::passed)
-                            {
-                                ++_passed;
-                            }
+                return worker;
+            }
 
-                            else
-                            {
-                                _failed.push_back(std::make_pair(result.status, boost::join(suite_stack, "/") + "/" + test.name()));
-                            }
-                        });
-                    }
+            virtual testcase_result _execute(const _plan_entry & entry, _detail::_output_capture & output) const override
+            {
+                if (entry.in_process)
+                {
+                    return _invoke(*entry.test);
                 }
 
-                rep.suite_finished(s);
+                // children find the testcase by its id, without building or comparing any paths
+                auto target = _target(entry);
+                return _run_test(*entry.test, target.first, target.second, output);
             }
 
-            testcase_result _run_test(const testcase & t, const suite & s, const reporter & rep, const std::vector<std::string> & suite_stack) const
+            testcase_result _run_test(const testcase & t, const std::string & executable, const std::string & test_name, _detail::_output_capture & output) const
             {
                 testcase_result result;
                 result.name = t.name();
                 result.status = testcase_status::passed;
 
-                std::vector<std::string> output;
-
-                if (_threads == 1)
-                {
-                    rep.test_started(t);
-                }
-
                 using namespace boost::process::initializers;
 
-                std::vector<std::string> args{ _executable, "--test", boost::join(suite_stack, "/") + "/" + t.name(), "-r", "subprocess" };
+                pid_t pid = -1;
+                std::unique_ptr<_worker_process> worker;
+                int source_handle = -1;
+                int errors_handle = -1;
+                int results_handle = -1;
+                int pidfd = -1;
 
-                boost::process::pipe p = boost::process::create_pipe();
-                std::atomic<bool> timeout_flag{ false };
-                std::atomic<bool> finished_flag{ false };
-                std::mutex m;
-                std::condition_variable cv;
-                reaver::joining_thread th;
-
-                auto begin = std::chrono::high_resolution_clock::now();
+                auto begin = std::chrono::steady_clock::now();
 
+                if (_fork_server)
                 {
-                    boost::iostreams::file_descriptor_sink sink{ p.sink, boost::iostreams::close_handle };
-
-                    auto child = boost::process::execute(set_args(args), inherit_env(), bind_stdout(sink), close_stdin());
+                    auto spawned = _fork_server->spawn(test_name);
+                    pid = spawned.pid;
+                    source_handle = spawned.output;
+                    errors_handle = spawned.errors;
+                    results_handle = spawned.results;
+                    pidfd = spawned.pidfd;
+                }
 
-                    th = std::thread{ [&]()
-                    {
-                        std::unique_lock<std::mutex> lock{ m };
-                        if (!cv.wait_for(lock, std::chrono::seconds{ _timeout }, [&]() -> bool { return finished_flag; }))
-                        {
-                            timeout_flag = true;
-                            boost::process::terminate(child);
-                        }
-                    }};
+                else if (_isolation == isolation_mode::batch)
+                {
+                    worker = _acquire_worker(test_name);
+                    pid = worker->child.pid;
                 }
 
-                boost::iostreams::file_descriptor_source source{ p.source, boost::iostreams::close_handle };
-                boost::iostreams::stream<boost::iostreams::file_descriptor_source> is(source);
+                else
+                {
+                    std::vector<std::string> args{ executable, "--test-id", test_name.substr(1), "-r", "subprocess" };
+                    _add_perf_counters(args);
+
+                    int results_sink = -1;
+                    results_handle = _add_result_pipe(args, results_sink);
 
-                std::string message;
+                    auto p = _create_pipe();
+                    auto e = _create_pipe();
+                    boost::iostreams::file_descriptor_sink sink{ p.second, boost::iostreams::close_handle };
+                    boost::iostreams::file_descriptor_sink errors_sink{ e.second, boost::iostreams::close_handle };
 
-                enum { not_started, started, finished, exited } state = not_started;
+                    pid = boost::process::execute(set_args(args), inherit_env(), bind_stdout(sink), bind_stderr(errors_sink), close_stdin(),
+                        on_exec_setup([=](auto &){ if (results_sink != -1) { _detail::_bind_result_fd(results_sink); } })).pid;
+                    source_handle = p.first;
+                    errors_handle = e.first;
 
-                while (std::getline(is, message))
-                {
-                    if (message.substr(0, 2) == "{{")
+                    if (results_sink != -1)
                     {
-                        if (message == "{{started}}")
-                        {
-                            assert(state == not_started);
-                            state = started;
-                        }
+                        ::close(results_sink);
+                    }
+                }
 
-                        else if (message == "{{finished}}")
-                        {
-                            assert(state == started);
-                            state = finished;
-                        }
+                _stats.started_test(std::chrono::steady_clock::now() - begin);
 
-                        else if (message == "{{exit}}")
-                        {
-                            assert(state == finished);
-                            state = exited;
-                        }
+                // a direct child inherits the affinity of the thread that started it, but workers are shared by all the threads, and the
+                // children of the fork server are started by the zygote
+                if (_placement != worker_placement::none && (worker || _fork_server))
+                {
+                    _detail::_share_affinity(pid);
+                }
 
-                        else if (message.substr(0, 8) == "{{failed")
-                        {
-                            assert(state == started);
-                            result.status = testcase_status::failed;
-                            result.description = message.substr(9, message.length() - 11);
-                        }
+                _detail::_protocol_parser local_parser;
+                auto & parser = worker ? worker->parser : local_parser;
+                parser.reset();
+                parser.binary = _protocol == result_protocol::binary;
+                parser.output = _detail::_output_capture{ _output_limit };
 
-                        else if (message == "{{error unexpected test status}}")
-                        {
-                            throw unexpected_result{};
-                        }
+                // only children started directly are reaped here; workers are waited for when they're dropped, and the fork server reaps its own
+                auto watch = _supervisor->watch(pid, !worker && !_fork_server, std::chrono::seconds{ _timeout }, worker ? worker->output : source_handle,
+                    worker ? worker->errors : errors_handle, worker ? worker->results : results_handle, parser, pidfd);
+                auto outcome = _supervisor->wait(watch);
 
-                        else if (message == "{{error not found}}")
-                        {
-                            result.status = testcase_status::not_found;
-                        }
-                    }
+                if (!worker)
+                {
+                    ::close(source_handle);
+                    ::close(errors_handle);
 
-                    else
+                    if (results_handle != -1)
                     {
-                        output.push_back(std::move(message));
+                        ::close(results_handle);
                     }
                 }
 
-                if (state != exited)
+                if (parser.unexpected_status)
+                {
+                    throw unexpected_result{};
+                }
+
+                result.status = parser.status;
+                result.description = std::move(parser.description);
+                result.assertions = parser.assertions;
+                result.usage = parser.usage;
+                result.counters = std::move(parser.counters);
+                output = std::move(parser.output);
+
+                if (parser.state != _detail::_protocol_parser::exited)
                 {
-                    if (timeout_flag)
+                    if (outcome == _detail::_supervisor::outcome::cancelled)
+                    {
+                        result.status = testcase_status::not_started;
+                    }
+
+                    else if (outcome == _detail::_supervisor::outcome::timed_out)
                     {
                         result.status = testcase_status::timed_out;
                     }
@@ -337,40 +1337,48 @@ namespace reaver
                     }
                 }
 
-                try
+                // a sanitizer aborts the process on most of what it finds, and only makes it exit with an error code after finishing a passed
+                // testcase otherwise; neither says more than the report does
+                if (parser.sanitizer && (result.status == testcase_status::passed || result.status == testcase_status::crashed))
                 {
-                    finished_flag = true;
-                    cv.notify_all();
+                    result.status = parser.sanitizer.status;
+                    result.description = std::move(parser.sanitizer.description);
                 }
 
-                catch (...)
+                // a child that got to report on the testcase has measured the time of its body itself, without the cost of starting
+                // the process; otherwise all there is is the time it was running for, as seen from here
+                result.duration = parser.state >= _detail::_protocol_parser::finished ? parser.duration : std::chrono::steady_clock::now() - begin;
+
+                // a crashed or killed worker is dropped here, and so is one a sanitizer has reported on; the next test that needs one spawns
+                // a fresh process
+                if (worker && parser.state == _detail::_protocol_parser::exited && !parser.sanitizer)
                 {
+                    std::lock_guard<std::mutex> lock{ _workers_mutex };
+                    _idle_workers.push_back(std::move(worker));
                 }
 
-                auto duration = std::chrono::high_resolution_clock::now() - begin;
-                result.duration = std::chrono::duration_cast<std::chrono::milliseconds>(duration);
+                return result;
+            }
+        };
 
-                if (_threads != 1)
-                {
-                    std::unique_lock<const reporter> lock(rep);
-                    rep.test_started(t);
-                    for (auto && message : output)
-                    {
-                        logger::dlog() << message;
-                    }
-                    rep.test_finished(result);
-                }
+        // runs every testcase directly on the pool's threads; there is no isolation at all, so a crash takes the whole run down with it
+        // and timeouts can't be enforced - meant for suites of pure computations, where spawning a process costs far more than the test
+        class inprocess_runner : public runner
+        {
+        public:
+            inprocess_runner(std::size_t threads = 1) : runner{ threads }
+            {
+            }
 
-                else
-                {
-                    for (auto && message : output)
-                    {
-                        logger::dlog() << message;
-                    }
-                    rep.test_finished(result);
-                }
+            virtual void operator()(const std::vector<suite> & suites, const reporter & rep) override
+            {
+                _run_plan(suites, rep);
+            }
 
-                return result;
+        protected:
+            virtual testcase_result _execute(const _plan_entry & entry, _detail::_output_capture &) const override
+            {
+                return _invoke(*entry.test);
             }
         };
 
@@ -405,6 +1413,51 @@ namespace reaver
 
         constexpr static const char * version_string = "Reaver Project's Mayfly v0.1.2 alpha\nCopyright © 2014 Reaver Project Team\n";
 
+        class invalid_isolation_mode : public exception
+        {
+        public:
+            invalid_isolation_mode(const std::string & mode) : exception{ reaver::logger::error }
+            {
+                *this << "invalid isolation mode `" << mode << "` - available modes are `subprocess`, `fork-server` `batch` and `in-process`.";
+            }
+        };
+
+        class invalid_worker_placement : public exception
+        {
+        public:
+            invalid_worker_placement(const std::string & placement) : exception{ reaver::logger::error }
+            {
+                *this << "invalid worker placement `" << placement << "` - available placements are `none`, `cpu` and `numa`.";
+            }
+        };
+
+        class invalid_result_protocol : public exception
+        {
+        public:
+            invalid_result_protocol(const std::string & protocol) : exception{ reaver::logger::error }
+            {
+                *this << "invalid result protocol `" << protocol << "` - available protocols are `text` and `binary`.";
+            }
+        };
+
+        class invalid_shard : public exception
+        {
+        public:
+            invalid_shard(std::size_t index, std::size_t count) : exception{ reaver::logger::error }
+            {
+                *this << "invalid shard " << index << " of " << count << " - the shard index must be lower than a non-zero shard count.";
+            }
+        };
+
+        class invalid_reporter_path : public exception
+        {
+        public:
+            invalid_reporter_path(const std::string & name) : exception{ reaver::logger::error }
+            {
+                *this << "the reporter `" << name << "` doesn't write to a file - only a reporter's name can be given.";
+            }
+        };
+
         class invalid_testcase_name_format : public exception
         {
         public:
@@ -421,13 +1474,167 @@ namespace reaver
 
             new_opt_ext(tasks, std::size_t, opt_name_desc("tasks,j", "specify the amount of worker threads"); static constexpr type default_value = 1; );
             new_opt_desc(test, boost::optional<std::string>, "test,t", "specify the test to run");
-            new_opt_desc(reporter, std::vector<std::string>, "reporter,r", "select reporters to use");
+            new_opt_desc(test_id, boost::optional<std::size_t>, "test-id", "specify the test to run by its id (used by testcase processes)");
+            new_opt_desc(reporter, std::vector<std::string>, "reporter,r", "select reporters to use (`name:path` writes a file, for junit and json)");
+            new_opt_desc(filter, std::vector<std::string>, "filter,f", "run only the tests whose paths match one of these patterns (globs, or regular expressions prefixed with `re:`)");
+            new_opt_desc(exclude, std::vector<std::string>, "exclude,x", "never run the tests whose paths match one of these patterns");
+            new_opt_desc(resource, std::vector<std::string>, "resource", "set the amount of a resource tests can hold at the same time (`name=amount`, e.g. `gpu=2` or `mem=64G`)");
             new_opt_desc(quiet, void, "quiet,q", "disable reporters");
             new_opt_ext(timeout, std::size_t, opt_name_desc("timeout,l", "specify the timeout for tests (in seconds)"); static constexpr type default_value = 10; );
             new_opt_desc(error, void, "error,e", "only show errors and summary (controls console output)");
+            new_opt_desc(isolation, boost::optional<std::string>, "isolation", "select the testcase isolation mode (subprocess, fork-server, batch, in-process)");
+            new_opt_desc(worker, void, "worker", "run testcases named on the standard input (used by the batch isolation mode)");
+            new_opt_desc(protocol, boost::optional<std::string>, "protocol", "select the protocol testcase processes report results with (text, binary)");
+            new_opt_desc(pin, boost::optional<std::string>, "pin", "pin every worker thread and its testcase processes to a CPU or a NUMA node (none, cpu, numa)");
+            new_opt_desc(result_fd, boost::optional<int>, "result-fd", "write results in the binary protocol to this descriptor (used by testcase processes)");
+            new_opt_ext(shard_index, std::size_t, opt_name_desc("shard-index", "run only the part of the tests with this index (counted from 0)"); static constexpr type default_value = 0; );
+            new_opt_ext(shard_count, std::size_t, opt_name_desc("shard-count", "split the tests into this many disjoint parts"); static constexpr type default_value = 1; );
+            new_opt_desc(timing_file, boost::optional<std::string>, "timing-file", "read and update test durations in this file, to run the longest tests first and balance shards");
+            new_opt_ext(output_limit, std::size_t, opt_name_desc("output-limit", "keep only about this many bytes of the beginning and the end of the output of every test (0 keeps all)"); static constexpr type default_value = 0; );
+            new_opt_desc(perf_counters, boost::optional<std::string>, "perf-counters", "read these hardware counters around every test (cycles, instructions, cache-references, cache-misses, branches, branch-misses, task-clock, context-switches, cpu-migrations)");
+            new_opt_desc(result_cache, boost::optional<std::string>, "result-cache", "keep the last result of every test in this file (.mayfly-results by default, with --rerun-failed and --failed-first)");
+            new_opt_desc(rerun_failed, void, "rerun-failed", "run only the tests that didn't pass in the previous run (everything, if none failed)");
+            new_opt_desc(failed_first, void, "failed-first", "run the tests that didn't pass in the previous run before all the others");
+            new_opt_desc(fail_fast, void, "fail-fast", "stop the run after the first failed test");
+            new_opt_desc(max_failures, boost::optional<std::size_t>, "max-failures", "stop the run after this many failed tests");
+            new_opt_desc(baseline, boost::optional<std::string>, "baseline", "report tests and benchmarks slower than in this baseline file as regressed");
+            new_opt_desc(save_baseline, boost::optional<std::string>, "save-baseline", "write the durations of passed tests and benchmarks to this baseline file");
+            new_opt_desc(list_tests, void, "list-tests", "print the id, the suite, the name and the resources of every test, and exit (used by the mayfly driver)");
+            new_opt_desc(runner_stats, void, "runner-stats", "print what the runner itself cost (overhead per test, process start latency, reporting, peak RSS) after the run");
+            new_opt_desc(profile_startup, void, "profile-startup", "print how long registering and indexing the tests took before running them");
+            new_opt_ext(regression_threshold, std::size_t, opt_name_desc("regression-threshold", "the slowdown against the baseline, in percent, above which a test has regressed"); static constexpr type default_value = 10; );
         }
 
-        inline int run(const std::vector<suite> & suites, int argc, char ** argv)
+        namespace _detail
+        {
+            inline std::vector<std::reference_wrapper<const reporter>> _select_reporters(const std::vector<std::string> & reporters)
+            {
+                std::vector<std::reference_wrapper<const reporter>> reps;
+                for (const auto & elem : reporters)
+                {
+                    // `name:path` sends the report to a file, for the reporters that write one
+                    auto separator = elem.find(':');
+                    auto & rep = *reporter_registry().at(elem.substr(0, separator));
+
+                    if (separator != std::string::npos)
+                    {
+                        auto file = dynamic_cast<file_reporter *>(&rep);
+                        if (!file)
+                        {
+                            throw invalid_reporter_path{ elem.substr(0, separator) };
+                        }
+
+                        file->open(elem.substr(separator + 1));
+                    }
+
+                    reps.emplace_back(std::cref(rep));
+                }
+
+                return reps;
+            }
+
+            // the settings of a run that don't depend on how its testcases are executed; shared by run() and the driver
+            template<typename Parsed>
+            void _configure_runner(runner & r, const Parsed & parsed)
+            {
+                auto placement = worker_placement::none;
+                if (auto name = parsed.template get<options::pin>())
+                {
+                    if (*name == "cpu")
+                    {
+                        placement = worker_placement::cpu;
+                    }
+
+                    else if (*name == "numa")
+                    {
+                        placement = worker_placement::numa;
+                    }
+
+                    else if (*name != "none")
+                    {
+                        throw invalid_worker_placement{ *name };
+                    }
+                }
+
+                auto shard_index = parsed.template get<options::shard_index>();
+                auto shard_count = parsed.template get<options::shard_count>();
+                if (!shard_count || shard_index >= shard_count)
+                {
+                    throw invalid_shard{ shard_index, shard_count };
+                }
+
+                r.shard(shard_index, shard_count);
+                r.pin_workers(placement);
+                for (auto && pattern : parsed.template get<options::filter>())
+                {
+                    r.filter(pattern);
+                }
+                for (auto && pattern : parsed.template get<options::exclude>())
+                {
+                    r.exclude(pattern);
+                }
+                for (auto && capacity : parsed.template get<options::resource>())
+                {
+                    auto separator = capacity.find('=');
+                    std::uint64_t amount = 0;
+                    if (separator == 0 || separator == std::string::npos || !_detail::_parse_amount(capacity.substr(separator + 1), amount))
+                    {
+                        throw invalid_resource_capacity{ capacity };
+                    }
+
+                    r.resource_capacity(capacity.substr(0, separator), amount);
+                }
+                r.output_limit(parsed.template get<options::output_limit>());
+                if (auto timing_file = parsed.template get<options::timing_file>())
+                {
+                    r.timing_history(*timing_file);
+                }
+                if (auto failures = parsed.template get<options::max_failures>())
+                {
+                    r.fail_fast(*failures);
+                }
+                else if (parsed.template get<options::fail_fast>())
+                {
+                    r.fail_fast();
+                }
+                auto result_cache = parsed.template get<options::result_cache>();
+                if (!result_cache && (parsed.template get<options::rerun_failed>() || parsed.template get<options::failed_first>()))
+                {
+                    result_cache = std::string{ ".mayfly-results" };
+                }
+                if (result_cache)
+                {
+                    r.result_cache(*result_cache);
+                    r.rerun_failed(parsed.template get<options::rerun_failed>());
+                    r.failed_first(parsed.template get<options::failed_first>());
+                }
+                if (auto baseline = parsed.template get<options::baseline>())
+                {
+                    r.baseline(*baseline, parsed.template get<options::regression_threshold>() / 100.0);
+                }
+                if (auto save_baseline = parsed.template get<options::save_baseline>())
+                {
+                    r.save_baseline(*save_baseline);
+                }
+            }
+        }
+
+        namespace _detail
+        {
+            // what run() takes the tests from; each is only asked for when the options need it, so that a registry still holding
+            // only the records of its tests builds no more of them than that
+            struct _test_source
+            {
+                std::function<const std::vector<suite> & ()> suites;
+                std::function<const _test_index & ()> index;
+                // the index of a single testcase, for a child started with --test-id; none means the full index is used for it too
+                std::function<std::unique_ptr<_test_index> (std::size_t)> single;
+                // only known for a registry; without one, --profile-startup reports an empty registration
+                const _startup_profile * profile = nullptr;
+            };
+        }
+
+        inline int run(const _detail::_test_source & source, int argc, char ** argv)
         {
             std::string executable = argv[0];
 
@@ -442,15 +1649,39 @@ namespace reaver
             config.add_options()
                 ("tasks,j", boost::program_options::value<std::size_t>(), "specify the amount of worker threads")
                 ("test,t", boost::program_options::value<std::string>(), "specify the thread to run")
-                ("reporter,r", boost::program_options::value<std::vector<std::string>>()->composing(), "select a reporter to use")
+                ("reporter,r", boost::program_options::value<std::vector<std::string>>()->composing(), "select a reporter to use (`name:path` writes a file, for junit and json)")
+                ("filter,f", boost::program_options::value<std::vector<std::string>>()->composing(), "run only the tests whose paths match one of these patterns (globs, or regular expressions prefixed with `re:`)")
+                ("exclude,x", boost::program_options::value<std::vector<std::string>>()->composing(), "never run the tests whose paths match one of these patterns")
+                ("resource", boost::program_options::value<std::vector<std::string>>()->composing(), "set the amount of a resource tests can hold at the same time (`name=amount`, e.g. `gpu=2` or `mem=64G`)")
                 ("quiet,q", "disable reporters")
                 ("timeout,l", boost::program_options::value<std::size_t>(), "specify the timeout for tests (in seconds)")
-                ("error,e", "only show errors and summary (controls console output)");
+                ("error,e", "only show errors and summary (controls console output)")
+                ("isolation", boost::program_options::value<std::string>(), "select the testcase isolation mode (subprocess, fork-server, batch, in-process)")
+                ("pin", boost::program_options::value<std::string>(), "pin every worker thread and its testcase processes to a CPU or a NUMA node (none, cpu, numa)")
+                ("protocol", boost::program_options::value<std::string>(), "select the protocol testcase processes report results with (text, binary)")
+                ("shard-index", boost::program_options::value<std::size_t>(), "run only the part of the tests with this index (counted from 0)")
+                ("shard-count", boost::program_options::value<std::size_t>(), "split the tests into this many disjoint parts")
+                ("timing-file", boost::program_options::value<std::string>(), "read and update test durations in this file, to run the longest tests first and balance shards")
+                ("output-limit", boost::program_options::value<std::size_t>(), "keep only about this many bytes of the beginning and the end of the output of every test (0 keeps all)")
+                ("perf-counters", boost::program_options::value<std::string>(), "read these hardware counters around every test (cycles, instructions, cache-references, cache-misses, branches, branch-misses, task-clock, context-switches, cpu-migrations)")
+                ("result-cache", boost::program_options::value<std::string>(), "keep the last result of every test in this file (.mayfly-results by default, with --rerun-failed and --failed-first)")
+                ("rerun-failed", "run only the tests that didn't pass in the previous run (everything, if none failed)")
+                ("failed-first", "run the tests that didn't pass in the previous run before all the others")
+                ("fail-fast", "stop the run after the first failed test")
+                ("max-failures", boost::program_options::value<std::size_t>(), "stop the run after this many failed tests")
+                ("baseline", boost::program_options::value<std::string>(), "report tests and benchmarks slower than in this baseline file as regressed")
+                ("save-baseline", boost::program_options::value<std::string>(), "write the durations of passed tests and benchmarks to this baseline file")
+                ("regression-threshold", boost::program_options::value<std::size_t>(), "the slowdown against the baseline, in percent, above which a test has regressed")
+                ("profile-startup", "print how long registering and indexing the tests took before running them")
+                ("list-tests", "print the id, the suite, the name and the resources of every test, and exit (used by the mayfly driver)")
+                ("runner-stats", "print what the runner itself cost (overhead per test, process start latency, reporting, peak RSS) after the run");
 
             boost::program_options::options_description options;
             options.add(general).add(config);
 
-            auto parsed = reaver::options::parse_argv(argc, argv, tpl::vector<options::help, options::version, options::tasks, options::test, options::reporter, options::quiet, options::timeout, options::error>{});
+            auto parsed = reaver::options::parse_argv(argc, argv, tpl::vector<options::help, options::version, options::tasks, options::test, options::test_id, options::reporter, options::filter, options::exclude, options::resource, options::quiet, options::timeout, options::error, options::isolation, options::worker,
+                options::protocol, options::pin, options::result_fd, options::shard_index, options::shard_count,
+                options::timing_file, options::output_limit, options::perf_counters, options::result_cache, options::rerun_failed, options::failed_first, options::fail_fast, options::max_failures, options::baseline, options::save_baseline, options::regression_threshold, options::profile_startup, options::list_tests, options::runner_stats>{});
 
             if (parsed.get<options::help>())
             {
@@ -470,6 +1701,21 @@ namespace reaver
                 return 0;
             }
 
+            if (parsed.get<options::list_tests>())
+            {
+                _detail::_list_tests(std::cout, source.suites());
+                std::cout << std::flush;
+
+                return 0;
+            }
+
+            if (parsed.get<options::profile_startup>())
+            {
+                // the tree and the index are otherwise only built for the run, after this is printed
+                source.index();
+                _detail::_print_startup_profile(source.profile ? *source.profile : _detail::_startup_profile{});
+            }
+
             auto reporters = parsed.get<options::reporter>();
             if (reporters.empty() && !parsed.get<options::quiet>())
             {
@@ -481,14 +1727,52 @@ namespace reaver
                 reaver::logger::default_logger().set_level(reaver::logger::error);
             }
 
-            std::vector<std::reference_wrapper<const reporter>> reps;
-            for (const auto & elem : reporters)
+            auto reps = _detail::_select_reporters(reporters);
+
+            if (auto fd = parsed.get<options::result_fd>())
+            {
+                _detail::_result_fd() = *fd;
+            }
+
+            if (auto counters = parsed.get<options::perf_counters>())
+            {
+                auto && selection = _detail::_perf_counter_selection();
+                boost::algorithm::split(selection, *counters, boost::is_any_of(","));
+
+                for (auto && name : selection)
+                {
+                    _detail::_perf_counter(name);
+                }
+            }
+
+            if (parsed.get<options::worker>())
             {
-                reps.emplace_back(std::cref(*reporter_registry().at(elem)));
+                std::string test_name;
+                while (std::getline(std::cin, test_name))
+                {
+                    subprocess_runner::run_child(source.suites(), source.index(), test_name);
+                    _detail::_leak_check();
+
+                    if (_detail::_result_fd() != -1)
+                    {
+                        std::cout << std::flush;
+                        _detail::_write_frame(_detail::_frame_type::done);
+                        continue;
+                    }
+
+                    std::cout << "{{done}}" << std::endl;
+                }
+
+                return 0;
             }
 
             auto test_name = parsed.get<options::test>();
-            if (test_name && test_name->find('/') == std::string::npos)
+            if (auto id = parsed.get<options::test_id>())
+            {
+                test_name = "#" + std::to_string(*id);
+            }
+
+            else if (test_name && test_name->find('/') == std::string::npos)
             {
                 if (!parsed.get<options::quiet>())
                 {
@@ -502,10 +1786,79 @@ namespace reaver
                 }
             }
 
+            auto isolation = isolation_mode::subprocess;
+            bool in_process = false;
+            if (auto mode = parsed.get<options::isolation>())
+            {
+                if (*mode == "in-process")
+                {
+                    in_process = true;
+                }
+
+                else if (*mode == "fork-server")
+                {
+                    isolation = isolation_mode::fork_server;
+                }
+
+                else if (*mode == "batch")
+                {
+                    isolation = isolation_mode::batch;
+                }
+
+                else if (*mode != "subprocess")
+                {
+                    throw invalid_isolation_mode{ *mode };
+                }
+            }
+
+            auto protocol = result_protocol::text;
+            if (auto name = parsed.get<options::protocol>())
+            {
+                if (*name == "binary")
+                {
+                    protocol = result_protocol::binary;
+                }
+
+                else if (*name != "text")
+                {
+                    throw invalid_result_protocol{ *name };
+                }
+            }
+
             auto && reporter = combine(reps);
-            default_runner(std::make_unique<subprocess_runner>(executable, parsed.get<options::tasks>(), parsed.get<options::timeout>(), test_name))(suites, reporter);
+
+            // a child started for a single testcase by its id runs it off an index of just that testcase, and never gets the tree
+            std::unique_ptr<_detail::_test_index> single;
+            const std::vector<suite> no_suites;
+            auto id = parsed.get<options::test_id>();
+            if (id && source.single)
+            {
+                single = source.single(*id);
+            }
+
+            // a single named test is always run by the subprocess runner, which executes it in the current process
+            if (in_process && !test_name)
+            {
+                default_runner(std::make_unique<inprocess_runner>(parsed.get<options::tasks>()));
+            }
+
+            else
+            {
+                auto subprocess = std::make_unique<subprocess_runner>(executable, parsed.get<options::tasks>(), parsed.get<options::timeout>(), test_name, isolation,
+                    protocol);
+                subprocess->index(single ? *single : source.index());
+                default_runner(std::move(subprocess));
+            }
+
+            _detail::_configure_runner(default_runner(), parsed);
+            default_runner()(single ? no_suites : source.suites(), reporter);
             default_runner().summary(reporter);
 
+            if (parsed.get<options::runner_stats>())
+            {
+                _detail::_print_runner_stats(default_runner().stats());
+            }
+
             if (default_runner().passed() == default_runner().total())
             {
                 return 0;
@@ -513,5 +1866,23 @@ namespace reaver
 
             return 1;
         }
+
+        inline int run(const std::vector<suite> & suites, const _detail::_test_index & index, int argc, char ** argv, const _detail::_startup_profile * profile = nullptr)
+        {
+            return run(_detail::_test_source{ [&]() -> auto & { return suites; }, [&]() -> auto & { return index; }, {}, profile }, argc, argv);
+        }
+
+        inline int run(const std::vector<suite> & suites, int argc, char ** argv)
+        {
+            return run(suites, _detail::_test_index{ suites }, argc, argv);
+        }
+
+        // the registry's tree and index are built on first use and kept, and not at all in a child started with --test-id; this is what
+        // the default main() uses
+        inline int run(const suite_registry & registry, int argc, char ** argv)
+        {
+            return run(_detail::_test_source{ [&]() -> auto & { return static_cast<const std::vector<suite> &>(registry); }, [&]() -> auto & { return registry.index(); },
+                [&](std::size_t id){ return registry.index(id); }, &registry.startup_profile() }, argc, argv);
+        }
     }}
 }
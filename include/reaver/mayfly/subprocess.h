@@ -28,11 +28,13 @@
 #include "suite.h"
 #include "reporter.h"
 #include "detail/atexit.h"
+#include "detail/protocol.h"
 
 namespace reaver
 {
     namespace mayfly { inline namespace _v1
     {
+        // speaks the text protocol on stdout, or the binary one when the parent has handed over a result descriptor
         class subprocess_reporter : public reporter
         {
         public:
@@ -46,13 +48,51 @@ namespace reaver
 
             virtual void test_started(const testcase &) const override
             {
-                _detail::_default_atexit_registry().atexit(_atexit);
+                static auto registered = (_detail::_default_atexit_registry().atexit(_atexit), true);
+                (void)registered;
+
+                if (_detail::_result_fd() != -1)
+                {
+                    _detail::_write_frame(_detail::_frame_type::started);
+                    return;
+                }
 
                 std::cout << "{{started}}\n";
             }
 
             virtual void test_finished(const testcase_result & result) const override
             {
+                if (_detail::_result_fd() != -1)
+                {
+                    _detail::_finished_frame frame;
+                    frame.status = static_cast<std::uint8_t>(result.status);
+                    frame.duration = result.duration.count();
+                    frame.assertions = result.assertions;
+                    frame.user_time = result.usage.user_time.count();
+                    frame.system_time = result.usage.system_time.count();
+                    frame.peak_rss = result.usage.peak_rss;
+                    frame.minor_faults = result.usage.minor_faults;
+                    frame.major_faults = result.usage.major_faults;
+
+                    if (!result.counters.empty())
+                    {
+                        std::string counters;
+                        for (auto && counter : result.counters)
+                        {
+                            counters.append(reinterpret_cast<const char *>(&counter.second), sizeof(counter.second));
+                            counters.push_back(static_cast<char>(counter.first.size()));
+                            counters.append(counter.first);
+                        }
+
+                        _detail::_write_frame(_detail::_frame_type::counters, counters.data(), counters.size());
+                    }
+
+                    // whatever the test printed has to be in the output pipe before the parent learns that it's over
+                    std::cout << std::flush;
+                    _detail::_write_frame(_detail::_frame_type::finished, &frame, sizeof(frame), result.description);
+                    return;
+                }
+
                 switch (result.status)
                 {
                     case testcase_status::passed:
@@ -67,6 +107,13 @@ namespace reaver
                         break;
                 }
 
+                for (auto && counter : result.counters)
+                {
+                    std::cout << "{{counter " << counter.first << ' ' << counter.second << "}}\n";
+                }
+
+                std::cout << "{{usage " << result.duration.count() << ' ' << result.usage.user_time.count() << ' ' << result.usage.system_time.count() << ' '
+                    << result.usage.peak_rss << ' ' << result.usage.minor_faults << ' ' << result.usage.major_faults << "}}\n";
                 std::cout << "{{finished}}\n";
             }
 
@@ -74,6 +121,12 @@ namespace reaver
             {
                 if (!summary.total)
                 {
+                    if (_detail::_result_fd() != -1)
+                    {
+                        _detail::_write_frame(_detail::_frame_type::not_found);
+                        return;
+                    }
+
                     std::cout << "{{error not found}}\n";
                 }
             }
@@ -81,6 +134,13 @@ namespace reaver
         private:
             static void _atexit()
             {
+                if (_detail::_result_fd() != -1)
+                {
+                    std::cout << std::flush;
+                    _detail::_write_frame(_detail::_frame_type::exit);
+                    return;
+                }
+
                 std::cout << "{{exit}}\n";
             }
         };
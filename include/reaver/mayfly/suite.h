@@ -25,8 +25,13 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <map>
 #include <unordered_map>
 #include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <cstdlib>
 #include <sstream>
 
 #include <boost/algorithm/string.hpp>
@@ -34,16 +39,26 @@
 
 #include "testcase.h"
 #include "reporter.h"
+#include "detail/startup_profile.h"
 
 namespace reaver
 {
     namespace mayfly { inline namespace _v1
     {
+        namespace _detail
+        {
+            class _fixture_base;
+        }
+
+        class suite_registry;
+
         class suite
         {
+            friend class suite_registry;
+
         public:
-            suite(std::string name, std::vector<testcase> testcases = {}, std::vector<suite> suites = {}) : _name{ std::move(name) }, _testcases{ std::move(testcases) },
-                _suites{ std::move(suites) }
+            suite(std::string name, std::vector<testcase> testcases = {}, std::vector<suite> suites = {}, bool in_process = false) : _name{ std::move(name) },
+                _testcases{ std::move(testcases) }, _suites{ std::move(suites) }, _in_process{ in_process }
             {
             }
 
@@ -88,6 +103,54 @@ namespace reaver
                 (*this)[parent].add(std::move(s), std::move(parent_path));
             }
 
+            // the fixture is shared by every testcase of this suite and of its sub-suites; it must outlive the suite
+            void add_fixture(_detail::_fixture_base & f)
+            {
+                _fixtures.push_back(&f);
+            }
+
+            void add_fixture(_detail::_fixture_base & f, std::deque<std::string> parent_path)
+            {
+                if (parent_path.empty())
+                {
+                    add_fixture(f);
+                    return;
+                }
+
+                auto parent = std::move(parent_path.front());
+                parent_path.pop_front();
+                (*this)[parent].add_fixture(f, std::move(parent_path));
+            }
+
+            const std::vector<_detail::_fixture_base *> & fixtures() const
+            {
+                return _fixtures;
+            }
+
+            // resources held by every testcase of this suite and of its sub-suites, on top of their own
+            void uses(const std::string & spec)
+            {
+                _resources.merge(_detail::_parse_resources(spec));
+            }
+
+            void uses(const std::string & spec, std::deque<std::string> parent_path)
+            {
+                if (parent_path.empty())
+                {
+                    uses(spec);
+                    return;
+                }
+
+                auto parent = std::move(parent_path.front());
+                parent_path.pop_front();
+                (*this)[parent].uses(spec, std::move(parent_path));
+            }
+
+            const _detail::_resource_demand & resources() const
+            {
+                return _resources;
+            }
+
             const std::string & name() const
             {
                 return _name;
@@ -122,6 +185,12 @@ namespace reaver
                 return _suites;
             }
 
+            // testcases of in-process suites (and of all their sub-suites) are run directly on the runner's threads, never in a child
+            bool in_process() const
+            {
+                return _in_process;
+            }
+
             auto begin() const
             {
                 return _testcases.begin();
@@ -146,8 +215,185 @@ namespace reaver
             std::string _name;
             std::vector<testcase> _testcases;
             std::vector<suite> _suites;
+            bool _in_process;
+            std::vector<_detail::_fixture_base *> _fixtures;
+            _detail::_resource_demand _resources;
         };
 
+        namespace _detail
+        {
+            // every testcase of a tree under its full path, and under an id - its position in the tree, with the sub-suites of a suite
+            // coming before its own testcases, the order the runners plan them in; a child can be asked for `#<id>` instead of a path,
+            // and either is found with a single lookup
+            // a parameterized testcase has a single entry, covering a range of ids one per case; the entry of a case is only
+            // created when the case is looked up
+            class _test_index
+            {
+            public:
+                struct entry
+                {
+                    std::size_t id;
+                    std::string path;
+                    const suite * parent;
+                    const testcase * test;
+                    // owns `test` in the entry of a case
+                    std::shared_ptr<const testcase> instance;
+                };
+
+                _test_index(const std::vector<suite> & suites)
+                {
+                    for (auto && s : suites)
+                    {
+                        _add(s, nullptr, {});
+                    }
+                }
+
+                // entries found without the tree they come from, in the order of their ids; the suites they're in aren't known, so
+                // they have no parents
+                explicit _test_index(std::vector<entry> entries) : _entries{ std::move(entries) }
+                {
+                    for (std::size_t i = 0; i < _entries.size(); ++i)
+                    {
+                        if (_entries[i].test->is_parameterized())
+                        {
+                            _parameterized.push_back(i);
+                        }
+
+                        else
+                        {
+                            _ids.emplace(_entries[i].path, i);
+                        }
+                    }
+                }
+
+                const entry * find(const std::string & path) const
+                {
+                    auto it = _ids.find(path);
+                    if (it != _ids.end())
+                    {
+                        return &_entries[it->second];
+                    }
+
+                    // case names are whatever the testcase makes of its parameters, so they can only be generated and compared
+                    for (auto position : _parameterized)
+                    {
+                        auto && family = _entries[position];
+                        auto parent_length = family.path.size() - family.test->name().size();
+
+                        if (path.compare(0, parent_length, family.path, 0, parent_length))
+                        {
+                            continue;
+                        }
+
+                        for (std::size_t i = 0; i < family.test->cases(); ++i)
+                        {
+                            if (path.compare(parent_length, std::string::npos, family.test->case_name(i)) == 0)
+                            {
+                                return _case(family, i);
+                            }
+                        }
+                    }
+
+                    return nullptr;
+                }
+
+                const entry * find(std::size_t id) const
+                {
+                    auto it = std::upper_bound(_entries.begin(), _entries.end(), id, [](std::size_t id, const entry & e){ return id < e.id; });
+                    if (it == _entries.begin())
+                    {
+                        return nullptr;
+                    }
+
+                    auto && e = *--it;
+                    if (id - e.id >= e.test->cases())
+                    {
+                        return nullptr;
+                    }
+
+                    return e.test->is_parameterized() ? _case(e, id - e.id) : &e;
+                }
+
+                // either `#<id>` or a full path
+                const entry * resolve(const std::string & request) const
+                {
+                    if (request.size() > 1 && request.front() == '#')
+                    {
+                        char * end;
+                        auto id = std::strtoull(request.c_str() + 1, &end, 10);
+                        return *end ? nullptr : find(static_cast<std::size_t>(id));
+                    }
+
+                    return find(request);
+                }
+
+                // one for every registered testcase; parameterized ones aren't expanded into their cases
+                const std::vector<entry> & entries() const
+                {
+                    return _entries;
+                }
+
+                // the suite `s` is a sub-suite of; nullptr for a top-level one
+                const suite * parent(const suite & s) const
+                {
+                    auto it = _parents.find(&s);
+                    return it != _parents.end() ? it->second : nullptr;
+                }
+
+            private:
+                void _add(const suite & s, const suite * parent, const std::string & parent_path)
+                {
+                    auto path = parent_path.empty() ? s.name() : parent_path + "/" + s.name();
+                    _parents.emplace(&s, parent);
+
+                    for (auto && sub : s.suites())
+                    {
+                        _add(sub, &s, path);
+                    }
+
+                    for (auto && test : s)
+                    {
+                        if (test.is_parameterized())
+                        {
+                            _parameterized.push_back(_entries.size());
+                        }
+
+                        else
+                        {
+                            _ids.emplace(path + "/" + test.name(), _entries.size());
+                        }
+
+                        _entries.push_back({ _next_id, path + "/" + test.name(), &s, &test, nullptr });
+                        _next_id += test.cases();
+                    }
+                }
+
+                const entry * _case(const entry & family, std::size_t index) const
+                {
+                    std::lock_guard<std::mutex> lock{ _cases_mutex };
+
+                    auto & created = _cases[family.id + index];
+                    if (!created.instance)
+                    {
+                        auto instance = std::make_shared<const testcase>(family.test->instance(index));
+                        created = { family.id + index, family.path.substr(0, family.path.size() - family.test->name().size()) + instance->name(),
+                            family.parent, instance.get(), instance };
+                    }
+
+                    return &created;
+                }
+
+                std::vector<entry> _entries;
+                std::unordered_map<std::string, std::size_t> _ids;
+                std::vector<std::size_t> _parameterized;
+                std::unordered_map<const suite *, const suite *> _parents;
+                std::size_t _next_id = 0;
+
+                mutable std::mutex _cases_mutex;
+                mutable std::unordered_map<std::size_t, entry> _cases;
+            };
+        }
+
         class duplicate_testcase_registration : public exception
         {
         public:
@@ -166,6 +412,24 @@ namespace reaver
             }
         };
 
+        class unknown_fixture_suite : public exception
+        {
+        public:
+            unknown_fixture_suite(const std::string & suite_name) : exception{ reaver::logger::error }
+            {
+                *this << "tried to register a fixture for an unknown suite `" << suite_name << "`.";
+            }
+        };
+
+        class unknown_resources_suite : public exception
+        {
+        public:
+            unknown_resources_suite(const std::string & suite_name) : exception{ reaver::logger::error }
+            {
+                *this << "tried to declare resources of an unknown suite `" << suite_name << "`.";
+            }
+        };
+
         class unknown_parent : public exception
         {
         public:
@@ -175,23 +439,97 @@ namespace reaver
             }
         };
 
+        // registration only validates the name and records where things go, and a suite is never looked up by name or copied; a
+        // deferred registry (the default one, filled by the static registrars of every process) builds its suite tree from these
+        // records in a single pass the first time it's used, any other applies each of them right away
         class suite_registry
         {
         public:
+            suite_registry(bool deferred = false) : _deferred{ deferred }
+            {
+            }
+
             operator const std::vector<suite> &() const
             {
+                _materialize();
                 return _suites;
             }
 
+            // built on first use, once registration is over; registering anything afterwards drops it
+            const _detail::_test_index & index() const
+            {
+                if (!_index)
+                {
+                    _materialize();
+
+                    auto start = _detail::_startup_profile::clock::now();
+                    _index = std::make_unique<_detail::_test_index>(_suites);
+                    _profile.indexing += _detail::_startup_profile::clock::now() - start;
+                }
+
+                return *_index;
+            }
+
+            // the index of just the testcase with the id `id`, or of nothing if there's none; a child started to run that testcase
+            // needs nothing else, so while the tree is only recorded, the testcase is found by walking the records in the order the
+            // ids are given in, and the tree isn't built
+            std::unique_ptr<_detail::_test_index> index(std::size_t id) const
+            {
+                std::vector<_detail::_test_index::entry> found;
+
+                if (!_suites.empty())
+                {
+                    if (auto entry = index().find(id))
+                    {
+                        found.push_back(*entry);
+                    }
+
+                    return std::make_unique<_detail::_test_index>(std::move(found));
+                }
+
+                auto start = _detail::_startup_profile::clock::now();
+
+                _records records;
+                for (auto && pending : _pending_suites)
+                {
+                    if (pending.first.size() > 1)
+                    {
+                        records[{ pending.first.begin(), std::prev(pending.first.end()) }].suites.push_back(&pending);
+                    }
+                }
+
+                for (auto && pending : _pending_testcases)
+                {
+                    records[pending.first].testcases.push_back(&pending.second);
+                }
+
+                std::size_t next = 0;
+                std::vector<const std::string *> chain;
+                for (auto && pending : _pending_suites)
+                {
+                    if (pending.first.size() == 1 && _find(pending.second, &pending.first, records, id, next, chain, found))
+                    {
+                        break;
+                    }
+                }
+
+                _profile.indexing += _detail::_startup_profile::clock::now() - start;
+                return std::make_unique<_detail::_test_index>(std::move(found));
+            }
+
+            const _detail::_startup_profile & startup_profile() const
+            {
+                return _profile;
+            }
+
             void add(suite s)
             {
-                if (_names.find(s.name()) != _names.end())
+                if (_registered.find(s.name()) != _registered.end())
                 {
                     return;
                 }
 
-                _suites.push_back(s);
-                _names.emplace(s.name());
+                _register(std::move(s), {}, nullptr);
             }
 
             void add(suite s, const std::string & parent_path)
@@ -202,57 +540,275 @@ namespace reaver
                     return;
                 }
 
-                if (_names.find(parent_path) == _names.end())
+                auto parent = _registered.find(parent_path);
+                if (parent == _registered.end())
                 {
                     throw unknown_parent{ parent_path, s.name() };
                 }
 
-                if (_names.find(parent_path + "/" + s.name()) != _names.end())
+                auto path = parent_path + "/" + s.name();
+                if (_registered.find(path) != _registered.end())
                 {
                     return;
                 }
 
-                _names.emplace(parent_path + (parent_path.empty() ? "" : "/") + s.name());
-
-                std::deque<std::string> path_parts;
-                boost::split(path_parts, parent_path, boost::is_any_of("/"));
-
-                auto parent = std::move(path_parts.front());
-                path_parts.pop_front();
-                boost::range::find_if(_suites, [&](auto && arg){ return arg.name() == parent; })->add(std::move(s), std::move(path_parts));
+                _register(std::move(s), std::move(path), &parent->second);
             }
 
             void add(const std::string & suite_name, testcase t)
             {
-                if (_names.find(suite_name) == _names.end())
+                auto target = _registered.find(suite_name);
+                if (target == _registered.end())
                 {
                     throw unknown_suite{ suite_name, t.name() };
                 }
 
-                if (_testcases[suite_name].find(t.name()) != _testcases[suite_name].end())
+                if (!target->second.testcases.emplace(t.name()).second)
                 {
                     throw duplicate_testcase_registration{ suite_name, t.name() };
                 }
 
-                std::deque<std::string> path_parts;
-                boost::split(path_parts, suite_name, boost::is_any_of("/"));
+                _index.reset();
+                _profile.registered();
+                ++_profile.testcases;
+                _pending_testcases.emplace_back(target->second.position, std::move(t));
+
+                if (!_deferred)
+                {
+                    _materialize();
+                }
+            }
+
+            void add_resources(const std::string & suite_name, const std::string & spec)
+            {
+                auto target = _registered.find(suite_name);
+                if (target == _registered.end())
+                {
+                    throw unknown_resources_suite{ suite_name };
+                }
+
+                _index.reset();
+                _profile.registered();
+                _pending_resources.emplace_back(target->second.position, spec);
+
+                if (!_deferred)
+                {
+                    _materialize();
+                }
+            }
+
+            void add_fixture(const std::string & suite_name, _detail::_fixture_base & f)
+            {
+                auto target = _registered.find(suite_name);
+                if (target == _registered.end())
+                {
+                    throw unknown_fixture_suite{ suite_name };
+                }
 
-                auto parent = std::move(path_parts.front());
-                path_parts.pop_front();
-                boost::range::find_if(_suites, [&](auto && arg){ return arg.name() == parent; })->add(std::move(t), std::move(path_parts));
+                _index.reset();
+                _profile.registered();
+                _pending_fixtures.emplace_back(target->second.position, &f);
 
-                _testcases[suite_name].emplace(t.name());
+                if (!_deferred)
+                {
+                    _materialize();
+                }
             }
 
         private:
-            std::vector<suite> _suites;
-            std::unordered_set<std::string> _names;
-            std::unordered_map<std::string, std::unordered_set<std::string>> _testcases;
+            // the position of a suite is the list of indices of the sub-suites leading to it, starting with a top-level suite; suites
+            // are only ever appended, so it never changes
+            using _position = std::vector<std::size_t>;
+
+            struct _registered_suite
+            {
+                _position position;
+                std::size_t sub_suites;
+                std::unordered_set<std::string> testcases;
+            };
+
+            void _register(suite s, std::string path, _registered_suite * parent)
+            {
+                _position position;
+                if (parent)
+                {
+                    position = parent->position;
+                    position.push_back(parent->sub_suites++);
+                }
+
+                else
+                {
+                    position.push_back(_top_level++);
+                    path = s.name();
+                }
+
+                _index.reset();
+                _profile.registered();
+                ++_profile.suites;
+                _registered.emplace(std::move(path), _registered_suite{ position, s.suites().size(), {} });
+                _pending_suites.emplace_back(std::move(position), std::move(s));
+
+                if (!_deferred)
+                {
+                    _materialize();
+                }
+            }
+
+            // what was registered into a suite after the suite itself, in the order of registration
+            struct _recorded_contents
+            {
+                std::vector<const std::pair<_position, suite> *> suites;
+                std::vector<const testcase *> testcases;
+            };
+
+            using _records = std::map<_position, _recorded_contents>;
+
+            // visits `s` like _test_index does, as if it was built: its own sub-suites and then the recorded ones, then its own testcases
+            // and then the recorded ones; `next` is the id of the next testcase, and the entry of the one with the id `id` ends up in
+            // `found`, owning a copy of it
+            static bool _find(const suite & s, const _position * position, const _records & records, std::size_t id, std::size_t & next,
+                std::vector<const std::string *> & chain, std::vector<_detail::_test_index::entry> & found)
+            {
+                auto recorded = position ? records.find(*position) : records.end();
+                chain.push_back(&s.name());
+
+                auto visit = [&](const testcase & t)
+                {
+                    if (id - next >= t.cases())
+                    {
+                        next += t.cases();
+                        return false;
+                    }
+
+                    std::string path;
+                    for (auto && name : chain)
+                    {
+                        path += *name + "/";
+                    }
+
+                    auto instance = std::make_shared<const testcase>(t);
+                    found.push_back({ next, path + t.name(), nullptr, instance.get(), instance });
+                    return true;
+                };
+
+                for (auto && sub : s.suites())
+                {
+                    if (_find(sub, nullptr, records, id, next, chain, found))
+                    {
+                        return true;
+                    }
+                }
+
+                if (recorded != records.end())
+                {
+                    for (auto && sub : recorded->second.suites)
+                    {
+                        if (_find(sub->second, &sub->first, records, id, next, chain, found))
+                        {
+                            return true;
+                        }
+                    }
+                }
+
+                for (auto && t : s)
+                {
+                    if (visit(t))
+                    {
+                        return true;
+                    }
+                }
+
+                if (recorded != records.end())
+                {
+                    for (auto && t : recorded->second.testcases)
+                    {
+                        if (visit(*t))
+                        {
+                            return true;
+                        }
+                    }
+                }
+
+                chain.pop_back();
+                return false;
+            }
+
+            suite & _at(const _position & position) const
+            {
+                auto s = &_suites[position.front()];
+                for (auto it = std::next(position.begin()); it != position.end(); ++it)
+                {
+                    s = &s->_suites[*it];
+                }
+
+                return *s;
+            }
+
+            // every suite a testcase, a fixture or a resource declaration refers to was registered before it, and is built by the
+            // time it's applied; the relative order of the registrations of each kind is kept
+            void _materialize() const
+            {
+                if (_pending_suites.empty() && _pending_testcases.empty() && _pending_fixtures.empty() && _pending_resources.empty())
+                {
+                    return;
+                }
+
+                auto start = _detail::_startup_profile::clock::now();
+
+                for (auto && pending : _pending_suites)
+                {
+                    if (pending.first.size() == 1)
+                    {
+                        _suites.push_back(std::move(pending.second));
+                        continue;
+                    }
+
+                    auto parent = pending.first;
+                    parent.pop_back();
+                    _at(parent)._suites.push_back(std::move(pending.second));
+                }
+
+                for (auto && pending : _pending_testcases)
+                {
+                    _at(pending.first).add(std::move(pending.second));
+                }
+
+                for (auto && pending : _pending_fixtures)
+                {
+                    _at(pending.first).add_fixture(*pending.second);
+                }
+
+                for (auto && pending : _pending_resources)
+                {
+                    _at(pending.first).uses(pending.second);
+                }
+
+                _pending_suites.clear();
+                _pending_testcases.clear();
+                _pending_fixtures.clear();
+                _pending_resources.clear();
+
+                _profile.materialization += _detail::_startup_profile::clock::now() - start;
+                ++_profile.materializations;
+            }
+
+            bool _deferred;
+            mutable std::vector<suite> _suites;
+            std::unordered_map<std::string, _registered_suite> _registered;
+            std::size_t _top_level = 0;
+
+            mutable std::vector<std::pair<_position, suite>> _pending_suites;
+            mutable std::vector<std::pair<_position, testcase>> _pending_testcases;
+            mutable std::vector<std::pair<_position, _detail::_fixture_base *>> _pending_fixtures;
+            mutable std::vector<std::pair<_position, std::string>> _pending_resources;
+
+            mutable _detail::_startup_profile _profile;
+            mutable std::unique_ptr<_detail::_test_index> _index;
         };
 
         inline suite_registry & default_suite_registry()
         {
-            static suite_registry default_registry;
+            static suite_registry default_registry{ true };
 
             return default_registry;
         };
@@ -282,10 +838,11 @@ namespace reaver
 
         struct testcase_registrar
         {
-            testcase_registrar(const std::string & suite_name, testcase t)
+            testcase_registrar(const std::string & suite_name, testcase t, const std::string & resources = {})
             {
                 try
                 {
+                    t.uses(resources);
                     default_suite_registry().add(suite_name, std::move(t));
                 }
 
@@ -302,18 +859,45 @@ namespace reaver
                 }
             }
         };
+
+        struct resources_registrar
+        {
+            resources_registrar(const std::string & suite_name, const std::string & resources)
+            {
+                try
+                {
+                    default_suite_registry().add_resources(suite_name, resources);
+                }
+
+                catch (reaver::exception & e)
+                {
+                    e.print(reaver::logger::default_logger());
+                    std::exit(2);
+                }
+            }
+        };
     }}
 }
 
 #define MAYFLY_ADD_SUITE(name) \
     namespace { static ::reaver::mayfly::suite_registrar MAYFLY_DETAIL_UNIQUE_NAME { ::reaver::mayfly::suite { name }, reaver_mayfly_suite_path }; }
 
+#define MAYFLY_ADD_IN_PROCESS_SUITE(name) \
+    namespace { static ::reaver::mayfly::suite_registrar MAYFLY_DETAIL_UNIQUE_NAME { ::reaver::mayfly::suite { name, {}, {}, true }, reaver_mayfly_suite_path }; }
+
 #define MAYFLY_ADD_TESTCASE_TO(suite, test, ...)                                                                            \
     namespace { static ::reaver::mayfly::testcase_registrar MAYFLY_DETAIL_UNIQUE_NAME { suite, ::reaver::mayfly::testcase { \
         test, __VA_ARGS__ } }; }
 
-#define MAYFLY_BEGIN_SUITE(name)                                                                                              \
-    MAYFLY_ADD_SUITE(name)                                                                                                    \
+#define MAYFLY_BEGIN_SUITE(name) \
+    MAYFLY_ADD_SUITE(name)        \
+    MAYFLY_DETAIL_OPEN_SUITE(name)
+
+#define MAYFLY_BEGIN_IN_PROCESS_SUITE(name) \
+    MAYFLY_ADD_IN_PROCESS_SUITE(name)        \
+    MAYFLY_DETAIL_OPEN_SUITE(name)
+
+#define MAYFLY_DETAIL_OPEN_SUITE(name)                                                                                        \
     namespace { namespace MAYFLY_DETAIL_UNIQUE_NAME { static const std::string reaver_mayfly_suite_name = name;               \
         static const std::string reaver_mayfly_suite_path_ref = reaver_mayfly_suite_path;                                     \
         static const std::string reaver_mayfly_suite_path = reaver_mayfly_suite_path_ref.empty() ? reaver_mayfly_suite_name : \
@@ -328,6 +912,17 @@ namespace reaver
 #define MAYFLY_ADD_TESTCASE(test, ...) \
     MAYFLY_ADD_TESTCASE_TO(reaver_mayfly_suite_path, test, __VA_ARGS__)
 
+#define MAYFLY_ADD_TESTCASE_USING_TO(suite, test, resources, ...)                                                           \
+    namespace { static ::reaver::mayfly::testcase_registrar MAYFLY_DETAIL_UNIQUE_NAME { suite, ::reaver::mayfly::testcase { \
+        test, __VA_ARGS__ }, resources }; }
+
+#define MAYFLY_ADD_TESTCASE_USING(test, resources, ...) \
+    MAYFLY_ADD_TESTCASE_USING_TO(reaver_mayfly_suite_path, test, resources, __VA_ARGS__)
+
+// every testcase of the current suite (and of its sub-suites) holds these resources while it runs
+#define MAYFLY_SUITE_USES(resources) \
+    namespace { static ::reaver::mayfly::resources_registrar MAYFLY_DETAIL_UNIQUE_NAME { reaver_mayfly_suite_path, resources }; }
+
 #define MAYFLY_ADD_NEGATIVE_TESTCASE_TO(suite, test, ...)                                                                   \
     namespace { static ::reaver::mayfly::testcase_registrar MAYFLY_DETAIL_UNIQUE_NAME { suite, ::reaver::mayfly::testcase { \
         test, __VA_ARGS__, false } }; }
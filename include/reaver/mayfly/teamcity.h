@@ -27,6 +27,7 @@
 #include "testcase.h"
 #include "suite.h"
 #include "reporter.h"
+#include "benchmark.h"
 
 namespace reaver
 {
@@ -73,11 +74,47 @@ namespace reaver
                         reaver::logger::dlog() << "##teamcity[testFailed name='" << name << "' details='Test timed out.']";
                         break;
 
+                    case testcase_status::regressed:
+                        reaver::logger::dlog() << "##teamcity[testFailed name='" << name << "' details='Test regressed: " << description << "']";
+                        break;
+
+                    case testcase_status::leaked:
+                    case testcase_status::data_race:
+                    case testcase_status::memory_error:
+                    case testcase_status::undefined_behavior:
+                        reaver::logger::dlog() << "##teamcity[testFailed name='" << name << "' details='Sanitizer: " << description << "']";
+                        break;
+
                     default:
                         throw invalid_testcase_status{};
                 }
 
-                reaver::logger::dlog() << "##teamcity[testFinished name='" << name << "' duration='" << result.duration.count() << "']";
+                if (result.usage.peak_rss)
+                {
+                    auto metadata = [&](const char * key, auto value)
+                    {
+                        reaver::logger::dlog() << "##teamcity[testMetadata testName='" << name << "' type='number' name='" << key << "' value='" << value << "']";
+                    };
+
+                    metadata("user time (ms)", std::chrono::duration<double, std::milli>{ result.usage.user_time }.count());
+                    metadata("system time (ms)", std::chrono::duration<double, std::milli>{ result.usage.system_time }.count());
+                    metadata("peak RSS (kB)", result.usage.peak_rss);
+                    metadata("minor page faults", result.usage.minor_faults);
+                    metadata("major page faults", result.usage.major_faults);
+
+                    for (auto && counter : result.counters)
+                    {
+                        metadata(counter.first.c_str(), counter.second);
+                    }
+                }
+
+                reaver::logger::dlog() << "##teamcity[testFinished name='" << name << "' duration='" << std::chrono::duration_cast<std::chrono::milliseconds>(result.duration).count() << "']";
+            }
+
+            virtual void benchmark_finished(const benchmark_result & b) const override
+            {
+                reaver::logger::dlog() << "##teamcity[buildStatisticValue key='" << b.name << ".median' value='" << b.median.count() << "']";
+                reaver::logger::dlog() << "##teamcity[buildStatisticValue key='" << b.name << ".p99' value='" << b.p99.count() << "']";
             }
 
             virtual void summary(tests_summary) const override
@@ -22,11 +22,16 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
+#include <utility>
 #include <functional>
+#include <memory>
 #include <chrono>
 
 #include "asserts.h"
+#include "detail/resources.h"
 
 namespace reaver
 {
@@ -39,7 +44,14 @@ namespace reaver
             failed = 2,
             crashed = 3,
             timed_out = 4,
-            not_found = 5
+            not_found = 5,
+            // passed, but measurably slower than the baseline it was compared against
+            regressed = 6,
+            // a sanitizer reported on the testcase's process; see detail/sanitizers.h
+            leaked = 7,
+            data_race = 8,
+            memory_error = 9,
+            undefined_behavior = 10
         };
 
         class unexpected_result : public exception
@@ -51,14 +63,40 @@ namespace reaver
             }
         };
 
+        // what a testcase cost besides wall clock time, as measured by the process that executed it
+        struct resource_usage
+        {
+            std::chrono::nanoseconds user_time{};
+            std::chrono::nanoseconds system_time{};
+            // in kilobytes
+            std::size_t peak_rss = 0;
+            std::size_t minor_faults = 0;
+            std::size_t major_faults = 0;
+        };
+
         struct testcase_result
         {
             std::string name;
             testcase_status status;
             std::string description;
-            std::chrono::milliseconds duration;
+            std::chrono::nanoseconds duration{};
+            std::size_t assertions = 0;
+            resource_usage usage;
+            // readings of the hardware counters selected with --perf-counters, in the order they were selected in
+            std::vector<std::pair<std::string, std::uint64_t>> counters;
         };
 
+        namespace _detail
+        {
+            // the cases of a parameterized testcase; nothing is generated for any of them until it's asked for by its index
+            struct _case_generator
+            {
+                std::size_t count;
+                std::function<std::string (std::size_t)> name;
+                std::function<void (std::size_t)> body;
+            };
+        }
+
         class testcase
         {
         public:
@@ -67,19 +105,92 @@ namespace reaver
             {
             }
 
+            // a benchmark also carries a loop that runs its body a given number of times, with the body inlined into it
+            testcase(std::string name, std::function<void ()> test, std::function<void (std::size_t)> iterate) : _name{ std::move(name) }, _test{ std::move(test) },
+                _positive{ true }, _assertions_to_fail{ 0 }, _iterate{ std::move(iterate) }
+            {
+            }
+
+            // a parameterized testcase; see parameterized()
+            testcase(std::string name, std::shared_ptr<const _detail::_case_generator> cases) : _name{ std::move(name) }, _positive{ true }, _assertions_to_fail{ 0 },
+                _cases{ std::move(cases) }
+            {
+            }
+
             const std::string & name() const
             {
                 return _name;
             }
 
+            // a parameterized testcase is never run itself; it stands for cases() testcases, each created only when it's planned or run
+            bool is_parameterized() const
+            {
+                return static_cast<bool>(_cases);
+            }
+
+            std::size_t cases() const
+            {
+                return _cases ? _cases->count : 1;
+            }
+
+            std::string case_name(std::size_t index) const
+            {
+                return _cases ? _cases->name(index) : _name;
+            }
+
+            testcase instance(std::size_t index) const
+            {
+                if (!_cases)
+                {
+                    return *this;
+                }
+
+                auto cases = _cases;
+                testcase instance{ _cases->name(index), [cases, index]{ cases->body(index); }, _positive, _assertions_to_fail };
+                instance._resources = _resources;
+                return instance;
+            }
+
+            // declares the resources the testcase holds while it runs; see _detail::_parse_resources for the syntax
+            testcase & uses(const std::string & spec)
+            {
+                _resources.merge(_detail::_parse_resources(spec));
+                return *this;
+            }
+
+            const _detail::_resource_demand & resources() const
+            {
+                return _resources;
+            }
+
+            bool is_benchmark() const
+            {
+                return static_cast<bool>(_iterate);
+            }
+
+            // a single run of the body; for a benchmark, that's a smoke test without any measurement
             void operator()() const
+            {
+                _run([&]{ _test(); });
+            }
+
+            // calls `f` with the iteration loop of a benchmark, with assertions handled as for a regular run
+            template<typename F>
+            void measure(F && f) const
+            {
+                _run([&]{ f(_iterate); });
+            }
+
+        private:
+            template<typename F>
+            void _run(F && f) const
             {
                 try
                 {
-                    _detail::_local_assertions_logger() = _detail::_assertions_logger{ _positive, _assertions_to_fail };
-                    _test();
-                    _detail::_local_assertions_logger()->throw_exception();
-                    _detail::_local_assertions_logger() = boost::none;
+                    _detail::_assertions_logger logger{ _positive, _assertions_to_fail };
+                    _detail::_assertions_logger_scope scope{ &logger };
+                    f();
+                    logger.throw_exception();
                 }
 
                 catch (expected_failure_exit &)
@@ -87,11 +198,13 @@ namespace reaver
                 }
             }
 
-        private:
             std::string _name;
             std::function<void ()> _test;
             bool _positive;
             std::size_t _assertions_to_fail;
+            std::function<void (std::size_t)> _iterate;
+            std::shared_ptr<const _detail::_case_generator> _cases;
+            _detail::_resource_demand _resources;
         };
     }}
 }
@@ -0,0 +1,50 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#include "mayfly/driver.h"
+#include "mayfly/junit.h"
+#include "mayfly/json.h"
+#include "mayfly/teamcity.h"
+
+int main(int argc, char ** argv) try
+{
+    return reaver::mayfly::run_driver(argc, argv);
+}
+
+catch (reaver::exception & e)
+{
+    e.print(reaver::logger::default_logger());
+
+    if (e.level() == reaver::logger::crash)
+    {
+        return 2;
+    }
+
+    return 1;
+}
+
+catch (std::exception & e)
+{
+    reaver::logger::dlog(reaver::logger::crash) << e.what();
+
+    return 2;
+}
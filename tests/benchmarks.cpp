@@ -0,0 +1,96 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#include "mayfly.h"
+#include "mayfly/detail/baseline.h"
+
+#include <cmath>
+
+#include "harness.h"
+
+MAYFLY_BEGIN_SUITE("benchmarks");
+
+MAYFLY_ADD_BENCHMARK("vector push_back", []
+{
+    std::vector<int> v;
+    for (int i = 0; i < 16; ++i)
+    {
+        v.push_back(i);
+    }
+    reaver::mayfly::do_not_optimize(v.data());
+    reaver::mayfly::clobber();
+});
+
+MAYFLY_ADD_TESTCASE("measurement statistics", []
+{
+    std::size_t calls = 0;
+    auto t = reaver::mayfly::benchmark("counted", [&]{ ++calls; reaver::mayfly::clobber(); });
+
+    reaver::mayfly::_detail::_benchmark_settings settings;
+    settings.sample_time = std::chrono::microseconds{ 100 };
+    settings.samples = 10;
+
+    auto result = reaver::mayfly::_detail::_measure(t, settings);
+
+    MAYFLY_REQUIRE(t.is_benchmark());
+    MAYFLY_CHECK(result.name == "counted");
+    MAYFLY_CHECK(result.samples == 10);
+    MAYFLY_CHECK(result.iterations >= 1);
+    MAYFLY_CHECK(calls >= result.iterations * result.samples);
+    MAYFLY_CHECK(result.min <= result.median);
+    MAYFLY_CHECK(result.median <= result.p99);
+    MAYFLY_CHECK(result.stddev.count() >= 0);
+});
+
+MAYFLY_ADD_TESTCASE("throwing benchmarks fail", []
+{
+    reaver::mayfly::suite s{ "benchmarks" };
+    s.add(reaver::mayfly::benchmark("throwing", []{ throw 42; }));
+    std::vector<reaver::mayfly::suite> suites{ std::move(s) };
+
+    reaver::mayfly::inprocess_runner runner{ 1 };
+    auto log = mayfly_tests::run_recorded(runner, suites);
+
+    MAYFLY_REQUIRE(log.results.size() == 1);
+    MAYFLY_CHECK(log.results[0].status == reaver::mayfly::testcase_status::failed);
+    MAYFLY_CHECK(log.results[0].description == "unknown exception thrown");
+    MAYFLY_CHECK(runner.passed() == 0);
+});
+
+MAYFLY_ADD_TESTCASE("baseline regressions", []
+{
+    using reaver::mayfly::_detail::_regressed;
+    using ns = std::chrono::duration<double, std::nano>;
+
+    // benchmarks: the slowdown must exceed both the threshold and the noise of the measurements
+    MAYFLY_CHECK(std::abs(reaver::mayfly::_detail::_median_error(ns{ 10 }, 25).count() - 2.5066) < 0.001);
+    MAYFLY_CHECK(_regressed({ ns{ 100 }, ns{ 1 } }, { ns{ 120 }, ns{ 1 } }, 0.1));
+    MAYFLY_CHECK(!_regressed({ ns{ 100 }, ns{ 1 } }, { ns{ 105 }, ns{ 1 } }, 0.1));
+    MAYFLY_CHECK(!_regressed({ ns{ 100 }, ns{ 10 } }, { ns{ 120 }, ns{ 1 } }, 0.1));
+    MAYFLY_CHECK(!_regressed({ ns{ 100 }, ns{ 1 } }, { ns{ 80 }, ns{ 1 } }, 0.1));
+
+    // ordinary testcases: small absolute differences are never regressions
+    MAYFLY_CHECK(!_regressed({ std::chrono::milliseconds{ 2 }, {} }, { std::chrono::milliseconds{ 30 }, {} }, 0.1));
+    MAYFLY_CHECK(_regressed({ std::chrono::milliseconds{ 100 }, {} }, { std::chrono::milliseconds{ 200 }, {} }, 0.1));
+});
+
+MAYFLY_END_SUITE;
@@ -61,4 +61,38 @@ MAYFLY_ADD_NEGATIVE_TESTCASE_N("multiple failing requires", 1, []
 });
 
 MAYFLY_END_SUITE;
+
+MAYFLY_ADD_TESTCASE("assertion records", []
+{
+    using reaver::mayfly::_detail::_assertion_record;
+
+    std::string formatted;
+    _assertion_record{ nullptr, nullptr, 0, "just a description" }.format(formatted);
+    MAYFLY_CHECK(formatted == "just a description");
+
+    reaver::mayfly::_detail::_assertions_logger logger;
+    MAYFLY_CHECK_NOTHROW(logger.throw_exception());
+
+    logger.log({ "0 == 1", "tests/file.cpp", 12, {} });
+    logger.log({ "a == b", "tests/file.cpp", 13, "1 vs 2" });
+
+    bool thrown = false;
+    try
+    {
+        logger.throw_exception();
+    }
+
+    catch (reaver::mayfly::assertions_failed & e)
+    {
+        thrown = true;
+        MAYFLY_CHECK(e.count() == 2);
+        MAYFLY_CHECK(std::string{ e.what() } == "assertions failed: |n - 0 == 1 (in tests/file.cpp at line 12)|n - a == b: 1 vs 2 (in tests/file.cpp at line 13)");
+    }
+
+    MAYFLY_REQUIRE(thrown);
+
+    // the records are gone once reported
+    MAYFLY_CHECK_NOTHROW(logger.throw_exception());
+});
+
 MAYFLY_END_SUITE;
@@ -0,0 +1,146 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#pragma once
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <system_error>
+
+#include <boost/filesystem.hpp>
+
+#include "mayfly.h"
+#include "mayfly/runner.h"
+#include "mayfly/driver.h"
+
+// what the tests of the runners share: a small tree to run, a reporter that records what it's told, an executable to start children from,
+// and a place for the files a run reads and writes
+namespace mayfly_tests
+{
+    struct recorded
+    {
+        std::vector<std::string> events;
+        std::vector<reaver::mayfly::testcase_result> results;
+    };
+
+    class recording_reporter : public reaver::mayfly::reporter
+    {
+    public:
+        virtual void suite_started(const reaver::mayfly::suite & s) const override
+        {
+            log.events.push_back("+" + s.name());
+        }
+
+        virtual void suite_finished(const reaver::mayfly::suite & s) const override
+        {
+            log.events.push_back("-" + s.name());
+        }
+
+        virtual void test_started(const reaver::mayfly::testcase &) const override
+        {
+        }
+
+        virtual void test_finished(const reaver::mayfly::testcase_result & result) const override
+        {
+            log.events.push_back(result.name + (result.status == reaver::mayfly::testcase_status::passed ? " passed" : " failed"));
+            log.results.push_back(result);
+        }
+
+        virtual void summary(reaver::mayfly::tests_summary) const override
+        {
+        }
+
+        mutable recorded log;
+    };
+
+    inline std::vector<reaver::mayfly::suite> sample_suites()
+    {
+        reaver::mayfly::suite inner{ "inner" };
+        inner.add("failing", []{ MAYFLY_CHECK(false); });
+
+        reaver::mayfly::suite outer{ "outer" };
+        outer.add(std::move(inner));
+        outer.add("first", []{ std::this_thread::sleep_for(std::chrono::milliseconds{ 20 }); });
+        outer.add("second", []{});
+        outer.add("throwing", []{ throw std::runtime_error{ "oops" }; });
+
+        return { std::move(outer) };
+    }
+
+    // runs the tree with a runner set up by the caller, and returns what got reported, in order
+    inline recorded run_recorded(reaver::mayfly::runner & runner, const std::vector<reaver::mayfly::suite> & suites)
+    {
+        recording_reporter rep;
+        runner(suites, rep);
+        return std::move(rep.log);
+    }
+
+    // built from tests/helper/helper.cpp, next to the test executable
+    inline std::string helper_executable()
+    {
+        return (boost::filesystem::read_symlink("/proc/self/exe").parent_path() / "helper" / "helper").string();
+    }
+
+    // the tree of the helper, as it lists it itself; a subprocess runner started with it runs the helper's testcases by their ids there
+    inline std::vector<reaver::mayfly::suite> helper_suites()
+    {
+        reaver::mayfly::driver_runner driver;
+        driver.add_executable(helper_executable());
+        return driver.suites();
+    }
+
+    // a fresh directory under $TMPDIR (or /tmp), removed with everything in it
+    class temporary_directory
+    {
+    public:
+        temporary_directory()
+        {
+            auto base = std::getenv("TMPDIR");
+            std::string pattern = std::string{ base ? base : "/tmp" } + "/mayfly-tests-XXXXXX";
+
+            if (!::mkdtemp(&pattern[0]))
+            {
+                throw std::system_error{ errno, std::system_category() };
+            }
+
+            _path = std::move(pattern);
+        }
+
+        ~temporary_directory()
+        {
+            boost::system::error_code error;
+            boost::filesystem::remove_all(_path, error);
+        }
+
+        std::string file(const std::string & name) const
+        {
+            return _path + "/" + name;
+        }
+
+    private:
+        std::string _path;
+    };
+}
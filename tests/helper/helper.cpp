@@ -0,0 +1,84 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+// the executable the tests of the subprocess runners start their children from; every testcase does one thing a child can do
+
+#include "mayfly.h"
+#include "mayfly/main.h"
+
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <iostream>
+
+MAYFLY_BEGIN_SUITE("helper");
+
+MAYFLY_ADD_TESTCASE("passing", []
+{
+});
+
+MAYFLY_ADD_TESTCASE("failing", []
+{
+    MAYFLY_CHECK(false);
+});
+
+MAYFLY_ADD_TESTCASE("throwing", []
+{
+    throw 42;
+});
+
+MAYFLY_ADD_TESTCASE("aborting", []
+{
+    std::abort();
+});
+
+MAYFLY_ADD_TESTCASE("sleeping", []
+{
+    std::this_thread::sleep_for(std::chrono::seconds{ 30 });
+});
+
+// more than any pipe buffer on both stdout and stderr, interleaved, so that a parent reading them one after another would deadlock
+MAYFLY_ADD_TESTCASE("chatty", []
+{
+    std::string line(1023, '.');
+    for (std::size_t i = 0; i < 4096; ++i)
+    {
+        std::cout << line << '\n';
+        std::cerr << line << '\n';
+    }
+
+    std::cout << "no newline at the end" << std::flush;
+    std::cerr << "nor here" << std::flush;
+});
+
+// what AddressSanitizer writes before it ends the process, without needing the tests to be built with it
+MAYFLY_ADD_TESTCASE("sanitizer", []
+{
+    std::cerr << "==4242==ERROR: AddressSanitizer: heap-use-after-free on address 0x602000000010\n";
+    std::cerr << "READ of size 4 at 0x602000000010 thread T0\n";
+    std::cerr << "SUMMARY: AddressSanitizer: heap-use-after-free helper.cpp:1 in f\n";
+    std::cerr << "==4242==ABORTING\n" << std::flush;
+    std::_Exit(1);
+});
+
+MAYFLY_END_SUITE;
@@ -0,0 +1,187 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#include "mayfly.h"
+#include "mayfly/detail/output_capture.h"
+#include "mayfly/detail/protocol.h"
+
+#include <string>
+#include <vector>
+
+#include <signal.h>
+#include <sys/resource.h>
+
+namespace
+{
+    std::vector<std::string> lines_of(reaver::mayfly::_detail::_output_capture & output)
+    {
+        std::vector<std::string> lines;
+        output.for_each_line([&](const char * line, std::size_t length){ lines.emplace_back(line, length); });
+        return lines;
+    }
+
+    void append(reaver::mayfly::_detail::_output_capture & output, const std::string & line)
+    {
+        output.append(line.data(), line.size());
+    }
+}
+
+MAYFLY_BEGIN_SUITE("output capture");
+
+MAYFLY_ADD_TESTCASE("unlimited output", []
+{
+    reaver::mayfly::_detail::_output_capture output;
+    MAYFLY_CHECK(output.empty());
+
+    append(output, "first");
+    append(output, "");
+    append(output, "third");
+
+    std::vector<std::string> expected{ "first", "", "third" };
+    MAYFLY_CHECK(lines_of(output) == expected);
+    MAYFLY_CHECK(output.omitted() == 0);
+
+    auto moved = std::move(output);
+    MAYFLY_CHECK(lines_of(moved) == expected);
+    MAYFLY_CHECK(lines_of(output).empty());
+
+    moved.clear();
+    MAYFLY_CHECK(moved.empty());
+});
+
+MAYFLY_ADD_TESTCASE("head and tail of limited output", []
+{
+    // half of the limit for each of the head and the tail, terminators included
+    reaver::mayfly::_detail::_output_capture output{ 20 };
+
+    for (auto && line : { "aaaa", "bbbb", "cccc", "dddd", "eeee", "ffff" })
+    {
+        append(output, line);
+    }
+
+    MAYFLY_CHECK(output.omitted() == 2);
+
+    std::vector<std::string> expected{ "aaaa", "bbbb", "[... 2 lines of output omitted ...]", "eeee", "ffff" };
+    MAYFLY_CHECK(lines_of(output) == expected);
+
+    // once the head is full, a short line doesn't go back to it
+    append(output, "g");
+    expected = { "aaaa", "bbbb", "[... 3 lines of output omitted ...]", "ffff", "g" };
+    MAYFLY_CHECK(lines_of(output) == expected);
+});
+
+MAYFLY_ADD_TESTCASE("lines longer than the limit", []
+{
+    reaver::mayfly::_detail::_output_capture output{ 8 };
+
+    append(output, std::string(16, 'a'));
+    append(output, "b");
+
+    std::vector<std::string> expected{ "[... 1 lines of output omitted ...]", "b" };
+    MAYFLY_CHECK(lines_of(output) == expected);
+});
+
+MAYFLY_ADD_TESTCASE("output spilled to a file", []
+{
+    // 2MiB of output, past the default of 1MiB kept in memory, and past a single buffer of the file
+    reaver::mayfly::_detail::_output_capture output;
+
+    for (std::size_t i = 0; i < 2048; ++i)
+    {
+        auto line = std::to_string(i);
+        append(output, line + std::string(1023 - line.size(), '.'));
+    }
+
+    auto lines = lines_of(output);
+    MAYFLY_REQUIRE(lines.size() == 2048);
+
+    bool intact = true;
+    for (std::size_t i = 0; i < lines.size(); ++i)
+    {
+        auto prefix = std::to_string(i);
+        intact = intact && lines[i].size() == 1023 && lines[i].compare(0, prefix.size(), prefix) == 0 && lines[i][prefix.size()] == '.';
+    }
+    MAYFLY_CHECK(intact);
+
+    // reading it back doesn't consume it
+    MAYFLY_CHECK(lines_of(output).size() == 2048);
+
+    output.clear();
+    MAYFLY_CHECK(output.empty());
+    MAYFLY_CHECK(lines_of(output).empty());
+});
+
+MAYFLY_ADD_TESTCASE("output cut short by a full disk", []
+{
+    // the file can't grow past 1500 bytes, so the second write to it stops in the middle of a line, and the third one fails
+    ::rlimit previous;
+    ::getrlimit(RLIMIT_FSIZE, &previous);
+    ::rlimit limit = previous;
+    limit.rlim_cur = 1500;
+    ::setrlimit(RLIMIT_FSIZE, &limit);
+    ::signal(SIGXFSZ, SIG_IGN);
+
+    reaver::mayfly::_detail::_output_capture output{ 0, 1024 };
+
+    for (std::size_t i = 0; i < 100; ++i)
+    {
+        auto line = std::to_string(i);
+        append(output, line + std::string(100 - line.size(), '.'));
+    }
+
+    auto first = lines_of(output);
+
+    // nothing is written to the file anymore, and the line cut by the failed write is still a single one
+    append(output, "after");
+    auto lines = lines_of(output);
+    ::setrlimit(RLIMIT_FSIZE, &previous);
+
+    MAYFLY_CHECK(first.size() == 100);
+    MAYFLY_REQUIRE(lines.size() == 101);
+    MAYFLY_CHECK(lines.back() == "after");
+
+    bool intact = true;
+    for (std::size_t i = 0; i < 100; ++i)
+    {
+        auto prefix = std::to_string(i);
+        intact = intact && lines[i].size() == 100 && lines[i].compare(0, prefix.size(), prefix) == 0 && lines[i][prefix.size()] == '.';
+    }
+    MAYFLY_CHECK(intact);
+});
+
+MAYFLY_ADD_TESTCASE("output without a trailing newline", []
+{
+    reaver::mayfly::_detail::_protocol_parser parser;
+
+    std::string out = "complete\npartial";
+    parser.feed(out.data(), out.size());
+    std::string errors = "no newline on stderr either";
+    parser.feed_errors(errors.data(), errors.size());
+
+    parser.finish_errors();
+    parser.finish();
+
+    std::vector<std::string> expected{ "complete", "no newline on stderr either", "partial" };
+    MAYFLY_CHECK(lines_of(parser.output) == expected);
+});
+
+MAYFLY_END_SUITE;
@@ -0,0 +1,78 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#include "mayfly.h"
+#include "mayfly/detail/perf_counters.h"
+
+#include <string>
+#include <vector>
+#include <iterator>
+
+#include <boost/filesystem.hpp>
+
+MAYFLY_BEGIN_SUITE("performance counters");
+
+MAYFLY_ADD_TESTCASE("empty selection", []
+{
+    reaver::mayfly::_detail::_perf_meter meter{ std::vector<std::string>{} };
+    MAYFLY_CHECK(meter().empty());
+});
+
+MAYFLY_ADD_TESTCASE("unknown counters", []
+{
+    MAYFLY_CHECK(reaver::mayfly::_detail::_perf_counter("task-clock").type == PERF_TYPE_SOFTWARE);
+    MAYFLY_CHECK_THROWS_TYPE(reaver::mayfly::invalid_perf_counter, reaver::mayfly::_detail::_perf_counter("cycle"));
+
+    // the counters named before the unknown one aren't left open
+    auto descriptors = []{ return std::distance(boost::filesystem::directory_iterator{ "/proc/self/fd" }, boost::filesystem::directory_iterator{}); };
+    auto before = descriptors();
+
+    std::vector<std::string> names{ "task-clock", "bogus" };
+    MAYFLY_CHECK_THROWS_TYPE(reaver::mayfly::invalid_perf_counter, reaver::mayfly::_detail::_perf_meter{ names });
+    MAYFLY_CHECK(descriptors() == before);
+});
+
+MAYFLY_ADD_TESTCASE("software counters", []
+{
+    reaver::mayfly::_detail::_perf_meter meter{ { "task-clock", "context-switches" } };
+
+    volatile std::uint64_t sum = 0;
+    for (std::uint64_t i = 0; i < 1000000; ++i)
+    {
+        sum += i;
+    }
+
+    // a restrictive perf_event_paranoid leaves the counters out, but never reports anything that wasn't asked for, or twice
+    auto readings = meter();
+    MAYFLY_REQUIRE(readings.size() <= 2);
+    for (auto && reading : readings)
+    {
+        MAYFLY_CHECK(reading.first == "task-clock" || reading.first == "context-switches");
+    }
+
+    if (!readings.empty() && readings.front().first == "task-clock")
+    {
+        MAYFLY_CHECK(readings.front().second > 0);
+    }
+});
+
+MAYFLY_END_SUITE;
@@ -0,0 +1,197 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#include "mayfly.h"
+#include "mayfly/detail/protocol.h"
+
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace
+{
+    namespace detail = reaver::mayfly::_detail;
+
+    // what _write_frame() sends down the result descriptor of a child
+    std::string encoded(detail::_frame_type type, const void * payload = nullptr, std::size_t size = 0, const std::string & tail = {})
+    {
+        int fds[2];
+        MAYFLY_REQUIRE(::pipe(fds) == 0);
+
+        detail::_result_fd() = fds[1];
+        detail::_write_frame(type, payload, size, tail);
+        detail::_result_fd() = -1;
+        ::close(fds[1]);
+
+        std::string frame;
+        char buffer[256];
+        for (ssize_t read; (read = ::read(fds[0], buffer, sizeof(buffer))) > 0; )
+        {
+            frame.append(buffer, read);
+        }
+        ::close(fds[0]);
+
+        return frame;
+    }
+
+    std::vector<std::string> lines_of(detail::_output_capture & output)
+    {
+        std::vector<std::string> lines;
+        output.for_each_line([&](const char * line, std::size_t length){ lines.emplace_back(line, length); });
+        return lines;
+    }
+}
+
+MAYFLY_BEGIN_SUITE("result protocol");
+
+MAYFLY_ADD_TESTCASE("text protocol split across reads", []
+{
+    detail::_protocol_parser parser;
+
+    std::vector<std::string> reads{ "{{sta", "rted}}\nhel", "lo\n{{fai", "led oops}}\n{{usage 100 2 3 4 5 6}}\n{{counter cycles 42}}\n",
+        "{{counter malformed}}\n{{finished}}\n", "{{done}}\nnext\n" };
+
+    std::size_t done = 0;
+    for (auto && read : reads)
+    {
+        done += parser.feed(read.data(), read.size());
+        MAYFLY_CHECK(done == (&read == &reads.back()));
+    }
+
+    MAYFLY_CHECK(parser.state == detail::_protocol_parser::exited);
+    MAYFLY_CHECK(parser.status == reaver::mayfly::testcase_status::failed);
+    MAYFLY_CHECK(parser.description == "oops");
+    MAYFLY_CHECK(!parser.unexpected_status);
+
+    MAYFLY_CHECK(parser.duration == std::chrono::nanoseconds{ 100 });
+    MAYFLY_CHECK(parser.usage.user_time == std::chrono::nanoseconds{ 2 });
+    MAYFLY_CHECK(parser.usage.system_time == std::chrono::nanoseconds{ 3 });
+    MAYFLY_CHECK(parser.usage.peak_rss == 4);
+    MAYFLY_CHECK(parser.usage.minor_faults == 5);
+    MAYFLY_CHECK(parser.usage.major_faults == 6);
+
+    MAYFLY_REQUIRE(parser.counters.size() == 1);
+    MAYFLY_CHECK(parser.counters[0].first == "cycles");
+    MAYFLY_CHECK(parser.counters[0].second == 42);
+
+    std::vector<std::string> expected{ "hello" };
+    MAYFLY_CHECK(lines_of(parser.output) == expected);
+
+    // what came after the end of the testcase belongs to the next one
+    parser.reset();
+    parser.finish();
+    expected = { "next" };
+    MAYFLY_CHECK(lines_of(parser.output) == expected);
+    MAYFLY_CHECK(parser.state == detail::_protocol_parser::not_started);
+});
+
+MAYFLY_ADD_TESTCASE("binary frames split across reads", []
+{
+    detail::_protocol_parser parser;
+    parser.binary = true;
+
+    std::uint64_t cycles = 42;
+    std::string counters{ reinterpret_cast<const char *>(&cycles), sizeof(cycles) };
+    counters += '\x06';
+    counters += "cycles";
+
+    detail::_finished_frame finished{};
+    finished.status = static_cast<std::uint8_t>(reaver::mayfly::testcase_status::failed);
+    finished.duration = 100;
+    finished.assertions = 3;
+    finished.user_time = 2;
+    finished.peak_rss = 4;
+
+    auto frames = encoded(detail::_frame_type::started) + encoded(detail::_frame_type::counters, counters.data(), counters.size())
+        + encoded(detail::_frame_type::finished, &finished, sizeof(finished), "oops") + encoded(detail::_frame_type::done);
+
+    // a byte at a time, so that every frame is split at every possible place
+    std::size_t done = 0;
+    for (std::size_t i = 0; i < frames.size(); ++i)
+    {
+        done += parser.feed_frames(frames.data() + i, 1);
+        MAYFLY_CHECK(done == (i + 1 == frames.size()));
+    }
+
+    MAYFLY_CHECK(parser.state == detail::_protocol_parser::exited);
+    MAYFLY_CHECK(parser.status == reaver::mayfly::testcase_status::failed);
+    MAYFLY_CHECK(parser.description == "oops");
+    MAYFLY_CHECK(parser.duration == std::chrono::nanoseconds{ 100 });
+    MAYFLY_CHECK(parser.assertions == 3);
+    MAYFLY_CHECK(parser.usage.user_time == std::chrono::nanoseconds{ 2 });
+    MAYFLY_CHECK(parser.usage.peak_rss == 4);
+    MAYFLY_CHECK(!parser.unexpected_status);
+
+    MAYFLY_REQUIRE(parser.counters.size() == 1);
+    MAYFLY_CHECK(parser.counters[0].first == "cycles");
+    MAYFLY_CHECK(parser.counters[0].second == 42);
+
+    // with the binary protocol, stdout is only ever output
+    std::string out = "{{finished}}\nplain";
+    MAYFLY_CHECK(!parser.feed(out.data(), out.size()));
+    parser.finish();
+
+    std::vector<std::string> expected{ "{{finished}}", "plain" };
+    MAYFLY_CHECK(lines_of(parser.output) == expected);
+});
+
+MAYFLY_ADD_TESTCASE("malformed binary frames", []
+{
+    {
+        detail::_protocol_parser parser;
+        parser.binary = true;
+
+        // a `finished` frame too short to hold its fixed part
+        char truncated[10] = {};
+        auto frames = encoded(detail::_frame_type::started) + encoded(detail::_frame_type::finished, truncated, sizeof(truncated));
+        MAYFLY_CHECK(!parser.feed_frames(frames.data(), frames.size()));
+
+        MAYFLY_CHECK(parser.unexpected_status);
+        MAYFLY_CHECK(parser.state == detail::_protocol_parser::started);
+    }
+
+    {
+        detail::_protocol_parser parser;
+        parser.binary = true;
+
+        detail::_finished_frame finished{};
+        finished.status = 200;
+        auto frames = encoded(detail::_frame_type::finished, &finished, sizeof(finished));
+        parser.feed_frames(frames.data(), frames.size());
+
+        MAYFLY_CHECK(parser.unexpected_status);
+    }
+
+    {
+        detail::_protocol_parser parser;
+        parser.binary = true;
+
+        // only the header of a frame; nothing happens until the rest arrives
+        auto frames = encoded(detail::_frame_type::done);
+        MAYFLY_CHECK(!parser.feed_frames(frames.data(), frames.size() - 1));
+        MAYFLY_CHECK(parser.state == detail::_protocol_parser::not_started);
+        MAYFLY_CHECK(parser.feed_frames(frames.data() + frames.size() - 1, 1));
+    }
+});
+
+MAYFLY_END_SUITE;
@@ -0,0 +1,443 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#include "mayfly.h"
+#include "mayfly/runner.h"
+#include "mayfly/driver.h"
+#include "mayfly/json.h"
+#include "mayfly/junit.h"
+
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <iterator>
+
+#include "harness.h"
+
+using namespace mayfly_tests;
+
+MAYFLY_BEGIN_IN_PROCESS_SUITE("runners");
+
+MAYFLY_ADD_TESTCASE("in-process runner results", []
+{
+    auto suites = sample_suites();
+    reaver::mayfly::inprocess_runner runner{ 3 };
+    auto log = run_recorded(runner, suites);
+
+    MAYFLY_REQUIRE(runner.total() == 4);
+    MAYFLY_REQUIRE(runner.passed() == 2);
+
+    std::vector<std::string> expected{ "+outer", "+inner", "failing failed", "-inner", "first passed", "second passed", "throwing failed", "-outer" };
+    MAYFLY_CHECK(log.events == expected);
+});
+
+MAYFLY_ADD_TESTCASE("unknown exceptions fail the testcase", []
+{
+    reaver::mayfly::suite outer{ "outer", {}, {}, true };
+    outer.add("throwing", []{ throw 42; });
+    std::vector<reaver::mayfly::suite> suites{ std::move(outer) };
+
+    {
+        reaver::mayfly::inprocess_runner runner{ 1 };
+        auto log = run_recorded(runner, suites);
+
+        MAYFLY_REQUIRE(log.results.size() == 1);
+        MAYFLY_CHECK(log.results[0].status == reaver::mayfly::testcase_status::failed);
+        MAYFLY_CHECK(log.results[0].description == "unknown exception thrown");
+    }
+
+    {
+        // an in-process suite never gets as far as spawning the executable
+        reaver::mayfly::subprocess_runner runner{ "/nonexistent" };
+        auto log = run_recorded(runner, suites);
+
+        MAYFLY_REQUIRE(log.results.size() == 1);
+        MAYFLY_CHECK(log.results[0].status == reaver::mayfly::testcase_status::failed);
+        MAYFLY_CHECK(log.results[0].description == "unknown exception thrown");
+    }
+});
+
+MAYFLY_ADD_TESTCASE("runner statistics", []
+{
+    auto suites = sample_suites();
+    reaver::mayfly::inprocess_runner runner{ 2 };
+    run_recorded(runner, suites);
+
+    auto && stats = runner.stats();
+    MAYFLY_CHECK(stats.executed == 4);
+    MAYFLY_CHECK(stats.reported == 4);
+    MAYFLY_CHECK(stats.starts == 0);
+    MAYFLY_CHECK(stats.run >= std::chrono::milliseconds{ 20 });
+    MAYFLY_CHECK(stats.peak_rss > 0);
+
+    run_recorded(runner, suites);
+    MAYFLY_CHECK(runner.stats().executed == 4);
+});
+
+MAYFLY_ADD_TESTCASE("sharding covers the tree", []
+{
+    auto suites = sample_suites();
+    std::size_t total = 0;
+
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        reaver::mayfly::inprocess_runner runner{ 2 };
+        runner.shard(i, 3);
+        run_recorded(runner, suites);
+
+        total += runner.total();
+    }
+
+    MAYFLY_REQUIRE(total == 4);
+});
+
+MAYFLY_ADD_TESTCASE("filters prune the tree", []
+{
+    auto suites = sample_suites();
+
+    {
+        reaver::mayfly::inprocess_runner runner{ 2 };
+        runner.filter("outer/*");
+        runner.exclude("outer/inner/*");
+        runner.exclude("*ing");
+        auto log = run_recorded(runner, suites);
+
+        std::vector<std::string> expected{ "+outer", "first passed", "second passed", "-outer" };
+        MAYFLY_CHECK(log.events == expected);
+    }
+
+    {
+        reaver::mayfly::inprocess_runner runner{ 2 };
+        runner.filter("re:^outer/(inner/fail|sec)");
+        auto log = run_recorded(runner, suites);
+
+        std::vector<std::string> expected{ "+outer", "+inner", "failing failed", "-inner", "second passed", "-outer" };
+        MAYFLY_CHECK(log.events == expected);
+    }
+
+    namespace detail = reaver::mayfly::_detail;
+    MAYFLY_CHECK(detail::_glob_match("net/*", "net/tcp/connect"));
+    MAYFLY_CHECK(detail::_glob_match("*slow*", "net/slow connect"));
+    MAYFLY_CHECK(!detail::_glob_match("net/?", "net/ab"));
+    MAYFLY_CHECK(detail::_glob_match("*/tcp/*", "net/", true));
+    MAYFLY_CHECK(!detail::_glob_match("net/*", "disk/", true));
+});
+
+MAYFLY_ADD_TESTCASE("rerunning failed tests", []
+{
+    auto suites = sample_suites();
+    temporary_directory directory;
+    auto path = directory.file("results");
+
+    {
+        reaver::mayfly::inprocess_runner runner{ 2 };
+        runner.result_cache(path);
+        runner.rerun_failed();
+        run_recorded(runner, suites);
+
+        MAYFLY_REQUIRE(runner.total() == 4);
+    }
+
+    {
+        reaver::mayfly::inprocess_runner runner{ 2 };
+        runner.result_cache(path);
+        runner.rerun_failed();
+        auto log = run_recorded(runner, suites);
+
+        std::vector<std::string> expected{ "+outer", "+inner", "failing failed", "-inner", "throwing failed", "-outer" };
+        MAYFLY_CHECK(log.events == expected);
+    }
+
+    {
+        reaver::mayfly::inprocess_runner runner{ 2 };
+        runner.result_cache(path);
+        runner.failed_first();
+        auto log = run_recorded(runner, suites);
+
+        MAYFLY_REQUIRE(runner.total() == 4);
+
+        std::vector<std::string> expected{ "+outer", "+inner", "failing failed", "-inner", "throwing failed", "-outer",
+            "+outer", "first passed", "second passed", "-outer" };
+        MAYFLY_CHECK(log.events == expected);
+    }
+});
+
+MAYFLY_ADD_TESTCASE("result caches shared by executables", []
+{
+    using reaver::mayfly::testcase_status;
+
+    auto suites = sample_suites();
+    temporary_directory directory;
+    auto path = directory.file("results");
+    auto && self = reaver::mayfly::_detail::_self_executable();
+
+    // the same paths, from another executable run from the same directory
+    reaver::mayfly::_detail::_save_result_cache(path, { { { "/elsewhere/other", "outer/first" }, { testcase_status::failed } },
+        { { "/elsewhere/other", "outer/second" }, { testcase_status::passed } } });
+
+    // none of the testcases of this tree failed before, so everything runs
+    reaver::mayfly::inprocess_runner runner{ 2 };
+    runner.result_cache(path);
+    runner.rerun_failed();
+    run_recorded(runner, suites);
+    MAYFLY_CHECK(runner.total() == 4);
+
+    auto results = reaver::mayfly::_detail::_load_result_cache(path);
+    MAYFLY_REQUIRE(results.size() == 6);
+    MAYFLY_CHECK(results.at({ "/elsewhere/other", "outer/first" }).status == testcase_status::failed);
+    MAYFLY_CHECK(results.at({ self, "outer/first" }).status == testcase_status::passed);
+    MAYFLY_CHECK(results.at({ self, "outer/throwing" }).status == testcase_status::failed);
+});
+
+MAYFLY_ADD_TESTCASE("fail-fast cancels the rest of the run", []
+{
+    auto suites = sample_suites();
+    reaver::mayfly::inprocess_runner runner{ 1 };
+    runner.fail_fast();
+    auto log = run_recorded(runner, suites);
+
+    MAYFLY_REQUIRE(runner.total() == 1);
+    MAYFLY_REQUIRE(runner.passed() == 0);
+
+    std::vector<std::string> expected{ "+outer", "+inner", "failing failed", "-inner", "-outer" };
+    MAYFLY_CHECK(log.events == expected);
+});
+
+MAYFLY_ADD_TESTCASE("fail-fast counts regressions", []
+{
+    reaver::mayfly::suite outer{ "outer" };
+    outer.add("slow", []{ std::this_thread::sleep_for(std::chrono::milliseconds{ 100 }); });
+    for (auto i = 0; i < 5; ++i)
+    {
+        outer.add("later " + std::to_string(i), []{ std::this_thread::sleep_for(std::chrono::milliseconds{ 20 }); });
+    }
+    std::vector<reaver::mayfly::suite> suites{ std::move(outer) };
+
+    temporary_directory directory;
+    reaver::mayfly::_detail::_save_baseline(directory.file("baseline"), { { "outer/slow", { std::chrono::milliseconds{ 1 }, {} } } });
+
+    reaver::mayfly::inprocess_runner runner{ 1 };
+    runner.fail_fast();
+    runner.baseline(directory.file("baseline"));
+    auto log = run_recorded(runner, suites);
+
+    // the regression is only decided once "slow" is reported, by which time the next testcase may already be running
+    MAYFLY_REQUIRE(!log.results.empty());
+    MAYFLY_CHECK(log.results[0].status == reaver::mayfly::testcase_status::regressed);
+    MAYFLY_CHECK(log.results.size() <= 2);
+});
+
+MAYFLY_ADD_TESTCASE("cancelled tests leave the history and the cache alone", []
+{
+    auto suites = sample_suites();
+    temporary_directory directory;
+
+    reaver::mayfly::inprocess_runner runner{ 1 };
+    runner.fail_fast();
+    runner.timing_history(directory.file("timings"));
+    runner.result_cache(directory.file("results"));
+    run_recorded(runner, suites);
+
+    auto timings = reaver::mayfly::_detail::_load_timings(directory.file("timings"));
+    MAYFLY_REQUIRE(timings.size() == 1);
+    MAYFLY_CHECK(timings.count("outer/inner/failing"));
+
+    auto results = reaver::mayfly::_detail::_load_result_cache(directory.file("results"));
+    MAYFLY_REQUIRE(results.size() == 1);
+    MAYFLY_CHECK(results.at({ reaver::mayfly::_detail::_self_executable(), "outer/inner/failing" }).status == reaver::mayfly::testcase_status::failed);
+});
+
+MAYFLY_ADD_TESTCASE("fixtures are set up once per process", []
+{
+    std::atomic<std::size_t> setups{ 0 };
+    reaver::mayfly::fixture<std::size_t> shared{ [&]{ return ++setups; } };
+
+    reaver::mayfly::suite inner{ "inner" };
+    inner.add("first", [&]{ MAYFLY_CHECK(*shared == 1); });
+
+    reaver::mayfly::suite outer{ "outer" };
+    outer.add_fixture(shared);
+    outer.add(std::move(inner));
+    outer.add("second", [&]{ MAYFLY_CHECK(*shared == 1); });
+    outer.add("third", [&]{ MAYFLY_CHECK(*shared == 1); });
+
+    std::vector<reaver::mayfly::suite> suites{ std::move(outer) };
+    reaver::mayfly::inprocess_runner runner{ 3 };
+    run_recorded(runner, suites);
+
+    MAYFLY_REQUIRE(runner.passed() == 3);
+    MAYFLY_CHECK(setups == 1);
+
+    reaver::mayfly::_detail::_test_index index{ suites };
+    reaver::mayfly::_detail::_prepare_fixtures(index, *index.find("outer/inner/first"));
+    MAYFLY_CHECK(setups == 1);
+});
+
+MAYFLY_ADD_TESTCASE("failed fixture setups", []
+{
+    std::atomic<std::size_t> setups{ 0 };
+    reaver::mayfly::fixture<int> broken{ [&]() -> int { ++setups; throw std::runtime_error{ "no database" }; } };
+
+    reaver::mayfly::suite outer{ "outer" };
+    outer.add_fixture(broken);
+    outer.add("first", [&]{ broken.get(); });
+    outer.add("second", [&]{ broken.get(); });
+    outer.add("unaffected", []{});
+
+    // preparing never throws; the testcases using the fixture do, with what the setup threw
+    std::vector<reaver::mayfly::suite> suites{ std::move(outer) };
+    reaver::mayfly::_detail::_test_index index{ suites };
+    reaver::mayfly::_detail::_prepare_fixtures(index, *index.find("outer/first"));
+
+    reaver::mayfly::inprocess_runner runner{ 2 };
+    auto log = run_recorded(runner, suites);
+
+    MAYFLY_CHECK(setups == 1);
+    MAYFLY_REQUIRE(log.results.size() == 3);
+    MAYFLY_CHECK(log.results[0].status == reaver::mayfly::testcase_status::failed);
+    MAYFLY_CHECK(log.results[0].description == "no database");
+    MAYFLY_CHECK(log.results[1].description == "no database");
+    MAYFLY_CHECK(log.results[2].status == reaver::mayfly::testcase_status::passed);
+});
+
+MAYFLY_ADD_TESTCASE("sanitizer reports on stderr", []
+{
+    using reaver::mayfly::testcase_status;
+
+    reaver::mayfly::_detail::_protocol_parser parser;
+    auto feed = [&](const std::string & errors){ parser.feed_errors(errors.data(), errors.size()); };
+
+    feed("some noise\n==42==ERROR: LeakSanitizer: detected memory leaks\n\nDirect leak of 4 byte(s)");
+    feed(" in 1 object(s)\nSUMMARY: AddressSanitizer: 4 byte(s) leaked in 1 allocation(s).");
+    parser.finish_errors();
+
+    MAYFLY_REQUIRE(parser.sanitizer.status == testcase_status::leaked);
+    MAYFLY_CHECK(parser.sanitizer.description == "AddressSanitizer: 4 byte(s) leaked in 1 allocation(s).");
+
+    std::size_t lines = 0;
+    parser.output.for_each_line([&](const char *, std::size_t){ ++lines; });
+    MAYFLY_CHECK(lines == 5);
+
+    parser.reset();
+    MAYFLY_CHECK(!parser.sanitizer);
+
+    feed("tests/ub.cpp:3:12: runtime error: signed integer overflow\n");
+    MAYFLY_REQUIRE(parser.sanitizer.status == testcase_status::undefined_behavior);
+    MAYFLY_CHECK(parser.sanitizer.description == "tests/ub.cpp:3:12: runtime error: signed integer overflow");
+});
+
+MAYFLY_ADD_TESTCASE("driver tree from test lists", []
+{
+    auto suites = sample_suites();
+    suites[0].add(reaver::mayfly::testcase{ "gpu", []{} }.uses("gpu:2"));
+
+    std::stringstream listing;
+    reaver::mayfly::_detail::_list_tests(listing, suites);
+
+    std::vector<reaver::mayfly::_detail::_listed_test> tests;
+    MAYFLY_REQUIRE(reaver::mayfly::_detail::_read_test_list(listing, tests));
+    MAYFLY_REQUIRE(tests.size() == 5);
+    MAYFLY_CHECK(tests[0].id == 0);
+    MAYFLY_CHECK(tests[0].suite_path == "outer/inner");
+    MAYFLY_CHECK(tests[0].name == "failing");
+    MAYFLY_CHECK(tests[4].resources == "gpu:2");
+
+    std::stringstream malformed{ "1\touter\n" };
+    std::vector<reaver::mayfly::_detail::_listed_test> rejected;
+    MAYFLY_CHECK(!reaver::mayfly::_detail::_read_test_list(malformed, rejected));
+
+    reaver::mayfly::driver_runner driver;
+    driver.add_executable("./bin/first", tests);
+    MAYFLY_CHECK_THROWS_TYPE(reaver::mayfly::duplicate_test_executable, driver.add_executable("./other/first", tests));
+
+    auto && combined = driver.suites();
+    MAYFLY_REQUIRE(combined.size() == 1);
+    MAYFLY_CHECK(combined[0].name() == "first");
+    MAYFLY_REQUIRE(combined[0]["outer"].suites().size() == 1);
+    MAYFLY_CHECK(combined[0]["outer"]["inner"].begin()->name() == "failing");
+    MAYFLY_CHECK(std::distance(combined[0]["outer"].begin(), combined[0]["outer"].end()) == 4);
+});
+
+MAYFLY_ADD_TESTCASE("json report", []
+{
+    auto suites = sample_suites();
+    reaver::mayfly::suite pipes{ "pipes" };
+    pipes.add("pipes|nin a name", []{ throw std::runtime_error{ "first line|nsecond" }; });
+    suites.push_back(std::move(pipes));
+
+    temporary_directory directory;
+    auto path = directory.file("report.ndjson");
+
+    {
+        reaver::mayfly::json_reporter rep;
+        rep.open(path);
+
+        reaver::mayfly::inprocess_runner runner{ 2 };
+        runner(suites, rep);
+        runner.summary(rep);
+    }
+
+    std::ifstream in{ path };
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(in, line); )
+    {
+        lines.push_back(line);
+    }
+
+    MAYFLY_REQUIRE(lines.size() == 6);
+    MAYFLY_CHECK(lines[0].find("{\"suite\":\"outer/inner\",\"name\":\"failing\",\"status\":\"failed\"") == 0);
+    MAYFLY_CHECK(lines[3].find("\"description\":\"oops\"") != std::string::npos);
+    MAYFLY_CHECK(lines[5].find("{\"summary\":{\"total\":5,\"passed\":2,\"failed\":3,") == 0);
+
+    // only the descriptions have their line breaks encoded
+    MAYFLY_CHECK(lines[4].find("\"name\":\"pipes|nin a name\"") != std::string::npos);
+    MAYFLY_CHECK(lines[4].find("\"description\":\"first line\\nsecond\"") != std::string::npos);
+});
+
+MAYFLY_ADD_TESTCASE("junit report", []
+{
+    reaver::mayfly::suite outer{ "pipes|nin a suite" };
+    outer.add("pipes|nin a name", []{ throw std::runtime_error{ "first line|nsecond <line>" }; });
+    std::vector<reaver::mayfly::suite> suites{ std::move(outer) };
+
+    temporary_directory directory;
+    auto path = directory.file("report.xml");
+
+    {
+        reaver::mayfly::junit_reporter rep;
+        rep.open(path);
+
+        reaver::mayfly::inprocess_runner runner{ 1 };
+        runner(suites, rep);
+        runner.summary(rep);
+    }
+
+    std::ifstream in{ path };
+    std::string report{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{} };
+
+    // only the descriptions have their line breaks encoded
+    MAYFLY_CHECK(report.find("<testsuite name=\"pipes|nin a suite\">") != std::string::npos);
+    MAYFLY_CHECK(report.find("classname=\"pipes|nin a suite\" name=\"pipes|nin a name\"") != std::string::npos);
+    MAYFLY_CHECK(report.find("message=\"first line&#10;second &lt;line&gt;\"") != std::string::npos);
+});
+
+MAYFLY_END_SUITE;
@@ -0,0 +1,283 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#include "mayfly.h"
+#include "mayfly/runner.h"
+#include "mayfly/driver.h"
+
+#include <cstdlib>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "harness.h"
+
+using namespace mayfly_tests;
+
+namespace
+{
+    std::map<std::string, reaver::mayfly::testcase_status> statuses(const recorded & log)
+    {
+        std::map<std::string, reaver::mayfly::testcase_status> statuses;
+        for (auto && result : log.results)
+        {
+            statuses[result.name] = result.status;
+        }
+        return statuses;
+    }
+}
+
+// the testcases of these suites run in children of the runners under test, so that a crash or a kill of one of those takes nothing else down
+MAYFLY_BEGIN_SUITE("subprocess runner");
+
+MAYFLY_ADD_TESTCASE("subprocess isolation", []
+{
+    using reaver::mayfly::testcase_status;
+
+    auto suites = helper_suites();
+
+    for (auto protocol : { reaver::mayfly::result_protocol::text, reaver::mayfly::result_protocol::binary })
+    {
+        reaver::mayfly::subprocess_runner runner{ helper_executable(), 3, 1, {}, reaver::mayfly::isolation_mode::subprocess, protocol };
+
+        auto begin = std::chrono::steady_clock::now();
+        auto log = run_recorded(runner, suites);
+        auto results = statuses(log);
+
+        // the watchdog kills the child that overran its timeout, and nothing else
+        std::map<std::string, testcase_status> expected{ { "passing", testcase_status::passed }, { "failing", testcase_status::failed },
+            { "throwing", testcase_status::failed }, { "aborting", testcase_status::crashed }, { "sleeping", testcase_status::timed_out },
+            { "chatty", testcase_status::passed }, { "sanitizer", testcase_status::memory_error } };
+        MAYFLY_CHECK(results == expected);
+        MAYFLY_CHECK(runner.stats().starts == 7);
+        MAYFLY_CHECK(std::chrono::steady_clock::now() - begin < std::chrono::seconds{ 10 });
+
+        for (auto && result : log.results)
+        {
+            if (result.name == "throwing")
+            {
+                MAYFLY_CHECK(result.description == "unknown exception thrown");
+            }
+
+            if (result.name == "sleeping")
+            {
+                MAYFLY_CHECK(result.duration >= std::chrono::seconds{ 1 });
+            }
+        }
+    }
+});
+
+MAYFLY_ADD_TESTCASE("output on both pipes", []
+{
+    auto suites = helper_suites();
+
+    // 4MiB on each of stdout and stderr; reading one of them to the end before the other would leave the child blocked on a full pipe
+    reaver::mayfly::subprocess_runner runner{ helper_executable(), 1, 5 };
+    runner.filter("*/chatty");
+    runner.output_limit(4096);
+    auto log = run_recorded(runner, suites);
+
+    MAYFLY_REQUIRE(log.results.size() == 1);
+    MAYFLY_CHECK(log.results[0].status == reaver::mayfly::testcase_status::passed);
+});
+
+MAYFLY_ADD_TESTCASE("sanitizer reports", []
+{
+    using reaver::mayfly::testcase_status;
+
+    auto suites = helper_suites();
+
+    for (auto mode : { reaver::mayfly::isolation_mode::subprocess, reaver::mayfly::isolation_mode::batch })
+    {
+        // the report on stderr is what the testcase fails with, whether it ran in a child of its own or in a worker
+        reaver::mayfly::subprocess_runner runner{ helper_executable(), 1, 5, {}, mode };
+        runner.filter("*/sanitizer");
+        runner.filter("*/passing");
+        auto results = run_recorded(runner, suites).results;
+
+        MAYFLY_REQUIRE(results.size() == 2);
+        for (auto && result : results)
+        {
+            if (result.name == "sanitizer")
+            {
+                MAYFLY_CHECK(result.status == testcase_status::memory_error);
+                MAYFLY_CHECK(result.description == "AddressSanitizer: heap-use-after-free helper.cpp:1 in f");
+            }
+
+            else
+            {
+                MAYFLY_CHECK(result.status == testcase_status::passed);
+            }
+        }
+    }
+});
+
+MAYFLY_ADD_TESTCASE("fork-server isolation", []
+{
+    using reaver::mayfly::testcase_status;
+
+    reaver::mayfly::suite forked{ "forked" };
+    forked.add("passing", []{});
+    forked.add("failing", []{ MAYFLY_CHECK(false); });
+    forked.add("aborting", []{ std::abort(); });
+    forked.add("sleeping", []{ std::this_thread::sleep_for(std::chrono::seconds{ 30 }); });
+    std::vector<reaver::mayfly::suite> suites{ std::move(forked) };
+
+    for (auto protocol : { reaver::mayfly::result_protocol::text, reaver::mayfly::result_protocol::binary })
+    {
+        // the children are forked off the zygote, which has the tree in memory; the executable is never started
+        reaver::mayfly::subprocess_runner runner{ "/nonexistent", 2, 1, {}, reaver::mayfly::isolation_mode::fork_server, protocol };
+
+        auto begin = std::chrono::steady_clock::now();
+        auto results = statuses(run_recorded(runner, suites));
+
+        std::map<std::string, testcase_status> expected{ { "passing", testcase_status::passed }, { "failing", testcase_status::failed },
+            { "aborting", testcase_status::crashed }, { "sleeping", testcase_status::timed_out } };
+        MAYFLY_CHECK(results == expected);
+        MAYFLY_CHECK(runner.stats().starts == 4);
+        MAYFLY_CHECK(std::chrono::steady_clock::now() - begin < std::chrono::seconds{ 10 });
+    }
+});
+
+MAYFLY_ADD_TESTCASE("fixtures in the zygote", []
+{
+    using reaver::mayfly::testcase_status;
+
+    reaver::mayfly::fixture<pid_t> creator{ []{ return ::getpid(); } };
+    reaver::mayfly::fixture<int> broken{ []() -> int { throw std::runtime_error{ "no database" }; } };
+
+    reaver::mayfly::suite inner{ "inner" };
+    inner.add("shared", [&]{ MAYFLY_CHECK(*creator != ::getpid()); });
+    inner.add("broken", [&]{ broken.get(); });
+
+    reaver::mayfly::suite outer{ "outer" };
+    outer.add_fixture(creator);
+    outer.add(std::move(inner));
+    outer["inner"].add_fixture(broken);
+    std::vector<reaver::mayfly::suite> suites{ std::move(outer) };
+
+    // the fixtures of the enclosing suites are created in the zygote, and a failed setup is what the testcase using it fails with
+    reaver::mayfly::subprocess_runner runner{ "/nonexistent", 1, 5, {}, reaver::mayfly::isolation_mode::fork_server };
+    auto log = run_recorded(runner, suites);
+
+    MAYFLY_REQUIRE(log.results.size() == 2);
+    MAYFLY_CHECK(log.results[0].status == testcase_status::passed);
+    MAYFLY_CHECK(log.results[1].status == testcase_status::failed);
+    MAYFLY_CHECK(log.results[1].description == "no database");
+});
+
+MAYFLY_ADD_TESTCASE("batch isolation", []
+{
+    using reaver::mayfly::testcase_status;
+
+    auto suites = helper_suites();
+
+    for (auto protocol : { reaver::mayfly::result_protocol::text, reaver::mayfly::result_protocol::binary })
+    {
+        // a single worker at a time; one that crashed is replaced for the testcases after it, and an exception of an unknown type
+        // doesn't end it
+        reaver::mayfly::subprocess_runner runner{ helper_executable(), 1, 1, {}, reaver::mayfly::isolation_mode::batch, protocol };
+
+        auto begin = std::chrono::steady_clock::now();
+        auto results = statuses(run_recorded(runner, suites));
+
+        std::map<std::string, testcase_status> expected{ { "passing", testcase_status::passed }, { "failing", testcase_status::failed },
+            { "throwing", testcase_status::failed }, { "aborting", testcase_status::crashed }, { "sleeping", testcase_status::timed_out },
+            { "chatty", testcase_status::passed }, { "sanitizer", testcase_status::memory_error } };
+        MAYFLY_CHECK(results == expected);
+        MAYFLY_CHECK(std::chrono::steady_clock::now() - begin < std::chrono::seconds{ 10 });
+    }
+});
+
+MAYFLY_ADD_TESTCASE("fail-fast kills running children", []
+{
+    auto suites = helper_suites();
+    temporary_directory directory;
+
+    reaver::mayfly::subprocess_runner runner{ helper_executable(), 2 };
+    runner.filter("*/failing");
+    runner.filter("*/sleeping");
+    runner.fail_fast();
+    runner.timing_history(directory.file("timings"));
+    runner.result_cache(directory.file("results"));
+
+    // without the kill, the run would wait for the sleeping child for 30 seconds
+    auto begin = std::chrono::steady_clock::now();
+    auto log = run_recorded(runner, suites);
+    MAYFLY_CHECK(std::chrono::steady_clock::now() - begin < std::chrono::seconds{ 10 });
+
+    MAYFLY_REQUIRE(log.results.size() == 1);
+    MAYFLY_CHECK(log.results[0].name == "failing");
+
+    // the killed testcase never finished, so it has no duration and no result to remember
+    auto timings = reaver::mayfly::_detail::_load_timings(directory.file("timings"));
+    MAYFLY_REQUIRE(timings.size() == 1);
+    MAYFLY_CHECK(timings.begin()->first.find("/failing") != std::string::npos);
+
+    auto results = reaver::mayfly::_detail::_load_result_cache(directory.file("results"));
+    MAYFLY_REQUIRE(results.size() == 1);
+    MAYFLY_CHECK(results.begin()->second.status == reaver::mayfly::testcase_status::failed);
+});
+
+MAYFLY_ADD_TESTCASE("driver pooling", []
+{
+    using reaver::mayfly::testcase_status;
+
+    // the same helper twice, under another name; the driver takes every executable as a separate one
+    temporary_directory directory;
+    boost::filesystem::create_symlink(helper_executable(), directory.file("other"));
+
+    reaver::mayfly::driver_runner driver{ 2, 2 };
+    driver.add_executable(helper_executable());
+    driver.add_executable(directory.file("other"));
+    driver.filter("*/passing");
+    driver.filter("*/failing");
+    driver.filter("*/sleeping");
+
+    // both sleeping testcases time out at once; an executable at a time would take twice the timeout
+    auto begin = std::chrono::steady_clock::now();
+    auto log = run_recorded(driver, driver.suites());
+    MAYFLY_CHECK(std::chrono::steady_clock::now() - begin < std::chrono::milliseconds{ 3500 });
+
+    MAYFLY_REQUIRE(log.results.size() == 6);
+    MAYFLY_CHECK(driver.stats().starts == 6);
+    MAYFLY_CHECK(std::count(log.events.begin(), log.events.end(), "+helper") == 1);
+    MAYFLY_CHECK(std::count(log.events.begin(), log.events.end(), "+other") == 1);
+
+    std::map<std::string, std::size_t> counts;
+    for (auto && result : log.results)
+    {
+        ++counts[result.name];
+
+        auto expected = result.name == "passing" ? testcase_status::passed : result.name == "failing" ? testcase_status::failed : testcase_status::timed_out;
+        MAYFLY_CHECK(result.status == expected);
+    }
+
+    std::map<std::string, std::size_t> expected{ { "passing", 2 }, { "failing", 2 }, { "sleeping", 2 } };
+    MAYFLY_CHECK(counts == expected);
+});
+
+MAYFLY_END_SUITE;
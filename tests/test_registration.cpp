@@ -94,5 +94,127 @@ MAYFLY_ADD_TESTCASE("test case without existing parent", []
     MAYFLY_REQUIRE_THROWS_TYPE(reaver::mayfly::unknown_suite, registry.add("foobar", { "barfoo", []{} }));
 });
 
+MAYFLY_ADD_TESTCASE("test index", []
+{
+    reaver::mayfly::suite_registry registry;
+
+    registry.add({ "foobar" });
+    registry.add("foobar", { "first", []{} });
+    registry.add({ "fizzbuzz" }, "foobar");
+    registry.add("foobar/fizzbuzz", { "nested", []{} });
+
+    // sub-suites come first, like in the plan of a run
+    auto && index = registry.index();
+    MAYFLY_REQUIRE(index.entries().size() == 2);
+    MAYFLY_REQUIRE(index.resolve("foobar/fizzbuzz/nested") == index.find(std::size_t{ 0 }));
+    MAYFLY_REQUIRE(index.resolve("#1")->path == "foobar/first");
+    MAYFLY_CHECK(index.resolve("#2") == nullptr);
+    MAYFLY_CHECK(index.resolve("#1x") == nullptr);
+    MAYFLY_CHECK(index.resolve("foobar/missing") == nullptr);
+
+    registry.add("foobar", { "second", []{} });
+    MAYFLY_CHECK(registry.index().resolve("#2")->path == "foobar/second");
+});
+
+MAYFLY_ADD_TESTCASE("deferred registration", []
+{
+    reaver::mayfly::suite_registry registry{ true };
+
+    registry.add({ "foobar" });
+    registry.add("foobar", { "first", []{} });
+    registry.add({ "fizzbuzz" }, "foobar");
+    registry.add("foobar/fizzbuzz", { "nested", []{} });
+    MAYFLY_REQUIRE_THROWS_TYPE(reaver::mayfly::duplicate_testcase_registration, registry.add("foobar", { "first", []{} }));
+    MAYFLY_CHECK(registry.startup_profile().materializations == 0);
+    MAYFLY_CHECK(registry.startup_profile().suites == 2);
+    MAYFLY_CHECK(registry.startup_profile().testcases == 2);
+
+    const std::vector<reaver::mayfly::suite> & suites = registry;
+    MAYFLY_CHECK(registry.startup_profile().materializations == 1);
+    MAYFLY_REQUIRE(suites.size() == 1);
+    MAYFLY_REQUIRE(suites[0].begin()->name() == "first");
+    MAYFLY_REQUIRE(suites[0].suites()[0].begin()->name() == "nested");
+
+    MAYFLY_CHECK(registry.index().resolve("#0")->path == "foobar/fizzbuzz/nested");
+    MAYFLY_CHECK(registry.startup_profile().materializations == 1);
+});
+
+MAYFLY_ADD_TESTCASE("test ids without the tree", []
+{
+    auto fill = [](reaver::mayfly::suite_registry & registry)
+    {
+        // a suite can come with testcases and sub-suites of its own, which go before the registered ones
+        reaver::mayfly::suite inner{ "inner" };
+        inner.add("inner own", []{});
+        reaver::mayfly::suite foobar{ "foobar" };
+        foobar.add("own", []{});
+        foobar.add(std::move(inner));
+
+        registry.add(std::move(foobar));
+        registry.add("foobar", { "first", []{} });
+        registry.add({ "fizzbuzz" }, "foobar");
+        registry.add("foobar/fizzbuzz", reaver::mayfly::parameterized("squares", std::vector<int>{ 1, 2, 3 }, [](int){},
+            [](int value, std::size_t){ return std::to_string(value * value); }));
+        registry.add({ "barfoo" });
+        registry.add("barfoo", { "last", []{} });
+        registry.add("foobar/fizzbuzz", { "nested", []{} });
+    };
+
+    reaver::mayfly::suite_registry built{ true };
+    fill(built);
+    auto && index = built.index();
+
+    // the same ids, and the same testcases under them, as in the index of the whole tree, which is never built
+    reaver::mayfly::suite_registry recorded{ true };
+    fill(recorded);
+
+    for (std::size_t id = 0; id < 8; ++id)
+    {
+        auto single = recorded.index(id);
+        MAYFLY_REQUIRE(single->resolve("#" + std::to_string(id)) != nullptr);
+        MAYFLY_CHECK(single->resolve("#" + std::to_string(id))->path == index.resolve("#" + std::to_string(id))->path);
+    }
+
+    MAYFLY_CHECK(recorded.index(std::size_t{ 8 })->resolve("#8") == nullptr);
+    MAYFLY_CHECK(recorded.index(std::size_t{ 2 })->resolve("#2")->path == "foobar/fizzbuzz/squares[4]");
+    MAYFLY_CHECK(recorded.startup_profile().materializations == 0);
+
+    // once the tree is there, it's looked up in
+    const std::vector<reaver::mayfly::suite> & suites = recorded;
+    MAYFLY_CHECK(suites.size() == 2);
+    MAYFLY_CHECK(recorded.index(std::size_t{ 7 })->resolve("#7")->path == "barfoo/last");
+});
+
+MAYFLY_ADD_TESTCASE("parameterized testcase index", []
+{
+    reaver::mayfly::suite_registry registry;
+
+    registry.add({ "foobar" });
+    registry.add("foobar", reaver::mayfly::parameterized("squares", std::vector<int>{ 1, 2, 3 }, [](int){}, [](int value, std::size_t){ return std::to_string(value * value); }));
+    registry.add("foobar", { "last", []{} });
+
+    auto && index = registry.index();
+    MAYFLY_REQUIRE(index.entries().size() == 2);
+    MAYFLY_REQUIRE(index.resolve("#1") != nullptr);
+    MAYFLY_CHECK(index.resolve("#1")->path == "foobar/squares[4]");
+    MAYFLY_CHECK(index.resolve("#1")->test->name() == "squares[4]");
+    MAYFLY_CHECK(index.resolve("foobar/squares[9]") == index.find(std::size_t{ 2 }));
+    MAYFLY_CHECK(index.resolve("#3")->path == "foobar/last");
+    MAYFLY_CHECK(index.resolve("foobar/squares[2]") == nullptr);
+});
+
+MAYFLY_ADD_FIXTURE(shared_numbers, std::vector<int>, []{ return std::vector<int>{ 1, 2, 3 }; });
+
+MAYFLY_ADD_TESTCASE("suite fixture", []
+{
+    MAYFLY_REQUIRE(shared_numbers->size() == 3);
+    MAYFLY_CHECK(&*shared_numbers == &shared_numbers.get());
+});
+
+MAYFLY_ADD_PARAMETERIZED_TESTCASE("parameterized testcase", std::vector<int>{ 1, 2, 3, 4 }, [](int value)
+{
+    MAYFLY_CHECK(value > 0);
+});
+
 MAYFLY_END_SUITE;
 MAYFLY_END_SUITE;
@@ -21,6 +21,12 @@
  **/
 
 #include "mayfly.h"
+#include "mayfly/runner.h"
+#include "mayfly/detail/report_queue.h"
+#include "mayfly/detail/scheduler.h"
+
+#include <atomic>
+#include <algorithm>
 
 MAYFLY_BEGIN_SUITE("threads support");
 
@@ -34,5 +40,177 @@ MAYFLY_ADD_NEGATIVE_TESTCASE_N("multithreaded assertions", 1, []()
     }}.join();
 });
 
+MAYFLY_ADD_NEGATIVE_TESTCASE_N("concurrent assertions from many threads", 800, []()
+{
+    MAYFLY_MAIN_THREAD;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i)
+    {
+        threads.emplace_back([&](){
+            MAYFLY_THREAD;
+            for (int j = 0; j < 100; ++j)
+            {
+                MAYFLY_CHECK(false);
+            }
+        });
+    }
+
+    for (auto & thread : threads)
+    {
+        thread.join();
+    }
+});
+
+MAYFLY_ADD_TESTCASE("reporting thread sees every event in order", []()
+{
+    std::vector<std::vector<int>> seen(4);
+
+    {
+        // a tiny queue, so that the producers keep running into a full one
+        reaver::mayfly::_detail::_reporting_thread<std::pair<int, int>> events{ [&](std::pair<int, int> & event)
+        {
+            seen[event.first].push_back(event.second);
+        }, 4 };
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i)
+        {
+            threads.emplace_back([&, i](){
+                for (int j = 0; j < 1000; ++j)
+                {
+                    events.push({ i, j });
+                }
+            });
+        }
+
+        for (auto & thread : threads)
+        {
+            thread.join();
+        }
+
+        events.finish();
+    }
+
+    for (auto && producer : seen)
+    {
+        MAYFLY_REQUIRE(producer.size() == 1000);
+        for (int j = 0; j < 1000; ++j)
+        {
+            MAYFLY_REQUIRE(producer[j] == j);
+        }
+    }
+});
+
+MAYFLY_ADD_TESTCASE("scheduler respects resource capacities", []()
+{
+    namespace detail = reaver::mayfly::_detail;
+
+    std::atomic<int> gpu{ 0 }, running{ 0 };
+    std::atomic<int> max_gpu{ 0 }, max_running{ 0 };
+    std::atomic<bool> exclusive_overlapped{ false };
+
+    auto track = [](std::atomic<int> & counter, std::atomic<int> & maximum)
+    {
+        auto now = ++counter;
+        auto seen = maximum.load();
+        while (now > seen && !maximum.compare_exchange_weak(seen, now))
+        {
+        }
+    };
+
+    {
+        detail::_scheduler scheduler{ 8, detail::_resource_pool{ { { "gpu", 2 } } } };
+
+        for (int i = 0; i < 40; ++i)
+        {
+            bool exclusive = i % 10 == 9;
+            bool uses_gpu = !exclusive && i % 2;
+
+            scheduler.push([&, exclusive, uses_gpu]
+            {
+                track(running, max_running);
+                if (exclusive && running != 1)
+                {
+                    exclusive_overlapped = true;
+                }
+
+                if (uses_gpu)
+                {
+                    track(gpu, max_gpu);
+                }
+
+                std::this_thread::sleep_for(std::chrono::milliseconds{ 2 });
+
+                if (uses_gpu)
+                {
+                    --gpu;
+                }
+                --running;
+            }, detail::_parse_resources(exclusive ? "exclusive" : uses_gpu ? "gpu:1" : ""));
+        }
+
+        scheduler.wait();
+    }
+
+    MAYFLY_CHECK(max_gpu <= 2);
+    MAYFLY_CHECK(max_running > 1);
+    MAYFLY_CHECK(!exclusive_overlapped);
+
+    std::uint64_t amount = 0;
+    MAYFLY_CHECK(detail::_parse_amount("4G", amount) && amount == (std::uint64_t{ 4 } << 30));
+    MAYFLY_CHECK_THROWS(detail::_parse_resources("mem:4X"));
+
+    // amounts that don't fit in 64 bits, before or after scaling
+    MAYFLY_CHECK(!detail::_parse_amount("20000000T", amount));
+    MAYFLY_CHECK(!detail::_parse_amount("18446744073709551616", amount));
+    MAYFLY_CHECK(detail::_parse_amount("16777215T", amount) && amount == (std::uint64_t{ 16777215 } << 40));
+    MAYFLY_CHECK_THROWS(detail::_parse_resources("mem:20000000T"));
+
+    // a capacity of 0 would let every testcase using the resource run at once
+    reaver::mayfly::inprocess_runner runner;
+    MAYFLY_CHECK_THROWS_TYPE(reaver::mayfly::invalid_resource_capacity, runner.resource_capacity("gpu", 0));
+});
+
+MAYFLY_ADD_TESTCASE("workers are pinned where they were placed", []()
+{
+    namespace detail = reaver::mayfly::_detail;
+
+    MAYFLY_CHECK(detail::_parse_cpu_list("0-2,5") == (std::vector<int>{ 0, 1, 2, 5 }));
+
+    auto placement = detail::_worker_placement(4, reaver::mayfly::worker_placement::cpu);
+    MAYFLY_REQUIRE(placement.size() == 4);
+
+    std::atomic<int> misplaced{ 0 };
+
+    {
+        detail::_scheduler scheduler{ 4, {}, placement };
+
+        for (int i = 0; i < 16; ++i)
+        {
+            scheduler.push([&]
+            {
+                ::cpu_set_t set;
+                CPU_ZERO(&set);
+                ::sched_getaffinity(0, sizeof(set), &set);
+
+                if (std::none_of(placement.begin(), placement.end(), [&](auto && elem){ return CPU_EQUAL(&elem, &set); }))
+                {
+                    ++misplaced;
+                }
+            });
+        }
+
+        scheduler.wait();
+    }
+
+    MAYFLY_CHECK(misplaced == 0);
+    MAYFLY_CHECK(detail::_worker_placement(4, reaver::mayfly::worker_placement::none).empty());
+});
+
+MAYFLY_ADD_TESTCASE_USING("testcase holding resources", "exclusive", []()
+{
+});
+
 MAYFLY_END_SUITE;
 
@@ -0,0 +1,133 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#include "mayfly.h"
+#include "mayfly/detail/timings.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+
+#include "harness.h"
+
+namespace
+{
+    namespace detail = reaver::mayfly::_detail;
+}
+
+MAYFLY_BEGIN_SUITE("timings");
+
+MAYFLY_ADD_TESTCASE("timing history round trip", []
+{
+    mayfly_tests::temporary_directory directory;
+    auto path = directory.file("timings");
+
+    MAYFLY_CHECK(detail::_load_timings(path).empty());
+
+    detail::_timings timings{ { "outer/first", std::chrono::milliseconds{ 20 } }, { "outer/inner/with spaces", std::chrono::milliseconds{ 0 } },
+        { "other", std::chrono::milliseconds{ 123456 } } };
+    detail::_save_timings(path, timings);
+    MAYFLY_CHECK(detail::_load_timings(path) == timings);
+
+    // malformed lines are skipped, the rest is kept
+    {
+        std::ofstream out{ path, std::ios::app };
+        out << "garbage\n" << " no duration\n" << "x not a number\n" << "7 outer/second\n";
+    }
+
+    timings["outer/second"] = std::chrono::milliseconds{ 7 };
+    MAYFLY_CHECK(detail::_load_timings(path) == timings);
+
+    MAYFLY_CHECK_THROWS_TYPE(reaver::mayfly::timing_file_error, detail::_save_timings(directory.file("missing/timings"), timings));
+
+    MAYFLY_CHECK(detail::_mean_duration({}) == std::chrono::milliseconds{ 1 });
+    MAYFLY_CHECK(detail::_expected_duration(timings, "outer/first", std::chrono::milliseconds{ 5 }) == std::chrono::milliseconds{ 20 });
+    MAYFLY_CHECK(detail::_expected_duration(timings, "unknown", std::chrono::milliseconds{ 5 }) == std::chrono::milliseconds{ 5 });
+});
+
+MAYFLY_ADD_TESTCASE("hashed shards", []
+{
+    // pinned, so that every agent splits the tree the same way, whatever its standard library
+    MAYFLY_CHECK(detail::_shard_of("net/tcp/connect", 7) == 0);
+    MAYFLY_CHECK(detail::_shard_of("outer/inner/failing", 7) == 6);
+    MAYFLY_CHECK(detail::_shard_of("a", 7) == 5);
+    MAYFLY_CHECK(detail::_shard_of("anything", 1) == 0);
+
+    std::vector<std::size_t> sizes(4);
+    for (std::size_t i = 0; i < 4000; ++i)
+    {
+        ++sizes[detail::_shard_of("suite/test " + std::to_string(i), sizes.size())];
+    }
+
+    MAYFLY_CHECK(*std::min_element(sizes.begin(), sizes.end()) >= 800);
+    MAYFLY_CHECK(*std::max_element(sizes.begin(), sizes.end()) <= 1200);
+});
+
+MAYFLY_ADD_TESTCASE("weighted shards", []
+{
+    detail::_timings timings;
+    std::vector<std::string> paths;
+    for (std::size_t i = 1; i <= 10; ++i)
+    {
+        paths.push_back("suite/test " + std::to_string(i));
+        timings[paths.back()] = std::chrono::milliseconds{ 10 * i };
+    }
+
+    std::vector<std::chrono::milliseconds> loads;
+    std::vector<std::string> all;
+
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        auto shard = detail::_weighted_shard(paths, timings, i, 3);
+
+        // the order the testcases are collected in doesn't matter
+        auto reversed = paths;
+        std::reverse(reversed.begin(), reversed.end());
+        MAYFLY_CHECK(detail::_weighted_shard(reversed, timings, i, 3) == shard);
+
+        std::chrono::milliseconds load{};
+        for (auto && path : shard)
+        {
+            load += timings.at(path);
+            all.push_back(path);
+        }
+        loads.push_back(load);
+    }
+
+    std::sort(all.begin(), all.end());
+    auto sorted = paths;
+    std::sort(sorted.begin(), sorted.end());
+    MAYFLY_CHECK(all == sorted);
+
+    // 550ms in total; no shard is off by more than the longest testcase
+    MAYFLY_CHECK(*std::max_element(loads.begin(), loads.end()) - *std::min_element(loads.begin(), loads.end()) <= std::chrono::milliseconds{ 100 });
+
+    // testcases without a history weigh as much as an average one
+    detail::_timings single{ { "a", std::chrono::milliseconds{ 100 } } };
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        MAYFLY_CHECK(detail::_weighted_shard({ "a", "b", "c" }, single, i, 3).size() == 1);
+    }
+});
+
+MAYFLY_END_SUITE;
@@ -0,0 +1,73 @@
+/**
+ * Mayfly License
+ *
+ * Copyright © 2015 Michał "Griwes" Dominiak
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation is required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ **/
+
+#include "mayfly.h"
+#include "mayfly/detail/usage.h"
+
+#include <chrono>
+#include <vector>
+
+#include <time.h>
+
+MAYFLY_BEGIN_SUITE("resource usage");
+
+MAYFLY_ADD_TESTCASE("usage of the current thread", []
+{
+    reaver::mayfly::_detail::_usage_meter meter{ RUSAGE_THREAD };
+
+    // spin for 30ms of the thread's own CPU time, however loaded the machine is, and fault in a few fresh pages
+    auto cpu_time = []
+    {
+        ::timespec now;
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+        return std::chrono::seconds{ now.tv_sec } + std::chrono::nanoseconds{ now.tv_nsec };
+    };
+
+    auto begin = cpu_time();
+    while (cpu_time() - begin < std::chrono::milliseconds{ 30 })
+    {
+    }
+
+    std::vector<char> memory(16 << 20);
+    for (std::size_t i = 0; i < memory.size(); i += 4096)
+    {
+        memory[i] = 1;
+    }
+
+    auto usage = meter();
+    // the kernel accounts the CPU time a little coarser than the clock measures it
+    MAYFLY_CHECK(usage.user_time + usage.system_time >= std::chrono::milliseconds{ 20 });
+    MAYFLY_CHECK(usage.minor_faults > 0);
+    MAYFLY_CHECK(usage.peak_rss >= (16 << 10));
+});
+
+MAYFLY_ADD_TESTCASE("nothing measured", []
+{
+    reaver::mayfly::_detail::_usage_meter meter{ RUSAGE_SELF };
+    auto usage = meter();
+
+    MAYFLY_CHECK(usage.user_time >= std::chrono::nanoseconds{});
+    MAYFLY_CHECK(usage.system_time >= std::chrono::nanoseconds{});
+    MAYFLY_CHECK(usage.peak_rss > 0);
+});
+
+MAYFLY_END_SUITE;